@@ -0,0 +1,99 @@
+/*
+ * ABKbootloader.cpp
+ * Copyright (C) 2017 Benoit Rapidel <benoit.rapidel+devs@exmachina.fr>
+ *
+ * Distributed under terms of the MIT license.
+ */
+
+// Bootloader, sectors 0-14. Installs the image the application staged (see
+// src/update/ABKupdproto.h) and starts the application at ABK_UPD_APP_START.
+//
+// Staging is only read here, so an install cut short by a reset or a power
+// loss starts over at the next boot. The done mark is written last, once the
+// installed image checks out.
+
+#include "mbed.h"
+#include "mbed_application.h"
+
+#include "ABKiap.h"
+#include "ABKupdproto.h"
+
+#define ABK_BOOT_LED            P1_18   // LED1 of src/pins.h
+#define ABK_BOOT_RETRIES        (2)
+
+static uint8_t ABK_boot_block[ABK_IAP_BLOCK_SIZE] __attribute__((aligned(4)));
+
+static bool ABK_boot_check(uint32_t address, const ABK_upd_record_t *record) {
+    return ABK_upd_crc32(0, ABK_iap_map(address), record->image_size) == record->image_crc;
+}
+
+// The boot ROM only writes from RAM
+static bool ABK_boot_install(const ABK_upd_record_t *record) {
+    if (!ABK_iap_erase(ABK_UPD_APP_START, ABK_UPD_APP_START + record->image_size))
+        return false;
+
+    for (uint32_t offset=0; offset<record->image_size; offset+=ABK_IAP_BLOCK_SIZE) {
+        memcpy(ABK_boot_block, ABK_iap_map(ABK_UPD_STAGING_START + offset), ABK_IAP_BLOCK_SIZE);
+        if (!ABK_iap_write(ABK_UPD_APP_START + offset, ABK_boot_block))
+            return false;
+    }
+
+    return ABK_boot_check(ABK_UPD_APP_START, record);
+}
+
+static bool ABK_boot_done(void) {
+    const uint8_t *done = ABK_iap_map(ABK_UPD_RECORD_ADDRESS + ABK_UPD_DONE_OFFSET);
+
+    for (int i=0; i<ABK_UPD_RECORD_SIZE; i++) {
+        if (done[i] != 0xFF)
+            return true;
+    }
+
+    return false;
+}
+
+static bool ABK_boot_mark_done(const ABK_upd_record_t *record) {
+    memset(ABK_boot_block, 0xFF, sizeof(ABK_boot_block));
+    ABK_upd_encode_record(ABK_boot_block, record);
+
+    return ABK_iap_write(ABK_UPD_RECORD_ADDRESS + ABK_UPD_DONE_OFFSET, ABK_boot_block);
+}
+
+// Initial stack pointer in RAM, reset handler in the application slot
+static bool ABK_boot_app_valid(void) {
+    const uint32_t *vectors = (const uint32_t *) ABK_iap_map(ABK_UPD_APP_START);
+
+    return (vectors[0] & 0xFFF00000) == 0x10000000
+        && vectors[1] >= ABK_UPD_APP_START && vectors[1] < ABK_UPD_APP_START + ABK_UPD_SLOT_SIZE;
+}
+
+int main(void) {
+    DigitalOut led(ABK_BOOT_LED, 0);
+    ABK_upd_record_t record;
+
+    // A staging area that doesn't check out isn't installed, the running image stays
+    bool pending = ABK_upd_decode_record(ABK_iap_map(ABK_UPD_RECORD_ADDRESS), &record) && !ABK_boot_done()
+            && ABK_boot_check(ABK_UPD_STAGING_START, &record);
+
+    if (pending) {
+        led = 1;
+        for (int i=0; i<ABK_BOOT_RETRIES; i++) {
+            if (ABK_boot_install(&record)) {
+                ABK_boot_mark_done(&record);
+                break;
+            }
+        }
+        led = 0;
+    }
+
+    // A failed install may leave a valid vector table over a partial image:
+    // the slot only runs once it holds the whole staged image
+    if (ABK_boot_app_valid() && (!pending || ABK_boot_check(ABK_UPD_APP_START, &record)))
+        mbed_start_application(ABK_UPD_APP_START);
+
+    // No application left, the next reset retries the install, else only the ISP can recover
+    while (true) {
+        led = !led;
+        wait_ms(100);
+    }
+}
@@ -1,11 +1,14 @@
 @echo off
 
-@echo Compiling...
-mbed compile
+rem usage: make.bat PORT [VARIANT], VARIANT is one of variants\*.json (production by default)
+set VARIANT=%2
+if "%VARIANT%"=="" set VARIANT=production
+
+@echo Compiling %VARIANT%...
+python.exe tools\build_variants.py %VARIANT%
+if errorlevel 1 exit /b 1
 @echo Done.
 
 @echo Flashing to %1...
-python.exe tools\nxp-flasher\nxpprog.py --baudrate 230400 --cpu lpc1768 --oscfreq 120000 %1 BUILD\LPC1768\GCC_ARM\ABK-firmware.bin
+python.exe tools\nxp-flasher\nxpprog.py --baudrate 230400 --cpu lpc1768 --oscfreq 120000 %1 BUILD\%VARIANT%\ABK-full.bin
 @echo Done.
-
-
@@ -0,0 +1,45 @@
+/*
+ * ABKboot.cpp
+ * Copyright (C) 2017 Benoit Rapidel <benoit.rapidel+devs@exmachina.fr>
+ *
+ * Distributed under terms of the MIT license.
+ */
+
+#include "ABKboot.h"
+
+uint32_t ABK_boot_times[ABK_BOOT_PHASE_COUNT];
+static uint32_t ABK_boot_reached_mask;  // One bit per phase, a time of 0 is valid
+static uint32_t ABK_boot_origin;        // us_ticker at main() entry
+
+void ABK_boot_mark(ABK_boot_phase_t phase) {
+    uint32_t now = us_ticker_read();
+
+    if (phase == ABK_BOOT_CLOCK)
+        ABK_boot_origin = now;
+
+    ABK_boot_times[phase] = now - ABK_boot_origin;
+    ABK_boot_reached_mask |= 1 << phase;
+}
+
+bool ABK_boot_reached(int phase) {
+    return (phase >= 0 && phase < ABK_BOOT_PHASE_COUNT) && (ABK_boot_reached_mask & (1 << phase));
+}
+
+const char *ABK_boot_phase_name(int phase) {
+    switch (phase) {
+        case ABK_BOOT_CLOCK:
+            return "clock";
+        case ABK_BOOT_USB:
+            return "usb";
+        case ABK_BOOT_EEPROM:
+            return "eeprom";
+        case ABK_BOOT_VALIDATION:
+            return "validation";
+        case ABK_BOOT_THREADS:
+            return "threads";
+        case ABK_BOOT_READY:
+            return "ready";
+        default:
+            return "unknown";
+    }
+}
@@ -0,0 +1,33 @@
+/*
+ * ABKboot.h
+ * Copyright (C) 2017 Benoit Rapidel <benoit.rapidel+devs@exmachina.fr>
+ *
+ * Distributed under terms of the MIT license.
+ */
+
+#ifndef ABKBOOT_H
+#define ABKBOOT_H
+
+#include "mbed.h"
+
+typedef enum {
+    ABK_BOOT_CLOCK = 0,         // main() entered, clocks and static objects are up: the time origin
+    ABK_BOOT_USB,               // USB serial TX/RX path ready
+    ABK_BOOT_EEPROM,            // Configuration read from EEPROM, successfully or not
+    ABK_BOOT_VALIDATION,        // Configuration checked, valid or not
+    ABK_BOOT_THREADS,           // Application threads started
+    ABK_BOOT_READY,             // ABK_STATE_READY reached by an axis, never on an unconfigured unit
+    ABK_BOOT_PHASE_COUNT
+} ABK_boot_phase_t;
+
+// Timestamps are in us from main() entry (ABK_BOOT_CLOCK), valid once the phase
+// is reached. The us_ticker is already running for the static timers and
+// tickers, the time from reset to main() isn't measured.
+extern uint32_t ABK_boot_times[ABK_BOOT_PHASE_COUNT];
+
+// A phase marked again, once per axis, keeps the latest time
+void ABK_boot_mark(ABK_boot_phase_t phase);
+bool ABK_boot_reached(int phase);
+const char *ABK_boot_phase_name(int phase);
+
+#endif /* !ABKBOOT_H */
@@ -0,0 +1,120 @@
+/*
+ * ABKcalib.cpp
+ * Copyright (C) 2017 Benoit Rapidel <benoit.rapidel+devs@exmachina.fr>
+ *
+ * Distributed under terms of the MIT license.
+ */
+
+#include "ABKcalib.h"
+
+// Keep the calling task alive while it blocks for up to a few seconds
+static void ABK_calib_wait(ABK_task_id_t task, uint32_t ms) {
+    uint32_t start = us_ticker_read();
+
+    while ((us_ticker_read() - start) < ms * 1000) {
+        ABK_supervisor_checkin(task);
+        Thread::wait(10);
+    }
+}
+
+// Poll the feedback input every ms until it moves, the encoder pins have no GPIO interrupt (port 1)
+static ABK_calib_result_t ABK_calib_wait_motion(ABK_axis_t *axis, DigitalIn *feedback, ABK_task_id_t task,
+        uint32_t start, uint32_t *latency) {
+    int level = feedback->read();
+    int edges = 0;
+    uint32_t first = 0;
+
+    while ((us_ticker_read() - start) < ABK_CALIB_TIMEOUT * 1000) {
+        if (axis->error & ABK_ERROR_FAULTS)
+            return ABK_CALIB_ERROR;
+
+        if (feedback->read() != level) {
+            level = !level;
+            if (edges++ == 0)
+                first = us_ticker_read();
+
+            if (edges >= ABK_CALIB_EDGES) {
+                *latency = first - start;
+                return ABK_CALIB_OK;
+            }
+        }
+
+        ABK_supervisor_checkin(task);
+        Thread::wait(1); // Lets the lower priority threads run, lead times are whole ms anyway
+    }
+
+    return ABK_CALIB_NO_MOTION;
+}
+
+static void ABK_calib_stop(ABK_axis_t *axis) {
+    ABK_set_speed(axis, 0);
+    ABK_set_motor_mode(axis, ABK_MOTOR_DISABLED);
+    ABK_set_drum_mode(axis, ABK_DRUM_BRAKED);
+}
+
+// Measure the actuator latencies of an idle axis, the control loop leaves its outputs alone meanwhile
+ABK_calib_result_t ABK_calibrate(ABK_axis_t *axis, DigitalIn *feedback, ABK_task_id_t task, ABK_calib_t *calib) {
+    ABK_calib_result_t ret;
+    ABK_state_t state;
+    uint32_t start;
+
+    if (!ABK_axes_lock(axis, 1, &state))
+        return ABK_CALIB_BUSY;
+
+    memset(calib, 0, sizeof(ABK_calib_t));
+
+    if (axis->error & ABK_ERROR_FAULTS) { // The axis may be locked while faulted
+        ret = ABK_CALIB_ERROR;
+        goto out;
+    }
+
+    // VFD: drum free, time from the run command to motion
+    ABK_calib_stop(axis);
+    ABK_set_drum_mode(axis, ABK_DRUM_FREEWHEEL);
+    ABK_set_speed(axis, ABK_CALIB_SPEED);
+    start = us_ticker_read();
+    ABK_set_motor_mode(axis, ABK_MOTOR_FW);
+
+    ret = ABK_calib_wait_motion(axis, feedback, task, start, &calib->vfd_us);
+    ABK_calib_stop(axis);
+    if (ret != ABK_CALIB_OK)
+        goto out;
+
+    ABK_calib_wait(task, ABK_CALIB_SETTLE);
+
+#if ABK_HAS_BRAKE
+    // Brake: VFD already driving, time from the release to motion
+    ABK_set_speed(axis, ABK_CALIB_SPEED);
+    ABK_set_motor_mode(axis, ABK_MOTOR_FW);
+    ABK_calib_wait(task, calib->vfd_us / 1000 + ABK_CALIB_HOLD_MARGIN);
+    start = us_ticker_read();
+    ABK_set_drum_mode(axis, ABK_DRUM_FREEWHEEL);
+
+    ret = ABK_calib_wait_motion(axis, feedback, task, start, &calib->brake_us);
+    ABK_calib_stop(axis);
+    if (ret != ABK_CALIB_OK)
+        goto out;
+
+    calib->brake = true;
+    ABK_calib_wait(task, ABK_CALIB_SETTLE);
+#endif
+
+out:
+    ABK_axes_unlock(axis, 1, &state);
+    return ret;
+}
+
+const char *ABK_calib_result_name(ABK_calib_result_t result) {
+    switch (result) {
+        case ABK_CALIB_OK:
+            return "ok";
+        case ABK_CALIB_BUSY:
+            return "busy";
+        case ABK_CALIB_ERROR:
+            return "error";
+        case ABK_CALIB_NO_MOTION:
+            return "no_motion";
+    }
+
+    return "unknown";
+}
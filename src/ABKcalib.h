@@ -0,0 +1,41 @@
+/*
+ * ABKcalib.h
+ * Copyright (C) 2017 Benoit Rapidel <benoit.rapidel+devs@exmachina.fr>
+ *
+ * Distributed under terms of the MIT license.
+ */
+
+#ifndef ABKCALIB_H
+#define ABKCALIB_H
+
+#include "config.h"
+
+#include "mbed.h"
+
+#include "ABKcontrol.h"
+#include "ABKsupervisor.h"
+
+#define ABK_CALIB_SPEED             (10)    // Percent, slow enough to run against the brake
+#define ABK_CALIB_TIMEOUT           (2000)  // ms without motion before giving up
+#define ABK_CALIB_SETTLE            (1000)  // ms for the drum to stop between phases
+#define ABK_CALIB_HOLD_MARGIN       (100)   // ms the VFD runs against the brake past its own lead
+#define ABK_CALIB_EDGES             (2)     // Feedback edges needed to call it motion
+
+typedef enum {
+    ABK_CALIB_OK = 0,
+    ABK_CALIB_BUSY,             // Axis running
+    ABK_CALIB_ERROR,            // Axis error raised while measuring
+    ABK_CALIB_NO_MOTION,        // No feedback edge before the timeout
+} ABK_calib_result_t;
+
+typedef struct {
+    uint32_t vfd_us;            // VFD run command to first motion, brake already released
+    uint32_t brake_us;          // Brake release to first motion, VFD already driving
+    bool brake;                 // brake_us measured, never without a brake output
+} ABK_calib_t;
+
+ABK_calib_result_t ABK_calibrate(ABK_axis_t *axis, DigitalIn *feedback, ABK_task_id_t task, ABK_calib_t *calib);
+
+const char *ABK_calib_result_name(ABK_calib_result_t result);
+
+#endif /* !ABKCALIB_H */
@@ -0,0 +1,227 @@
+/*
+ * ABKcan.cpp
+ * Copyright (C) 2017 Benoit Rapidel <benoit.rapidel+devs@exmachina.fr>
+ *
+ * Distributed under terms of the MIT license.
+ */
+
+#include "ABKcan.h"
+
+#include "can_api.h"
+
+// The HAL is used directly: the CAN class locks a mutex, which isn't allowed
+// in the RX interrupt where frames must be timestamped.
+static can_t ABK_can;
+
+static uint8_t ABK_can_node = ABK_CAN_NODE_DISABLED;
+static ABK_can_sync_t ABK_can_sync;
+static ABK_axis_t *ABK_can_axes = NULL;
+static void (*ABK_can_wake)(void) = NULL;
+
+static uint8_t ABK_can_sync_seq = 0;
+static uint8_t ABK_can_cue_seq = 0;
+static bool ABK_can_cue_armed[ABK_AXES];    // Master: cue sent for this axis trigger
+
+static Timeout ABK_can_cue_timeout;
+static ABK_can_cue_t ABK_can_cue;
+static uint32_t ABK_can_cue_local;          // Scheduled fire time in local time
+static volatile bool ABK_can_report_pending = false;
+
+static ABK_can_report_t ABK_can_reports[ABK_CAN_MAX_NODES];
+
+static void ABK_can_irq(uint32_t id, CanIrqType type);
+
+static bool ABK_can_write(const ABK_can_frame_t *frame) {
+    CAN_Message msg;
+
+    msg.id = frame->id;
+    msg.len = frame->len;
+    msg.format = CANStandard;
+    msg.type = CANData;
+    memcpy(msg.data, frame->data, 8);
+
+    core_util_critical_section_enter();
+    int ret = can_write(&ABK_can, msg, 0);
+    core_util_critical_section_exit();
+
+    return ret != 0;
+}
+
+void ABK_can_init(AT24CXX_I2C *eeprom, PinName rd, PinName td, ABK_axis_t *axes, void (*wake)(void)) {
+    uint8_t node = ABK_CAN_NODE_DISABLED;
+
+    eeprom->read(ABK_EEPROM_CAN_ADDRESS, &node, 1);
+    if (node >= ABK_CAN_MAX_NODES)
+        node = ABK_CAN_NODE_DISABLED;
+
+    ABK_can_node = node;
+    ABK_can_axes = axes;
+    ABK_can_wake = wake;
+
+    memset(ABK_can_reports, 0, sizeof(ABK_can_reports));
+    memset(ABK_can_cue_armed, 0, sizeof(ABK_can_cue_armed));
+    ABK_can_sync_init(&ABK_can_sync, node == ABK_CAN_NODE_MASTER);
+
+    if (node == ABK_CAN_NODE_DISABLED)
+        return;
+
+    can_init(&ABK_can, rd, td);
+    can_frequency(&ABK_can, ABK_CAN_BITRATE);
+    can_irq_init(&ABK_can, &ABK_can_irq, 0);
+    can_irq_set(&ABK_can, IRQ_RX, 1);
+}
+
+// Takes effect after a reset
+bool ABK_can_set_node(AT24CXX_I2C *eeprom, uint8_t node) {
+    if (node >= ABK_CAN_MAX_NODES)
+        node = ABK_CAN_NODE_DISABLED;
+
+    return eeprom->write(ABK_EEPROM_CAN_ADDRESS, &node, 1);
+}
+
+uint8_t ABK_can_get_node(void) {
+    return ABK_can_node;
+}
+
+// Timeout interrupt at the scheduled cue time
+static void ABK_can_fire(void) {
+    uint32_t now = us_ticker_read();
+
+    for (int i=0; i<ABK_AXES; i++) {
+        if (ABK_can_cue.axes & (1 << i))
+            ABK_axis_trigger_at(&ABK_can_axes[i], ABK_can_cue_local); // Profile time starts at the cue time
+    }
+
+    int32_t late = (int32_t) (now - ABK_can_cue_local);
+    int32_t residual = ABK_can_sync.residual;
+    ABK_can_report_t *report = &ABK_can_reports[ABK_can_node];
+
+    report->node = ABK_can_node;
+    report->cue = ABK_can_cue.cue;
+    report->fire_late = (late > INT16_MAX) ? INT16_MAX : late;
+    report->residual = (residual > INT16_MAX) ? INT16_MAX : (residual < INT16_MIN) ? INT16_MIN : residual;
+    report->synced = ABK_can_sync.synced;
+    ABK_can_report_pending = true;
+
+    if (ABK_can_wake)
+        ABK_can_wake();
+}
+
+static void ABK_can_schedule(const ABK_can_cue_t *cue) {
+    if (!ABK_can_sync.synced)   // Can't place the cue in time: ignore it rather than start late
+        return;
+
+    ABK_can_cue = *cue;
+    ABK_can_cue_local = ABK_can_to_local(&ABK_can_sync, cue->fire_at);
+
+    int32_t delay = (int32_t) (ABK_can_cue_local - us_ticker_read());
+    if (delay < 0)
+        delay = 0;
+
+    ABK_can_cue_timeout.attach_us(&ABK_can_fire, delay);
+}
+
+static void ABK_can_irq(uint32_t id, CanIrqType type) {
+    uint32_t now = us_ticker_read(); // Timestamp first, SYNC accuracy depends on it
+    CAN_Message msg;
+
+    while (can_read(&ABK_can, &msg, 0)) {
+        ABK_can_frame_t frame;
+        uint8_t seq;
+        uint32_t master_tx;
+        ABK_can_cue_t cue;
+        ABK_can_report_t report;
+
+        frame.id = msg.id;
+        frame.len = msg.len;
+        memcpy(frame.data, msg.data, 8);
+
+        if (frame.id == ABK_CAN_ID_SYNC && ABK_can_node != ABK_CAN_NODE_MASTER) {
+            ABK_can_sync_on_sync(&ABK_can_sync, frame.data[0], now);
+        } else if (ABK_can_decode_followup(&frame, &seq, &master_tx) && ABK_can_node != ABK_CAN_NODE_MASTER) {
+            ABK_can_sync_on_followup(&ABK_can_sync, seq, master_tx, ABK_CAN_SYNC_LATENCY);
+        } else if (ABK_can_decode_cue(&frame, &cue)) {
+            ABK_can_schedule(&cue);
+        } else if (ABK_can_decode_report(&frame, &report) && ABK_can_node == ABK_CAN_NODE_MASTER) {
+            ABK_can_reports[report.node] = report;
+        }
+    }
+}
+
+// Called by the control loop: with CAN enabled, only the master's trigger
+// input is used, and it is turned into a cue broadcast to every unit.
+uint8_t ABK_can_filter_inputs(int index, uint8_t inputs) {
+    if (ABK_can_node == ABK_CAN_NODE_DISABLED)
+        return inputs;
+
+    if (ABK_can_node == ABK_CAN_NODE_MASTER) {
+        ABK_axis_t *axis = &ABK_can_axes[index];
+
+        if (axis->state != ABK_STATE_READY || axis->triggered) {
+            ABK_can_cue_armed[index] = false;
+        } else if (CHECK_FLAG(inputs, ABK_INPUT_TRIGGER) && !ABK_can_cue_armed[index]) {
+            ABK_can_cue_armed[index] = ABK_can_send_cue(1 << index);
+        }
+    }
+
+    return REMOVE_FLAG(inputs, ABK_INPUT_TRIGGER);
+}
+
+bool ABK_can_send_cue(uint8_t axes) {
+    ABK_can_frame_t frame;
+    ABK_can_cue_t cue;
+
+    if (ABK_can_node != ABK_CAN_NODE_MASTER)
+        return false;
+
+    cue.cue = ABK_can_cue_seq++;
+    cue.axes = axes;
+    cue.fire_at = us_ticker_read() + ABK_CAN_CUE_LEAD;
+
+    ABK_can_encode_cue(&frame, &cue);
+    if (!ABK_can_write(&frame))
+        return false;
+
+    core_util_critical_section_enter();
+    ABK_can_schedule(&cue);     // The master doesn't receive its own frames
+    core_util_critical_section_exit();
+
+    return true;
+}
+
+// Called periodically from the supervisor loop
+void ABK_can_poll(void) {
+    ABK_can_frame_t frame;
+
+    if (ABK_can_node == ABK_CAN_NODE_MASTER) {
+        uint8_t seq = ABK_can_sync_seq++;
+
+        ABK_can_encode_sync(&frame, seq);
+
+        core_util_critical_section_enter();
+        uint32_t tx = us_ticker_read(); // Bus is mostly idle: the frame leaves right away
+        bool sent = ABK_can_write(&frame);
+        core_util_critical_section_exit();
+
+        if (sent) {
+            ABK_can_encode_followup(&frame, seq, tx);
+            ABK_can_write(&frame);
+        }
+    } else if (ABK_can_node != ABK_CAN_NODE_DISABLED && ABK_can_report_pending) {
+        ABK_can_report_pending = false;
+        ABK_can_encode_report(&frame, &ABK_can_reports[ABK_can_node]);
+        ABK_can_write(&frame);
+    }
+}
+
+const ABK_can_sync_t *ABK_can_get_sync(void) {
+    return &ABK_can_sync;
+}
+
+const ABK_can_report_t *ABK_can_get_report(uint8_t node) {
+    return &ABK_can_reports[node];
+}
+
+uint8_t ABK_can_get_last_cue(void) {
+    return ABK_can_cue.cue;
+}
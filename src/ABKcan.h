@@ -0,0 +1,32 @@
+/*
+ * ABKcan.h
+ * Copyright (C) 2017 Benoit Rapidel <benoit.rapidel+devs@exmachina.fr>
+ *
+ * Distributed under terms of the MIT license.
+ */
+
+#ifndef ABKCAN_H
+#define ABKCAN_H
+
+#include "config.h"
+
+#include "mbed.h"
+
+#include "ABKcanproto.h"
+#include "ABKcontrol.h"
+
+#include "AT24Cxx_I2C.h"
+
+void ABK_can_init(AT24CXX_I2C *eeprom, PinName rd, PinName td, ABK_axis_t *axes, void (*wake)(void));
+bool ABK_can_set_node(AT24CXX_I2C *eeprom, uint8_t node);
+uint8_t ABK_can_get_node(void);
+
+uint8_t ABK_can_filter_inputs(int index, uint8_t inputs);
+bool ABK_can_send_cue(uint8_t axes);
+void ABK_can_poll(void);
+
+const ABK_can_sync_t *ABK_can_get_sync(void);
+const ABK_can_report_t *ABK_can_get_report(uint8_t node);
+uint8_t ABK_can_get_last_cue(void);
+
+#endif /* !ABKCAN_H */
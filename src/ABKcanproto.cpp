@@ -0,0 +1,148 @@
+/*
+ * ABKcanproto.cpp
+ * Copyright (C) 2017 Benoit Rapidel <benoit.rapidel+devs@exmachina.fr>
+ *
+ * Distributed under terms of the MIT license.
+ */
+
+#include "ABKcanproto.h"
+
+#include <string.h>
+
+static void ABK_can_put_u32(uint8_t *buf, uint32_t value) {
+    buf[0] = value & 0xFF;
+    buf[1] = (value >> 8) & 0xFF;
+    buf[2] = (value >> 16) & 0xFF;
+    buf[3] = (value >> 24) & 0xFF;
+}
+
+static uint32_t ABK_can_get_u32(const uint8_t *buf) {
+    return buf[0] | (buf[1] << 8) | (buf[2] << 16) | ((uint32_t) buf[3] << 24);
+}
+
+void ABK_can_sync_init(ABK_can_sync_t *sync, bool master) {
+    memset(sync, 0, sizeof(ABK_can_sync_t));
+    sync->synced = master;      // The master is the timebase
+}
+
+void ABK_can_sync_on_sync(ABK_can_sync_t *sync, uint8_t seq, uint32_t local_rx) {
+    sync->seq = seq;
+    sync->sync_rx = local_rx;
+}
+
+// Returns true if the offset was updated
+bool ABK_can_sync_on_followup(ABK_can_sync_t *sync, uint8_t seq, uint32_t master_tx, uint32_t latency) {
+    if (seq != sync->seq)       // SYNC lost, wait for the next pair
+        return false;
+
+    uint32_t offset = master_tx + latency - sync->sync_rx;
+
+    if (sync->synced) {
+        int32_t elapsed = (int32_t) (sync->sync_rx - sync->offset_time);
+        int32_t predicted = (int32_t) (sync->drift * elapsed);
+        int32_t change = (int32_t) (offset - sync->offset);
+
+        sync->residual = change - predicted;
+        if (sync->residual > ABK_CAN_RESYNC_LIMIT || sync->residual < -ABK_CAN_RESYNC_LIMIT) {
+            sync->drift = 0.0;  // Master restarted or SYNC corrupted
+        } else if (elapsed > 0) {
+            // First order filter, the drift of a crystal moves slowly
+            sync->drift += ((float) change / elapsed - sync->drift) / 8.0;
+        }
+
+        int32_t magnitude = (sync->residual < 0) ? -sync->residual : sync->residual;
+        if (magnitude > sync->worst_residual)
+            sync->worst_residual = magnitude;
+    }
+
+    sync->offset = offset;
+    sync->offset_time = sync->sync_rx;
+    sync->synced = true;
+    sync->syncs++;
+
+    return true;
+}
+
+uint32_t ABK_can_to_local(const ABK_can_sync_t *sync, uint32_t master_time) {
+    uint32_t local = master_time - sync->offset;
+    int32_t elapsed = (int32_t) (local - sync->offset_time);
+
+    return local - (int32_t) (sync->drift * elapsed);
+}
+
+uint32_t ABK_can_to_master(const ABK_can_sync_t *sync, uint32_t local_time) {
+    int32_t elapsed = (int32_t) (local_time - sync->offset_time);
+
+    return local_time + sync->offset + (int32_t) (sync->drift * elapsed);
+}
+
+void ABK_can_encode_sync(ABK_can_frame_t *frame, uint8_t seq) {
+    memset(frame, 0, sizeof(ABK_can_frame_t));
+    frame->id = ABK_CAN_ID_SYNC;
+    frame->len = 1;
+    frame->data[0] = seq;
+}
+
+void ABK_can_encode_followup(ABK_can_frame_t *frame, uint8_t seq, uint32_t master_tx) {
+    memset(frame, 0, sizeof(ABK_can_frame_t));
+    frame->id = ABK_CAN_ID_FOLLOWUP;
+    frame->len = 5;
+    frame->data[0] = seq;
+    ABK_can_put_u32(&frame->data[1], master_tx);
+}
+
+void ABK_can_encode_cue(ABK_can_frame_t *frame, const ABK_can_cue_t *cue) {
+    memset(frame, 0, sizeof(ABK_can_frame_t));
+    frame->id = ABK_CAN_ID_CUE;
+    frame->len = 6;
+    frame->data[0] = cue->cue;
+    frame->data[1] = cue->axes;
+    ABK_can_put_u32(&frame->data[2], cue->fire_at);
+}
+
+void ABK_can_encode_report(ABK_can_frame_t *frame, const ABK_can_report_t *report) {
+    int16_t late = report->fire_late;
+    int16_t residual = report->residual;
+
+    memset(frame, 0, sizeof(ABK_can_frame_t));
+    frame->id = ABK_CAN_ID_REPORT + report->node;
+    frame->len = 6;
+    frame->data[0] = report->cue;
+    frame->data[1] = report->synced;
+    frame->data[2] = late & 0xFF;
+    frame->data[3] = (late >> 8) & 0xFF;
+    frame->data[4] = residual & 0xFF;
+    frame->data[5] = (residual >> 8) & 0xFF;
+}
+
+bool ABK_can_decode_followup(const ABK_can_frame_t *frame, uint8_t *seq, uint32_t *master_tx) {
+    if (frame->id != ABK_CAN_ID_FOLLOWUP || frame->len < 5)
+        return false;
+
+    *seq = frame->data[0];
+    *master_tx = ABK_can_get_u32(&frame->data[1]);
+    return true;
+}
+
+bool ABK_can_decode_cue(const ABK_can_frame_t *frame, ABK_can_cue_t *cue) {
+    if (frame->id != ABK_CAN_ID_CUE || frame->len < 6)
+        return false;
+
+    cue->cue = frame->data[0];
+    cue->axes = frame->data[1];
+    cue->fire_at = ABK_can_get_u32(&frame->data[2]);
+    return true;
+}
+
+bool ABK_can_decode_report(const ABK_can_frame_t *frame, ABK_can_report_t *report) {
+    if (frame->id < ABK_CAN_ID_REPORT || frame->id >= ABK_CAN_ID_REPORT + ABK_CAN_MAX_NODES
+            || frame->len < 6)
+        return false;
+
+    report->node = frame->id - ABK_CAN_ID_REPORT;
+    report->cue = frame->data[0];
+    report->synced = frame->data[1] != 0;
+    report->fire_late = (int16_t) (frame->data[2] | (frame->data[3] << 8));
+    report->residual = (int16_t) (frame->data[4] | (frame->data[5] << 8));
+    return true;
+}
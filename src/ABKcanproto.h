@@ -0,0 +1,80 @@
+/*
+ * ABKcanproto.h
+ * Copyright (C) 2017 Benoit Rapidel <benoit.rapidel+devs@exmachina.fr>
+ *
+ * Distributed under terms of the MIT license.
+ */
+
+#ifndef ABKCANPROTO_H
+#define ABKCANPROTO_H
+
+// CAN synchronised trigger protocol. Kept free of mbed dependencies so the
+// host simulator in tools/can_sim can run the exact same code.
+//
+// The master (node 0) periodically sends SYNC, then FOLLOWUP carrying the
+// master time at which SYNC was written. Receivers timestamp SYNC on
+// reception and derive the master-local offset and drift. A CUE carries an
+// absolute master time at which every unit starts its profile.
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define ABK_CAN_ID_SYNC         (0x100)
+#define ABK_CAN_ID_FOLLOWUP     (0x101)
+#define ABK_CAN_ID_CUE          (0x110)
+#define ABK_CAN_ID_REPORT       (0x120)     // + node id
+#define ABK_CAN_MAX_NODES       (32)
+
+#define ABK_CAN_NODE_MASTER     (0)
+#define ABK_CAN_NODE_DISABLED   (0xFF)
+
+#define ABK_CAN_RESYNC_LIMIT    (1000)      // Residual in us above which drift is reset
+
+typedef struct {
+    uint32_t id;
+    uint8_t len;
+    uint8_t data[8];
+} ABK_can_frame_t;
+
+typedef struct {
+    bool synced;
+    uint8_t seq;                // Sequence of the last SYNC received
+    uint32_t sync_rx;           // Local time the last SYNC was received
+    uint32_t offset;            // master - local, modulo 2^32
+    uint32_t offset_time;       // Local time offset was measured
+    float drift;                // Offset change per local us
+    int32_t residual;           // Last offset prediction error in us
+    int32_t worst_residual;
+    uint32_t syncs;
+} ABK_can_sync_t;
+
+typedef struct {
+    uint8_t cue;
+    uint8_t axes;               // Bit mask of axes to start
+    uint32_t fire_at;           // Master time
+} ABK_can_cue_t;
+
+typedef struct {
+    uint8_t node;
+    uint8_t cue;
+    int16_t fire_late;          // Fire interrupt lateness in us
+    int16_t residual;           // Sync residual when the cue fired
+    bool synced;
+} ABK_can_report_t;
+
+void ABK_can_sync_init(ABK_can_sync_t *sync, bool master);
+void ABK_can_sync_on_sync(ABK_can_sync_t *sync, uint8_t seq, uint32_t local_rx);
+bool ABK_can_sync_on_followup(ABK_can_sync_t *sync, uint8_t seq, uint32_t master_tx, uint32_t latency);
+uint32_t ABK_can_to_local(const ABK_can_sync_t *sync, uint32_t master_time);
+uint32_t ABK_can_to_master(const ABK_can_sync_t *sync, uint32_t local_time);
+
+void ABK_can_encode_sync(ABK_can_frame_t *frame, uint8_t seq);
+void ABK_can_encode_followup(ABK_can_frame_t *frame, uint8_t seq, uint32_t master_tx);
+void ABK_can_encode_cue(ABK_can_frame_t *frame, const ABK_can_cue_t *cue);
+void ABK_can_encode_report(ABK_can_frame_t *frame, const ABK_can_report_t *report);
+
+bool ABK_can_decode_followup(const ABK_can_frame_t *frame, uint8_t *seq, uint32_t *master_tx);
+bool ABK_can_decode_cue(const ABK_can_frame_t *frame, ABK_can_cue_t *cue);
+bool ABK_can_decode_report(const ABK_can_frame_t *frame, ABK_can_report_t *report);
+
+#endif /* !ABKCANPROTO_H */
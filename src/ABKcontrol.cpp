@@ -7,49 +7,334 @@
 
 #include "ABKcontrol.h"
 
+static_assert(sizeof(ABK_cue_t) == ABK_CUE_SIZE, "Cue layout changed");
+static_assert(ABK_EEPROM_CUE_SIZE <= ABK_EEPROM_CUE_SLOT, "Cue doesn't fit its EEPROM slot");
+static_assert(ABK_EEPROM_CUE_ADDRESS >= ABK_EEPROM_USED_END, "Cues overlap the configuration block");
 
-void ABK_set_drum_mode(ABK_drum_mode_t mode) {
+void ABK_axis_init(ABK_axis_t *axis, DigitalOut *dir_fw, DigitalOut *dir_rw, bool *brake, FreqOut *motor) {
+    memset(axis, 0, sizeof(ABK_axis_t));
+
+    axis->dir_fw = dir_fw;
+    axis->dir_rw = dir_rw;
+    axis->brake = brake;
+    axis->motor = motor;
+
+    axis->state = ABK_STATE_NOT_CONFIGURED;
+    axis->error = ABK_ERROR_NONE;
+    axis->last_state = ABK_STATE_CONFIGURED;
+    axis->trigger_released = true;
+    axis->profile = &axis->list[0].profile;
+}
+
+static void ABK_axis_stop(ABK_axis_t *axis) {
+    ABK_set_speed(axis, 0);
+    ABK_set_drum_mode(axis, ABK_DRUM_BRAKED);
+    ABK_set_motor_mode(axis, ABK_MOTOR_DISABLED);
+}
+
+// Trigger the axis as if its input fired at the given us_ticker time, ISR safe
+void ABK_axis_trigger_at(ABK_axis_t *axis, uint32_t time) {
+    axis->ext_trigger_time = time;
+    axis->ext_trigger = true;
+}
+
+// Copies the configuration and the valid cues after it into the control loop,
+// the caller holds ABK_config_mutex. Returns the number of cues.
+int ABK_axis_load_cues(ABK_axis_t *axis) {
+    memcpy(&axis->list[0].profile, &axis->config, sizeof(ABK_config_t));
+    axis->list[0].follow = ABK_FOLLOW_TRIGGER;
+    axis->list[0].delay = 0;
+    axis->cue_count = 1;
+
+    for (int i=0; i<ABK_CUES-1; i++) {
+        ABK_cue_t *cue = &axis->cues[i];
+
+        if (cue->profile.state != 1 || !ABK_validate_config(&cue->profile) || cue->follow > ABK_FOLLOW_AUTO)
+            break;
+
+        memcpy(&axis->list[axis->cue_count++], cue, sizeof(ABK_cue_t));
+    }
+
+    axis->cue = 0;
+    axis->profile = &axis->list[0].profile;
+
+    return axis->cue_count;
+}
+
+// Once the running cue stops: the next one is either started from the stop
+// time itself, so no tick rounding accumulates, or armed for the next trigger,
+// which a trigger input still held from the previous cue isn't
+static bool ABK_axis_next_cue(ABK_axis_t *axis) {
+    if (axis->cue + 1 >= axis->cue_count)
+        return false;
+
+    ABK_cue_t *next = &axis->list[axis->cue + 1];
+
+    if (next->follow == ABK_FOLLOW_AUTO) {
+        axis->trigger_time += (axis->profile->stop_time + next->delay) * 1000;
+    } else {
+        axis->triggered = false;
+        axis->trigger_released = false;
+        axis->state = ABK_STATE_READY;
+    }
+
+    axis->cue++;
+    axis->profile = &next->profile;
+
+    return true;
+}
+
+// Profile holding a time since the running cue trigger, the following cues
+// that start on their own included. time is made relative to that cue.
+static ABK_config_t *ABK_axis_lookahead(ABK_axis_t *axis, int *time) {
+    int cue = axis->cue;
+
+    while (cue + 1 < axis->cue_count && axis->list[cue + 1].follow == ABK_FOLLOW_AUTO
+            && *time >= axis->list[cue].profile.stop_time) {
+        *time -= axis->list[cue].profile.stop_time + axis->list[cue + 1].delay;
+        cue++;
+    }
+
+    return &axis->list[cue].profile;
+}
+
+// The control loop keeps raising faults on locked axes but leaves their outputs alone
+bool ABK_axes_lock(ABK_axis_t *axes, int count, ABK_state_t *saved) {
+    bool idle = true;
+
+    core_util_critical_section_enter();
+    for (int i=0; i<count; i++) {
+        ABK_state_t state = axes[i].state;
+
+        if (state == ABK_STATE_RUN || state == ABK_STATE_SLOWFEED || state == ABK_STATE_CALIBRATION
+                || state == ABK_STATE_RESET || axes[i].triggered)
+            idle = false;
+    }
+    if (idle) {
+        for (int i=0; i<count; i++) {
+            saved[i] = axes[i].state;
+            axes[i].state = ABK_STATE_CALIBRATION;
+        }
+    }
+    core_util_critical_section_exit();
+
+    return idle;
+}
+
+void ABK_axes_unlock(ABK_axis_t *axes, int count, ABK_state_t *saved) {
+    for (int i=0; i<count; i++)
+        axes[i].state = saved[i];
+}
+
+// Profile speed at the given time since trigger, -1 outside of [start_time, stop_time)
+float ABK_profile_speed(ABK_config_t *config, int stime) {
+    if (stime >= config->start_time && stime < config->p1.time)
+        return ABK_map(config->start_time, config->p1.time, 0, config->p1.speed, stime);
+    if (stime >= config->p1.time && stime < config->p2.time)
+        return ABK_map(config->p1.time, config->p2.time, config->p1.speed, config->p2.speed, stime);
+    if (stime >= config->p2.time && stime < config->p3.time)
+        return ABK_map(config->p2.time, config->p3.time, config->p2.speed, config->p3.speed, stime);
+    if (stime >= config->p3.time && stime < config->stop_time)
+        return ABK_map(config->p3.time, config->stop_time, config->p3.speed, 0, stime);
+
+    return -1;
+}
+
+// One control step of an axis, returns true while the profile is running
+bool ABK_axis_tick(ABK_axis_t *axis, uint8_t inputs) {
+    // A scheduled trigger is only valid for the tick that follows it
+    core_util_critical_section_enter();
+    bool ext_trigger = axis->ext_trigger;
+    uint32_t ext_trigger_time = axis->ext_trigger_time;
+    axis->ext_trigger = false;
+    core_util_critical_section_exit();
+
+    if (!CHECK_FLAG(inputs, ABK_INPUT_TRIGGER))
+        axis->trigger_released = true;
+
+    if (axis->state == ABK_STATE_NOT_CONFIGURED) {
+        axis->error = ADD_FLAG(axis->error, ABK_ERROR_INVALID_CONFIG);
+    } else {
+        axis->error = REMOVE_FLAG(axis->error, ABK_ERROR_INVALID_CONFIG);
+    }
+
+    if (CHECK_FLAG(inputs, ABK_INPUT_VFD_FAULT)) {
+        axis->error = ADD_FLAG(axis->error, ABK_ERROR_VFD_ERROR);
+    } else {
+        axis->error = REMOVE_FLAG(axis->error, ABK_ERROR_VFD_ERROR);
+    }
+
+    if (CHECK_FLAG(inputs, ABK_INPUT_EMERGENCY_STOP)) {
+        axis->error = ADD_FLAG(axis->error, ABK_ERROR_EMERGENCY_STOP);
+    } else {
+        axis->error = REMOVE_FLAG(axis->error, ABK_ERROR_EMERGENCY_STOP);
+    }
+
+    // Outputs are driven by the calibration or diag routine, which stops on the faults raised above
+    if (axis->state == ABK_STATE_CALIBRATION)
+        return false;
+
+    if (axis->error & ABK_ERROR_FAULTS) { // Stop motor on VFD error or emergency input
+        ABK_axis_stop(axis);
+
+        if (axis->triggered) { // The run is aborted, it can be re-armed
+            axis->state = ABK_STATE_STANDBY;
+            axis->triggered = false;
+        }
+    }
+
+    if (axis->error != ABK_ERROR_NONE) // Block here if we have any error.
+        return false;
+
+    if (CHECK_FLAG(inputs, ABK_INPUT_SLOWFEED_FW) || CHECK_FLAG(inputs, ABK_INPUT_SLOWFEED_RW)
+            || axis->slowfeed != ABK_SLOWFEED_NONE) { // Overrides default behavior for loading/unloading
+        axis->last_state = axis->state;
+        axis->state = ABK_STATE_SLOWFEED;
+        ABK_set_drum_mode(axis, ABK_DRUM_FREEWHEEL);
+        if (CHECK_FLAG(inputs, ABK_INPUT_SLOWFEED_FW) || axis->slowfeed == ABK_SLOWFEED_FORWARD)
+            ABK_set_motor_mode(axis, ABK_MOTOR_FW);
+        else if (CHECK_FLAG(inputs, ABK_INPUT_SLOWFEED_RW) || axis->slowfeed == ABK_SLOWFEED_REWIND)
+            ABK_set_motor_mode(axis, ABK_MOTOR_RW);
+        ABK_set_speed(axis, ABK_SLOWFEED_SPEED);
+        axis->triggered = false;
+        return false;
+    } else if (axis->state == ABK_STATE_SLOWFEED) {
+        axis->state = (axis->last_state == ABK_STATE_READY) ? ABK_STATE_READY : ABK_STATE_STANDBY;
+        ABK_set_motor_mode(axis, ABK_MOTOR_DISABLED);
+        ABK_set_speed(axis, 0.0);
+    }
+
+    // A re-arm request waits here until the errors clear
+    if (axis->rearm && (axis->state == ABK_STATE_STANDBY || axis->state == ABK_STATE_READY) && !axis->triggered) {
+        axis->rearm = false;
+        axis->cue = 0;
+        axis->profile = &axis->list[0].profile;
+        axis->state = ABK_STATE_READY;
+    }
+
+    if (axis->state != ABK_STATE_RUN && axis->state != ABK_STATE_READY) {
+        ABK_axis_stop(axis);
+        return false;
+    }
+
+    if (!axis->triggered && ((CHECK_FLAG(inputs, ABK_INPUT_TRIGGER) && axis->trigger_released) || ext_trigger)) {
+        axis->state = ABK_STATE_RUN;
+        axis->triggered = true;
+        axis->trigger_time = ext_trigger ? ext_trigger_time : us_ticker_read();
+        printf("status trigger\r\n");
+    } else if (!axis->triggered) {
+        ABK_axis_stop(axis);
+        return false;
+    }
+
+    if (axis->state != ABK_STATE_RUN) {
+        ABK_axis_stop(axis);
+        return false;
+    }
+
+    int _stime = (int) (us_ticker_read() - axis->trigger_time) / 1000; // Update time since trigger
+    DEBUG_PRINTF("stime: %d \r\n", _stime);
+
+    // A cue that follows on its own takes over in this very tick
+    while (_stime >= axis->profile->stop_time) {
+        if (!ABK_axis_next_cue(axis)) {
+            ABK_axis_stop(axis);
+            DEBUG_PRINTF("S\r\n");
+            axis->triggered = false;
+            axis->state = ABK_STATE_STANDBY;
+            return false;
+        }
+
+        if (axis->state != ABK_STATE_RUN) { // Armed for the next trigger
+            ABK_axis_stop(axis);
+            return false;
+        }
+
+        _stime = (int) (us_ticker_read() - axis->trigger_time) / 1000;
+    }
+
+    // Look ahead: each actuator is commanded for the profile time it will reach once its lead has
+    // elapsed, which may be in a following cue
+    int brake_time = _stime + axis->lead.brake;
+    int vfd_time = _stime + axis->lead.vfd;
+    int next_time = vfd_time + ABK_INTERVAL;
+
+    ABK_config_t *brake_profile = ABK_axis_lookahead(axis, &brake_time);
+    ABK_config_t *vfd_profile = ABK_axis_lookahead(axis, &vfd_time);
+    ABK_config_t *next_profile = ABK_axis_lookahead(axis, &next_time);
+
+    if (brake_time >= brake_profile->start_time && brake_time < brake_profile->stop_time) {
+        ABK_set_drum_mode(axis, ABK_DRUM_FREEWHEEL);
+    } else {
+        ABK_set_drum_mode(axis, ABK_DRUM_BRAKED);
+    }
+
+    float rspeed = ABK_profile_speed(vfd_profile, vfd_time);
+    if (rspeed >= 0) {
+        // Publish where the profile is at the next tick, the output sweeps there in between
+        float nspeed = ABK_profile_speed(next_profile, next_time);
+
+        ABK_set_motor_mode(axis, ABK_MOTOR_FW);
+        ABK_ramp_speed(axis, (nspeed >= 0) ? nspeed : 0, ABK_INTERVAL);
+        DEBUG_PRINTF("T %f\r\n", rspeed);
+    } else {
+        ABK_set_speed(axis, 0);
+        ABK_set_motor_mode(axis, ABK_MOTOR_DISABLED);
+        DEBUG_PRINTF("U\r\n");
+    }
+
+    return true;
+}
+
+void ABK_set_drum_mode(ABK_axis_t *axis, ABK_drum_mode_t mode) {
     switch(mode) {
         case ABK_DRUM_BRAKED:
-            brake = 1; // brake is active when 1
+            *axis->brake = 1; // brake is active when 1
             break;
         case ABK_DRUM_FREEWHEEL:
-            brake = 0;
+            *axis->brake = 0;
             break;
     }
 }
 
 
-void ABK_set_motor_mode(ABK_motor_mode_t mode) {
+void ABK_set_motor_mode(ABK_axis_t *axis, ABK_motor_mode_t mode) {
     switch(mode) {
         case ABK_MOTOR_FW:
-            dir_fw = 1;
-            dir_rw = 0;
+            *axis->dir_fw = 1;
+            *axis->dir_rw = 0;
             break;
         case ABK_MOTOR_RW:
-            dir_fw = 0;
-            dir_rw = 1;
+            *axis->dir_fw = 0;
+            *axis->dir_rw = 1;
             break;
         case ABK_MOTOR_DISABLED:
-            dir_fw = 0;
-            dir_rw = 0;
+            *axis->dir_fw = 0;
+            *axis->dir_rw = 0;
             break;
     }
 }
 
-int ABK_set_speed(float speed) {
-    float dt = 0.5;
-    int period = 0;
+static float ABK_speed_hz(float speed) {
+    float freq = ABK_map(0, 100, ABK_MOT_MIN_FREQ, ABK_MOT_MAX_FREQ, speed);
+
+    if (freq < ABK_MOT_MIN_FREQ)
+        freq = ABK_MOT_MIN_FREQ;
+    else if (freq > ABK_MOT_MAX_FREQ)
+        freq = ABK_MOT_MAX_FREQ;
 
-    period = (int) (1000000.0 / ABK_map(0, 100, ABK_MOT_MIN_FREQ, ABK_MOT_MAX_FREQ, speed));
+    return freq;
+}
 
-    if (period > (1000000 / ABK_MOT_MIN_FREQ))
-        period = 1000000 / ABK_MOT_MIN_FREQ;
-    else if (period < (1000000 / ABK_MOT_MAX_FREQ))
-        period = 1000000 / ABK_MOT_MAX_FREQ;
+int ABK_set_speed(ABK_axis_t *axis, float speed) {
+    // The output resolves the frequency to one PCLK tick, no more whole microsecond periods
+    axis->motor->write_hz(ABK_speed_hz(speed));
+    return 0;
+}
 
-    motor_ctl.period_us(period);
-    motor_ctl = dt;
+// Reach speed in ms from the current output, interpolated every output period
+int ABK_ramp_speed(ABK_axis_t *axis, float speed, uint32_t ms) {
+    axis->motor->ramp_hz(ABK_speed_hz(speed), ms);
     return 0;
 }
 
@@ -96,27 +381,31 @@ bool ABK_validate_config(ABK_config_t *config) {
     return (res == (1 + 2 + 4 + 8));
 }
 
-bool ABK_eeprom_read_config(AT24CXX_I2C *eeprom, ABK_config_t *config) {
+static int ABK_eeprom_config_address(uint8_t axis) {
+    return ABK_EEPROM_START_ADDRESS + axis * ABK_EEPROM_DATA_SIZE;
+}
+
+bool ABK_eeprom_read_config(AT24CXX_I2C *eeprom, ABK_config_t *config, uint8_t axis) {
     ABK_eeprom_t eedata;
 
-    bool ret = eeprom->read(ABK_EEPROM_START_ADDRESS, eedata.raw, ABK_EEPROM_DATA_SIZE);
+    bool ret = eeprom->read(ABK_eeprom_config_address(axis), eedata.raw, ABK_EEPROM_DATA_SIZE);
     memcpy(config, &eedata.data.config, ABK_EEPROM_CONF_SIZE);
 
     return ret;
 }
 
-bool ABK_eeprom_write_config(AT24CXX_I2C *eeprom, ABK_config_t *config) {
+bool ABK_eeprom_write_config(AT24CXX_I2C *eeprom, ABK_config_t *config, uint8_t axis) {
     ABK_eeprom_t eedata;
     eedata.data.eeprom_version = ABK_EEPROM_VERSION;
     eedata.data.eeprom_state = ABK_EEPROM_STATE_PRESENT;
     memcpy(eedata.data.config, config, ABK_EEPROM_CONF_SIZE);
 
-    bool ret = eeprom->write(ABK_EEPROM_START_ADDRESS, eedata.raw, ABK_EEPROM_DATA_SIZE);
+    bool ret = eeprom->write(ABK_eeprom_config_address(axis), eedata.raw, ABK_EEPROM_DATA_SIZE);
 
     return ret;
 }
 
-bool ABK_eeprom_erase_config(AT24CXX_I2C *eeprom) {
+bool ABK_eeprom_erase_config(AT24CXX_I2C *eeprom, uint8_t axis) {
 
     ABK_eeprom_t eedata;
     ABK_config_t config;
@@ -143,7 +432,67 @@ bool ABK_eeprom_erase_config(AT24CXX_I2C *eeprom) {
     DEBUG_PRINTF("\r\n");
 #endif
 
-    bool ret = eeprom->write(ABK_EEPROM_START_ADDRESS, eedata.raw, ABK_EEPROM_DATA_SIZE);
+    bool ret = eeprom->write(ABK_eeprom_config_address(axis), eedata.raw, ABK_EEPROM_DATA_SIZE);
+
+    return ret;
+}
+
+static int ABK_eeprom_lead_address(uint8_t axis) {
+    return ABK_EEPROM_LEAD_ADDRESS + axis * ABK_EEPROM_LEAD_SIZE;
+}
+
+// Blank or corrupted lead times read as zero so an unconfigured rig behaves as before
+bool ABK_eeprom_read_lead(AT24CXX_I2C *eeprom, ABK_lead_t *lead, uint8_t axis) {
+    bool ret = eeprom->read(ABK_eeprom_lead_address(axis), (unsigned char *) lead, ABK_EEPROM_LEAD_SIZE);
+
+    if (!ret || lead->brake > ABK_LEAD_MAX)
+        lead->brake = 0;
+    if (!ret || lead->vfd > ABK_LEAD_MAX)
+        lead->vfd = 0;
 
     return ret;
 }
+
+bool ABK_eeprom_write_lead(AT24CXX_I2C *eeprom, ABK_lead_t *lead, uint8_t axis) {
+    return eeprom->write(ABK_eeprom_lead_address(axis), (unsigned char *) lead, ABK_EEPROM_LEAD_SIZE);
+}
+
+static int ABK_eeprom_cue_address(uint8_t axis, uint8_t index) {
+    return ABK_EEPROM_CUE_ADDRESS + (axis * (ABK_CUES - 1) + index - 1) * ABK_EEPROM_CUE_SLOT;
+}
+
+// Cues 1 and up, stored as version, state and cue like the configuration.
+// A blank or foreign slot reads as an unused cue.
+bool ABK_eeprom_read_cue(AT24CXX_I2C *eeprom, ABK_cue_t *cue, uint8_t axis, uint8_t index) {
+    unsigned char raw[ABK_EEPROM_CUE_SIZE];
+
+    bool ret = eeprom->read(ABK_eeprom_cue_address(axis, index), raw, ABK_EEPROM_CUE_SIZE);
+    memcpy(cue, &raw[2], ABK_CUE_SIZE);
+
+    if (!ret || raw[0] != ABK_EEPROM_VERSION || raw[1] != ABK_EEPROM_STATE_PRESENT) {
+        memset(cue, 0, ABK_CUE_SIZE);
+        return false;
+    }
+
+    return true;
+}
+
+bool ABK_eeprom_write_cue(AT24CXX_I2C *eeprom, ABK_cue_t *cue, uint8_t axis, uint8_t index) {
+    unsigned char raw[ABK_EEPROM_CUE_SIZE];
+
+    raw[0] = ABK_EEPROM_VERSION;
+    raw[1] = ABK_EEPROM_STATE_PRESENT;
+    memcpy(&raw[2], cue, ABK_CUE_SIZE);
+
+    return eeprom->write(ABK_eeprom_cue_address(axis, index), raw, ABK_EEPROM_CUE_SIZE);
+}
+
+bool ABK_eeprom_erase_cue(AT24CXX_I2C *eeprom, uint8_t axis, uint8_t index) {
+    unsigned char raw[ABK_EEPROM_CUE_SIZE];
+
+    memset(raw, 0, ABK_EEPROM_CUE_SIZE);
+    raw[0] = ABK_EEPROM_VERSION;
+    raw[1] = ABK_EEPROM_STATE_BLANK;
+
+    return eeprom->write(ABK_eeprom_cue_address(axis, index), raw, ABK_EEPROM_CUE_SIZE);
+}
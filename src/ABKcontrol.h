@@ -8,8 +8,12 @@
 #ifndef ABKCONTROL_H
 #define ABKCONTROL_H
 
+#include "config.h"
+
 #include "mbed.h"
 
+#include "freqout.h"
+
 #include "AT24Cxx_I2C.h"
 
 #define ABK_MOT_MIN_FREQ            (2000.0)
@@ -22,19 +26,28 @@
 #define ABK_EEPROM_STATE_PRESENT    (1)
 #define ABK_EEPROM_CONF_SIZE        (18)
 #define ABK_EEPROM_DATA_SIZE        (ABK_EEPROM_CONF_SIZE + 2)
-#define ABK_EEPROM_START_ADDRESS    (1)
+#define ABK_EEPROM_START_ADDRESS    (1)     // Axis n config is at START + n * DATA_SIZE
+#define ABK_EEPROM_MAX_AXES         (2)
+#define ABK_EEPROM_CONFIG_END       (ABK_EEPROM_START_ADDRESS + ABK_EEPROM_MAX_AXES * ABK_EEPROM_DATA_SIZE)
+#define ABK_EEPROM_CAN_ADDRESS      (ABK_EEPROM_CONFIG_END)     // Node id, 0xFF when CAN is disabled
+#define ABK_EEPROM_LEAD_ADDRESS     (ABK_EEPROM_CAN_ADDRESS + 1) // Axis n lead times are at LEAD + n * LEAD_SIZE
+#define ABK_EEPROM_LEAD_SIZE        (4)
+#define ABK_EEPROM_USED_END         (ABK_EEPROM_LEAD_ADDRESS + ABK_EEPROM_MAX_AXES * ABK_EEPROM_LEAD_SIZE)
+#define ABK_EEPROM_CUE_ADDRESS      (64)    // Axis n cue c (1..) is at CUE + (n * (ABK_CUES - 1) + c - 1) * CUE_SLOT
+#define ABK_EEPROM_CUE_SLOT         (32)    // A cue never spans two pages
+#define ABK_EEPROM_CUE_SIZE         (ABK_CUE_SIZE + 2)
+#define ABK_EEPROM_CUE_END          (ABK_EEPROM_CUE_ADDRESS + ABK_EEPROM_MAX_AXES * (ABK_CUES - 1) * ABK_EEPROM_CUE_SLOT)
+
+#define ABK_LEAD_MAX                (2000)  // ms, anything above is treated as unset
+
+#define ABK_CUES                    (8)     // Cues per axis, cue 0 is the axis configuration
+#define ABK_CUE_SIZE                (21)
 
 #define CHECK_FLAG(value, flag) ((value & flag) == flag)
 #define ADD_FLAG(value, flag) (value | flag)
 #define REMOVE_FLAG(value, flag) (value & ~flag)
 #define SWITCH_FLAG(value, flag, test) (test) ? ADD_FLAG(value, flag) : REMOVE_FLAG(value, flag)
 
-extern bool brake;
-extern DigitalOut clutch;
-extern DigitalOut dir_fw;
-extern DigitalOut dir_rw;
-extern PwmOut motor_ctl;
-
 struct ABK_eeprom_data_s {
     unsigned char eeprom_version;
     unsigned char eeprom_state;
@@ -67,6 +80,21 @@ struct ABK_config_s {
 
 typedef struct ABK_config_s ABK_config_t;
 
+typedef enum {
+    ABK_FOLLOW_TRIGGER = 0,     // Armed once the previous cue stops, runs at the next trigger
+    ABK_FOLLOW_AUTO,            // Runs delay ms after the previous cue stops
+} ABK_follow_t;
+
+// A cue list runs its cues in order, cue 0 waits for the trigger. The list
+// ends at the first unused or invalid cue.
+struct ABK_cue_s {
+    ABK_config_t profile;       // 18, profile.state is 1 when the cue is used
+    uint8_t follow;             // 1, ABK_follow_t
+    uint16_t delay;             // 2, ms from the previous cue stop to this cue trigger
+} __attribute__((packed));      // Cue size: 21
+
+typedef struct ABK_cue_s ABK_cue_t;
+
 typedef enum {
     ABK_STATE_STANDBY = 0,
     ABK_STATE_NOT_CONFIGURED,
@@ -75,6 +103,7 @@ typedef enum {
     ABK_STATE_RUN,
     ABK_STATE_SLOWFEED,
     ABK_STATE_RESET,
+    ABK_STATE_CALIBRATION,
 } ABK_state_t;
 
 typedef enum {
@@ -85,6 +114,8 @@ typedef enum {
     ABK_ERROR_VFD_ERROR         = 0x08,
 } ABK_error_t;
 
+#define ABK_ERROR_FAULTS            (ABK_ERROR_EMERGENCY_STOP | ABK_ERROR_VFD_ERROR)    // Stop the motor
+
 typedef enum {
     ABK_DRUM_BRAKED = 0,
     ABK_DRUM_FREEWHEEL
@@ -102,17 +133,91 @@ typedef enum {
     ABK_SLOWFEED_REWIND
 } ABK_slowfeed_t;
 
-void ABK_set_drum_mode(ABK_drum_mode_t);
-void ABK_set_motor_mode(ABK_motor_mode_t);
-int ABK_set_speed(float speed);
+typedef enum {
+    ABK_INPUT_SLOWFEED_FW       = 0x01,
+    ABK_INPUT_SLOWFEED_RW       = 0x02,
+    ABK_INPUT_VFD_FAULT         = 0x04,
+    ABK_INPUT_EMERGENCY_STOP    = 0x08,
+    ABK_INPUT_TRIGGER           = 0x10,
+} ABK_input_t;
+
+// Time between issuing a command and the drum actually responding to it
+struct ABK_lead_s {
+    uint16_t brake;             // ms, brake release to drum free
+    uint16_t vfd;               // ms, VFD run command to drum moving
+} __attribute__((packed));      // Lead size: 4
+
+typedef struct ABK_lead_s ABK_lead_t;
+
+struct ABK_axis_s {
+    // Outputs
+    DigitalOut *dir_fw;
+    DigitalOut *dir_rw;
+    bool *brake;
+    FreqOut *motor;
+
+    // Shared with the serial task, config is protected by ABK_config_mutex
+    ABK_config_t config;
+    ABK_cue_t cues[ABK_CUES - 1];       // Cues after the configuration, read at boot too
+    ABK_lead_t lead;                    // Read at boot, changes apply after a reset
+    volatile uint8_t slowfeed;          // ABK_slowfeed_t requested over serial
+    volatile ABK_state_t state;
+    volatile uint8_t error;
+
+    // Trigger scheduled from an interrupt (CAN cue), consumed by the next tick
+    volatile bool ext_trigger;
+    volatile uint32_t ext_trigger_time;
+
+    volatile bool rearm;                // Back to cue 0 from STANDBY, requested over serial, kept until applied
+
+    // Control loop private state
+    ABK_cue_t list[ABK_CUES];           // Copy of config and cues used while running
+    uint8_t cue_count;
+    volatile uint8_t cue;               // Running or armed cue
+    ABK_config_t *profile;              // Its profile in list
+    ABK_state_t last_state;
+    bool triggered;
+    bool trigger_released;              // Trigger input seen inactive since the cue was armed
+    uint32_t trigger_time;              // us_ticker at trigger
+
+    // Control loop cost
+    uint32_t tick_us;
+    uint32_t tick_max_us;
+};
+
+typedef struct ABK_axis_s ABK_axis_t;
+
+void ABK_axis_init(ABK_axis_t *axis, DigitalOut *dir_fw, DigitalOut *dir_rw, bool *brake, FreqOut *motor);
+bool ABK_axis_tick(ABK_axis_t *axis, uint8_t inputs);
+void ABK_axis_trigger_at(ABK_axis_t *axis, uint32_t time);
+int ABK_axis_load_cues(ABK_axis_t *axis);
+
+// Takes axes out of the control loop (CALIBRATION), all of them or none. Unconfigured or
+// faulted axes can be locked, a running or already locked one can't.
+bool ABK_axes_lock(ABK_axis_t *axes, int count, ABK_state_t *saved);
+void ABK_axes_unlock(ABK_axis_t *axes, int count, ABK_state_t *saved);
+
+void ABK_set_drum_mode(ABK_axis_t *axis, ABK_drum_mode_t);
+void ABK_set_motor_mode(ABK_axis_t *axis, ABK_motor_mode_t);
+int ABK_set_speed(ABK_axis_t *axis, float speed);
+int ABK_ramp_speed(ABK_axis_t *axis, float speed, uint32_t ms);
+
+float ABK_profile_speed(ABK_config_t *config, int stime);
 
 float ABK_map(int from_val1, int from_val2, int to_val1, int to_val2, int value);
 float ABK_map(int from_val1, int from_val2, int to_val1, int to_val2, float value);
 
 bool ABK_validate_config(ABK_config_t *config);
 
-bool ABK_eeprom_read_config(AT24CXX_I2C *eeprom, ABK_config_t *config);
-bool ABK_eeprom_write_config(AT24CXX_I2C *eeprom, ABK_config_t *config);
-bool ABK_eeprom_erase_config(AT24CXX_I2C *eeprom);
+bool ABK_eeprom_read_config(AT24CXX_I2C *eeprom, ABK_config_t *config, uint8_t axis);
+bool ABK_eeprom_write_config(AT24CXX_I2C *eeprom, ABK_config_t *config, uint8_t axis);
+bool ABK_eeprom_erase_config(AT24CXX_I2C *eeprom, uint8_t axis);
+
+bool ABK_eeprom_read_cue(AT24CXX_I2C *eeprom, ABK_cue_t *cue, uint8_t axis, uint8_t index);
+bool ABK_eeprom_write_cue(AT24CXX_I2C *eeprom, ABK_cue_t *cue, uint8_t axis, uint8_t index);
+bool ABK_eeprom_erase_cue(AT24CXX_I2C *eeprom, uint8_t axis, uint8_t index);
+
+bool ABK_eeprom_read_lead(AT24CXX_I2C *eeprom, ABK_lead_t *lead, uint8_t axis);
+bool ABK_eeprom_write_lead(AT24CXX_I2C *eeprom, ABK_lead_t *lead, uint8_t axis);
 
 #endif /* !ABKCONTROL_H */
@@ -0,0 +1,333 @@
+/*
+ * ABKdiag.cpp
+ * Copyright (C) 2017 Benoit Rapidel <benoit.rapidel+devs@exmachina.fr>
+ *
+ * Distributed under terms of the MIT license.
+ */
+
+#include "ABKdiag.h"
+
+#include "pins.h"
+
+#if ABK_HAS_CONTROL
+
+#define ABK_DIAG_PCLK           (SystemCoreClock / 4)   // TIMER1, as in freqout.cpp
+#define ABK_DIAG_SETTLE         (1)     // ms between two loopback edges
+#define ABK_DIAG_MASKED_US      (50)    // us an edge is polled with interrupts off
+#define ABK_DIAG_RELEASE        (5 * ABK_INTERVAL)  // ms for the control loop to clear the loopback faults
+
+static const PinName ABK_diag_outputs[2][ABK_DIAG_LOOPBACK_PAIRS] = {
+    { OUTPUT1_1, OUTPUT1_2, OUTPUT1_3, OUTPUT1_4 },
+    { OUTPUT2_1, OUTPUT2_2, OUTPUT2_3, OUTPUT2_4 },
+};
+
+static const PinName ABK_diag_inputs[2][ABK_DIAG_LOOPBACK_PAIRS] = {
+    { INPUT1_1, INPUT1_2, INPUT1_3, INPUT1_4 },
+    { INPUT2_1, INPUT2_2, INPUT2_3, INPUT2_4 },
+};
+
+// Capture of the VFD frequency output, filled by the TIMER1 interrupt
+static volatile uint32_t ABK_diag_edges;
+static volatile uint32_t ABK_diag_first;
+static volatile uint32_t ABK_diag_last;
+
+static void ABK_diag_stop(ABK_axis_t *axis) {
+    ABK_set_speed(axis, 0);
+    ABK_set_motor_mode(axis, ABK_MOTOR_DISABLED);
+    ABK_set_drum_mode(axis, ABK_DRUM_BRAKED);
+}
+
+static void ABK_diag_wait(ABK_task_id_t task, uint32_t ms) {
+    uint32_t start = us_ticker_read();
+
+    while ((us_ticker_read() - start) < ms * 1000) {
+        ABK_supervisor_checkin(task);
+        Thread::wait((ms < 10) ? ms : 10);
+    }
+}
+
+// Drives the output and waits for the input to leave level. The first ABK_DIAG_MASKED_US
+// are polled with interrupts off so neither USB nor the control tick stretch a normal
+// edge; a slower input is polled on with interrupts on, up to the timeout.
+static bool ABK_diag_edge(DigitalOut *out, DigitalIn *in, int value, int level, uint32_t *worst) {
+    bool ok;
+    uint32_t elapsed;
+
+    core_util_critical_section_enter();
+    uint32_t start = us_ticker_read();
+    out->write(value);
+    do {
+        int read = in->read();
+
+        elapsed = us_ticker_read() - start;
+        ok = (read != level);
+    } while (!ok && elapsed < ABK_DIAG_MASKED_US);
+    core_util_critical_section_exit();
+
+    while (!ok && elapsed < ABK_DIAG_LOOPBACK_TIMEOUT) {
+        int read = in->read();
+
+        elapsed = us_ticker_read() - start;
+        ok = (read != level);
+    }
+
+    if (ok && elapsed > *worst)
+        *worst = elapsed;
+
+    return ok;
+}
+
+// Input polarity depends on the wiring, only the change of level matters
+ABK_diag_result_t ABK_diag_loopback(ABK_axis_t *axes, int count, int block, ABK_task_id_t task,
+        ABK_diag_loopback_t loopback[ABK_DIAG_LOOPBACK_PAIRS]) {
+    ABK_diag_result_t ret = ABK_DIAG_OK;
+    ABK_state_t saved[ABK_AXES];
+
+    if (block < 1 || block > 2)
+        return ABK_DIAG_UNAVAILABLE;
+
+    // Block 1 drives the direction outputs of both axes and the E-stop input
+    if (!ABK_axes_lock(axes, count, saved))
+        return ABK_DIAG_BUSY;
+
+    memset(loopback, 0, ABK_DIAG_LOOPBACK_PAIRS * sizeof(ABK_diag_loopback_t));
+
+    for (int i=0; i<count; i++)
+        ABK_diag_stop(&axes[i]);
+
+    for (int i=0; i<ABK_DIAG_LOOPBACK_PAIRS; i++) {
+        PinName pin = ABK_diag_outputs[block - 1][i];
+
+#if ABK_AXES > 1
+        if (pin == CTL_FREQ_VFD_2) // Owned by TIMER1
+            continue;
+#endif
+
+        DigitalOut out(pin, 0);
+        DigitalIn in(ABK_diag_inputs[block - 1][i]);
+
+        ABK_diag_wait(task, ABK_DIAG_SETTLE);
+        int idle = in.read();
+
+        loopback[i].tested = true;
+        loopback[i].ok = true;
+        for (int n=0; n<ABK_DIAG_LOOPBACK_CYCLES && loopback[i].ok; n++) {
+            loopback[i].ok = ABK_diag_edge(&out, &in, 1, idle, &loopback[i].rise_us);
+            ABK_diag_wait(task, ABK_DIAG_SETTLE);
+
+            if (loopback[i].ok)
+                loopback[i].ok = ABK_diag_edge(&out, &in, 0, !idle, &loopback[i].fall_us);
+            ABK_diag_wait(task, ABK_DIAG_SETTLE);
+        }
+
+        out.write(0);
+        if (!loopback[i].ok)
+            ret = ABK_DIAG_FAILED;
+    }
+
+    // The faults the loopback raised must be gone before the axes are released
+    ABK_diag_wait(task, ABK_DIAG_RELEASE);
+
+    ABK_axes_unlock(axes, count, saved);
+    return ret;
+}
+
+// Writes the complement of what is stored so every bit changes, then puts it back.
+// The area belongs to the log ring, the mutex keeps the log thread out meanwhile.
+ABK_diag_result_t ABK_diag_eeprom(AT24CXX_I2C *eeprom, Mutex *eeprom_mutex, ABK_diag_eeprom_t *result) {
+    static uint8_t saved[ABK_DIAG_EEPROM_SIZE];
+    static uint8_t pattern[ABK_DIAG_EEPROM_SIZE];
+    static uint8_t check[ABK_DIAG_EEPROM_SIZE];
+    ABK_diag_result_t ret = ABK_DIAG_OK;
+    uint32_t start;
+
+    memset(result, 0, sizeof(ABK_diag_eeprom_t));
+
+    eeprom_mutex->lock();
+
+    if (!eeprom->read(ABK_DIAG_EEPROM_ADDRESS, saved, ABK_DIAG_EEPROM_SIZE)) {
+        eeprom_mutex->unlock();
+        return ABK_DIAG_FAILED;
+    }
+
+    for (int i=0; i<ABK_DIAG_EEPROM_SIZE; i++)
+        pattern[i] = ~saved[i];
+
+    // Page writes, each one waits for the write cycle of the previous
+    start = us_ticker_read();
+    for (int i=0; i<ABK_DIAG_EEPROM_SIZE; i+=ABK_LOG_PAGE_SIZE) {
+        if (!eeprom->write(ABK_DIAG_EEPROM_ADDRESS + i, pattern + i, ABK_LOG_PAGE_SIZE))
+            ret = ABK_DIAG_FAILED;
+    }
+    result->write_us = us_ticker_read() - start;
+
+    start = us_ticker_read();
+    if (!eeprom->read(ABK_DIAG_EEPROM_ADDRESS, check, ABK_DIAG_EEPROM_SIZE))
+        ret = ABK_DIAG_FAILED;
+    result->read_us = us_ticker_read() - start;
+
+    result->verified = (memcmp(pattern, check, ABK_DIAG_EEPROM_SIZE) == 0);
+    if (!result->verified)
+        ret = ABK_DIAG_FAILED;
+
+    for (int i=0; i<ABK_DIAG_EEPROM_SIZE; i+=ABK_LOG_PAGE_SIZE) {
+        if (!eeprom->write(ABK_DIAG_EEPROM_ADDRESS + i, saved + i, ABK_LOG_PAGE_SIZE))
+            ret = ABK_DIAG_FAILED;
+    }
+
+    eeprom_mutex->unlock();
+
+    result->bytes = ABK_DIAG_EEPROM_SIZE;
+    return ret;
+}
+
+// Only referenced through its vector, which the host simulation drops
+__attribute__((unused)) static void ABK_diag_capture_isr(void) {
+    uint32_t time = LPC_TIM1->CR1;
+
+    LPC_TIM1->IR = (1 << 5);                    // CR1 interrupt
+    if (ABK_diag_edges++ == 0)
+        ABK_diag_first = time;
+    ABK_diag_last = time;
+}
+
+// Rising edges timestamped by TIMER1 at full PCLK. Both ends run from the same
+// crystal, this checks the synthesis and its quantisation, not the oscillator.
+ABK_diag_result_t ABK_diag_pwm(ABK_axis_t *axis, int speed, ABK_task_id_t task, ABK_diag_pwm_t *result) {
+#if ABK_AXES > 1
+    return ABK_DIAG_UNAVAILABLE; // TIMER1 drives the second axis
+#else
+    ABK_diag_result_t ret = ABK_DIAG_OK;
+    ABK_state_t saved;
+
+    if (!ABK_axes_lock(axis, 1, &saved))
+        return ABK_DIAG_BUSY;
+
+    memset(result, 0, sizeof(ABK_diag_pwm_t));
+
+    ABK_diag_stop(axis);                        // Motor disabled, only the output runs
+    ABK_set_speed(axis, speed);
+    ABK_diag_wait(task, ABK_INTERVAL);          // New period latched
+
+    ABK_diag_edges = 0;
+
+    LPC_SC->PCONP |= (1 << 2);                  // Power TIMER1
+    LPC_TIM1->TCR = 2;                          // Hold in reset
+    LPC_TIM1->CTCR = 0;
+    LPC_TIM1->PR = 0;
+    LPC_TIM1->MCR = 0;
+    LPC_TIM1->CCR = (1 << 3) | (1 << 5);        // Capture CAP1.1 rising edges, interrupt
+    LPC_TIM1->IR = 0x3F;
+    LPC_PINCON->PINSEL3 |= (3 << 6);            // ABK_DIAG_CAPTURE (P1.19) as CAP1.1
+
+    NVIC_SetVector(TIMER1_IRQn, (uint32_t) &ABK_diag_capture_isr);
+    NVIC_EnableIRQ(TIMER1_IRQn);
+    LPC_TIM1->TCR = 1;
+
+    ABK_diag_wait(task, ABK_DIAG_PWM_WINDOW);
+
+    NVIC_DisableIRQ(TIMER1_IRQn);
+    LPC_TIM1->TCR = 0;
+    LPC_TIM1->CCR = 0;
+    LPC_TIM1->IR = 0x3F;
+    LPC_PINCON->PINSEL3 &= ~(3 << 6);
+    LPC_SC->PCONP &= ~(1 << 2);
+
+    uint32_t edges = ABK_diag_edges;
+    uint32_t span = ABK_diag_last - ABK_diag_first;
+
+    result->edges = edges;
+    result->commanded_mhz = (uint32_t) (axis->motor->actual_hz() * 1000.0);
+
+    if (edges < 2 || span == 0) {
+        ret = ABK_DIAG_NO_SIGNAL;
+    } else {
+        result->measured_mhz = (uint32_t) ((uint64_t) (edges - 1) * ABK_DIAG_PCLK * 1000 / span);
+        if (result->commanded_mhz > 0)
+            result->error_ppm = (int32_t) (((int64_t) result->measured_mhz - result->commanded_mhz)
+                    * 1000000 / result->commanded_mhz);
+    }
+
+    ABK_set_speed(axis, 0);
+    ABK_axes_unlock(axis, 1, &saved);
+    return ret;
+#endif
+}
+
+// Up and down along a triangle, one output ramp per control interval, stopped on any fault
+ABK_diag_result_t ABK_diag_ramp(ABK_axis_t *axis, DigitalIn *feedback, ABK_task_id_t task, ABK_diag_ramp_t *result) {
+    ABK_diag_result_t ret = ABK_DIAG_OK;
+    ABK_state_t saved;
+    uint32_t start, step = 0;
+    int level;
+
+    if (!ABK_axes_lock(axis, 1, &saved))
+        return ABK_DIAG_BUSY;
+
+    memset(result, 0, sizeof(ABK_diag_ramp_t));
+
+    ABK_diag_stop(axis);
+    ABK_set_drum_mode(axis, ABK_DRUM_FREEWHEEL);
+    ABK_set_motor_mode(axis, ABK_MOTOR_FW);
+
+    level = feedback ? feedback->read() : 0;
+    start = us_ticker_read();
+
+    while (true) {
+        uint32_t ms = (us_ticker_read() - start) / 1000;
+
+        if (axis->error & ABK_ERROR_FAULTS) {
+            ret = ABK_DIAG_ERROR;
+            break;
+        }
+        if (ms >= 2 * ABK_DIAG_RAMP_TIME)
+            break;
+
+        // Aim where the triangle is at the end of the step, the output interpolates
+        if (ms >= step) {
+            int next = step + ABK_INTERVAL;
+            float speed = (next < ABK_DIAG_RAMP_TIME)
+                ? ABK_map(0, ABK_DIAG_RAMP_TIME, 0, ABK_DIAG_RAMP_SPEED, next)
+                : ABK_map(ABK_DIAG_RAMP_TIME, 2 * ABK_DIAG_RAMP_TIME, ABK_DIAG_RAMP_SPEED, 0, next);
+
+            ABK_ramp_speed(axis, (speed > 0) ? speed : 0, ABK_INTERVAL);
+            step += ABK_INTERVAL;
+        }
+
+        // The encoder pins have no GPIO interrupt (port 1), 1ms polling is enough to see motion
+        if (feedback && feedback->read() != level) {
+            level = !level;
+            result->feedback_edges++;
+        }
+
+        ABK_supervisor_checkin(task);
+        Thread::wait(1);
+    }
+
+    ABK_diag_stop(axis);
+    result->duration_ms = (us_ticker_read() - start) / 1000;
+
+    ABK_axes_unlock(axis, 1, &saved);
+    return ret;
+}
+
+const char *ABK_diag_result_name(ABK_diag_result_t result) {
+    switch (result) {
+        case ABK_DIAG_OK:
+            return "ok";
+        case ABK_DIAG_BUSY:
+            return "busy";
+        case ABK_DIAG_ERROR:
+            return "error";
+        case ABK_DIAG_FAILED:
+            return "failed";
+        case ABK_DIAG_NO_SIGNAL:
+            return "no_signal";
+        case ABK_DIAG_UNAVAILABLE:
+            return "unavailable";
+    }
+
+    return "unknown";
+}
+
+#endif
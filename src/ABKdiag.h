@@ -0,0 +1,81 @@
+/*
+ * ABKdiag.h
+ * Copyright (C) 2017 Benoit Rapidel <benoit.rapidel+devs@exmachina.fr>
+ *
+ * Distributed under terms of the MIT license.
+ */
+
+#ifndef ABKDIAG_H
+#define ABKDIAG_H
+
+#include "config.h"
+
+#include "mbed.h"
+
+#include "ABKcontrol.h"
+#include "ABKlogproto.h"
+#include "ABKsupervisor.h"
+
+#include "AT24Cxx_I2C.h"
+
+// Commissioning tests of a production unit. Every test takes the axes it
+// touches into ABK_STATE_CALIBRATION, so the control loop leaves the outputs
+// alone while still raising E-stop and VFD faults, and only runs on axes that
+// aren't running. Unconfigured axes are fine, commissioning comes first.
+
+#define ABK_DIAG_LOOPBACK_PAIRS     (4)     // Outputs wired back to the inputs of the same I/O block
+#define ABK_DIAG_LOOPBACK_CYCLES    (8)     // Rising and falling edges measured per pair
+#define ABK_DIAG_LOOPBACK_TIMEOUT   (10000) // us an input may take to follow its output
+#define ABK_DIAG_EEPROM_SIZE        (256)   // Bytes written at the end of the EEPROM, restored afterwards
+#define ABK_DIAG_EEPROM_ADDRESS     (ABK_LOG_EEPROM_SIZE - ABK_DIAG_EEPROM_SIZE)
+#define ABK_DIAG_PWM_SPEED          (50)    // Speed the output is measured at, motor disabled
+#define ABK_DIAG_PWM_WINDOW         (500)   // ms of edges captured
+#define ABK_DIAG_RAMP_SPEED         (30)    // Top speed of the motor ramp
+#define ABK_DIAG_RAMP_TIME          (2000)  // ms up, as much down
+
+typedef enum {
+    ABK_DIAG_OK = 0,
+    ABK_DIAG_BUSY,              // An axis is running
+    ABK_DIAG_ERROR,             // Axis error raised while testing
+    ABK_DIAG_FAILED,            // Loopback timeout, EEPROM mismatch
+    ABK_DIAG_NO_SIGNAL,         // Nothing on the capture input
+    ABK_DIAG_UNAVAILABLE,       // Not in this build
+} ABK_diag_result_t;
+
+typedef struct {
+    bool tested;                // Output not driven by something else in this build
+    bool ok;                    // Input followed every edge
+    uint32_t rise_us;           // Worst latency after the output went high
+    uint32_t fall_us;           // Worst latency after the output went low
+} ABK_diag_loopback_t;
+
+typedef struct {
+    uint32_t bytes;
+    uint32_t read_us;
+    uint32_t write_us;
+    bool verified;
+} ABK_diag_eeprom_t;
+
+typedef struct {
+    uint32_t edges;
+    uint32_t commanded_mhz;     // Frequency the output synthesises
+    uint32_t measured_mhz;
+    int32_t error_ppm;
+} ABK_diag_pwm_t;
+
+typedef struct {
+    uint32_t duration_ms;
+    uint32_t feedback_edges;    // Drum motion seen during the ramp
+} ABK_diag_ramp_t;
+
+// block is 1 or 2, OUTPUTb_n must be wired to INPUTb_n
+ABK_diag_result_t ABK_diag_loopback(ABK_axis_t *axes, int count, int block, ABK_task_id_t task,
+        ABK_diag_loopback_t loopback[ABK_DIAG_LOOPBACK_PAIRS]);
+ABK_diag_result_t ABK_diag_eeprom(AT24CXX_I2C *eeprom, Mutex *eeprom_mutex, ABK_diag_eeprom_t *result);
+// The VFD frequency output of the axis must be wired to ABK_DIAG_CAPTURE
+ABK_diag_result_t ABK_diag_pwm(ABK_axis_t *axis, int speed, ABK_task_id_t task, ABK_diag_pwm_t *result);
+ABK_diag_result_t ABK_diag_ramp(ABK_axis_t *axis, DigitalIn *feedback, ABK_task_id_t task, ABK_diag_ramp_t *result);
+
+const char *ABK_diag_result_name(ABK_diag_result_t result);
+
+#endif /* !ABKDIAG_H */
@@ -0,0 +1,165 @@
+/*
+ * ABKevents.cpp
+ * Copyright (C) 2017 Benoit Rapidel <benoit.rapidel+devs@exmachina.fr>
+ *
+ * Distributed under terms of the MIT license.
+ */
+
+#include "ABKevents.h"
+
+#if ABK_HAS_CONTROL
+
+static_assert(ABK_STATE_CALIBRATION < 8, "ABK_event_t.states holds one bit per state");
+
+typedef struct {
+    uint8_t state;              // Last seen by the control thread
+    uint8_t error;
+    bool queued;                // event waits for the serial thread
+    ABK_event_t event;
+} ABK_events_track_t;
+
+static void (*ABK_events_wake)(void);
+static Timer ABK_events_uptime;
+
+// Shared by both threads, under the critical section
+static ABK_events_track_t ABK_events_tracks[ABK_AXES];
+static uint32_t ABK_events_seq = 1;
+static ABK_events_stats_t ABK_events_stats;
+
+static uint32_t ABK_events_sent_ms; // Serial thread only
+
+// Critical section held
+static void ABK_events_queue(int index, uint32_t now) {
+    ABK_events_track_t *track = &ABK_events_tracks[index];
+    ABK_event_t *event = &track->event;
+
+    if (track->queued) {
+        if (event->merged < 255)
+            event->merged++;
+        ABK_events_stats.merged++;
+    } else {
+        event->seq = ABK_events_seq++;
+        event->axis = index;
+        event->merged = 0;
+        event->states = 0;
+        event->errors = 0;
+        track->queued = true;
+    }
+
+    event->time = now;
+    event->state = track->state;
+    event->error = track->error;
+    event->states |= 1 << track->state;
+    event->errors |= track->error;
+}
+
+void ABK_events_init(ABK_axis_t *axes, void (*wake)(void)) {
+    ABK_events_wake = wake;
+    memset(ABK_events_tracks, 0, sizeof(ABK_events_tracks));
+    memset(&ABK_events_stats, 0, sizeof(ABK_events_stats_t));
+
+    for (int i=0; i<ABK_AXES; i++) {
+        ABK_events_tracks[i].state = axes[i].state;
+        ABK_events_tracks[i].error = axes[i].error;
+    }
+
+    ABK_events_uptime.start();
+}
+
+void ABK_events_axis(int index, ABK_axis_t *axis) {
+    ABK_events_track_t *track = &ABK_events_tracks[index];
+    uint8_t state = axis->state;
+    uint8_t error = axis->error;
+    bool wake = false;
+
+    // Locked axes are being tested (the diag loopback drives the E-stop input):
+    // the state tells hosts the axis is busy, its errors are held until release
+    if (state == ABK_STATE_CALIBRATION)
+        error = track->error;
+
+    if (state == track->state && error == track->error)
+        return;
+
+    uint32_t now = ABK_events_uptime.read_ms();
+
+    core_util_critical_section_enter();
+    track->state = state;
+    track->error = error;
+    if (ABK_events_stats.subscribed) {
+        wake = !track->queued; // A merge is sent with the event it joined
+        ABK_events_queue(index, now);
+    }
+    core_util_critical_section_exit();
+
+    if (wake)
+        ABK_events_wake();
+}
+
+void ABK_events_subscribe(bool subscribed) {
+    uint32_t now = ABK_events_uptime.read_ms();
+
+    core_util_critical_section_enter();
+    ABK_events_stats.subscribed = subscribed;
+    for (int i=0; i<ABK_AXES; i++) {
+        if (!subscribed)
+            ABK_events_tracks[i].queued = false;
+        else if (!ABK_events_tracks[i].queued)
+            ABK_events_queue(i, now);
+    }
+    core_util_critical_section_exit();
+
+    ABK_events_sent_ms = now - ABK_EVENT_COALESCE; // The current state goes out at once
+}
+
+uint32_t ABK_events_due(void) {
+    bool queued = false;
+
+    core_util_critical_section_enter();
+    for (int i=0; i<ABK_AXES; i++)
+        queued |= ABK_events_tracks[i].queued;
+    core_util_critical_section_exit();
+
+    if (!queued)
+        return osWaitForever;
+
+    uint32_t elapsed = ABK_events_uptime.read_ms() - ABK_events_sent_ms;
+    return (elapsed >= ABK_EVENT_COALESCE) ? 0 : ABK_EVENT_COALESCE - elapsed;
+}
+
+int ABK_events_take(ABK_event_t *events) {
+    int count = 0;
+
+    if (ABK_events_due() != 0)
+        return 0;
+
+    core_util_critical_section_enter();
+    for (int i=0; i<ABK_AXES; i++) {
+        if (!ABK_events_tracks[i].queued)
+            continue;
+
+        events[count++] = ABK_events_tracks[i].event;
+        ABK_events_tracks[i].queued = false;
+    }
+    ABK_events_stats.sent += count;
+    core_util_critical_section_exit();
+
+    ABK_events_sent_ms = ABK_events_uptime.read_ms();
+
+    // Queued per axis, sent in sequence order
+    for (int i=1; i<count; i++) {
+        for (int j=i; j>0 && events[j].seq < events[j - 1].seq; j--) {
+            ABK_event_t tmp = events[j];
+            events[j] = events[j - 1];
+            events[j - 1] = tmp;
+        }
+    }
+
+    return count;
+}
+
+void ABK_events_get_stats(ABK_events_stats_t *stats) {
+    core_util_critical_section_enter();
+    memcpy(stats, &ABK_events_stats, sizeof(ABK_events_stats_t));
+    core_util_critical_section_exit();
+}
+#endif
@@ -0,0 +1,52 @@
+/*
+ * ABKevents.h
+ * Copyright (C) 2017 Benoit Rapidel <benoit.rapidel+devs@exmachina.fr>
+ *
+ * Distributed under terms of the MIT license.
+ */
+
+#ifndef ABKEVENTS_H
+#define ABKEVENTS_H
+
+#include "config.h"
+
+#include "mbed.h"
+
+#include "ABKcontrol.h"
+
+#define ABK_EVENT_COALESCE      (50)    // Min time in ms between two sends, changes in between are merged
+
+// State or error change of an axis, pushed to subscribed hosts. An event
+// still waiting to be sent absorbs the next changes of its axis: it then
+// holds the latest state and error, and states/errors keep every value seen
+// since the previous event of that axis so short transitions aren't lost.
+typedef struct {
+    uint32_t seq;
+    uint32_t time;              // ms since boot of the latest change
+    uint8_t axis;
+    uint8_t state;              // ABK_state_t
+    uint8_t error;              // ABK_error_t flags
+    uint8_t merged;             // Changes folded into this one, saturates at 255
+    uint8_t states;             // One bit per ABK_state_t held
+    uint8_t errors;             // Every error flag raised
+} ABK_event_t;
+
+typedef struct {
+    bool subscribed;
+    uint32_t sent;
+    uint32_t merged;
+} ABK_events_stats_t;
+
+// wake is called from the control thread when an event is queued
+void ABK_events_init(ABK_axis_t *axes, void (*wake)(void));
+
+// Control thread, after every tick
+void ABK_events_axis(int index, ABK_axis_t *axis);
+
+// Serial thread. Subscribing queues the current state of every axis.
+void ABK_events_subscribe(bool subscribed);
+uint32_t ABK_events_due(void);          // ms until events may be taken, osWaitForever if none
+int ABK_events_take(ABK_event_t *events); // Up to ABK_AXES events in sequence order, once due
+void ABK_events_get_stats(ABK_events_stats_t *stats);
+
+#endif /* !ABKEVENTS_H */
@@ -0,0 +1,154 @@
+/*
+ * ABKinputs.cpp
+ * Copyright (C) 2017 Benoit Rapidel <benoit.rapidel+devs@exmachina.fr>
+ *
+ * Distributed under terms of the MIT license.
+ */
+
+#include "ABKinputs.h"
+
+#include "pins.h"
+
+#if ABK_HAS_CONTROL
+
+// PinNames are numbered from P0_0, 32 per port
+#define ABK_PIN_PORT(pin)       (((pin) - P0_0) >> 5)
+#define ABK_PIN_BIT(pin)        (((pin) - P0_0) & 0x1F)
+#define ABK_INPUTS_PORTS        (3)
+
+static_assert(ABK_DEBOUNCE_TRIGGER >= 1 && ABK_DEBOUNCE_TRIGGER < (1 << ABK_INPUTS_PLANES), "Debounce window out of range");
+static_assert(ABK_DEBOUNCE_ESTOP >= 1 && ABK_DEBOUNCE_ESTOP < (1 << ABK_INPUTS_PLANES), "Debounce window out of range");
+static_assert(ABK_DEBOUNCE_VFD >= 1 && ABK_DEBOUNCE_VFD < (1 << ABK_INPUTS_PLANES), "Debounce window out of range");
+static_assert(ABK_DEBOUNCE_SLOWFEED >= 1 && ABK_DEBOUNCE_SLOWFEED < (1 << ABK_INPUTS_PLANES), "Debounce window out of range");
+
+typedef struct {
+    PinName pin;
+    uint32_t flag;              // Snapshot bit
+    bool active_low;
+    uint8_t window;             // Samples
+} ABK_input_channel_t;
+
+#define ABK_AXIS2(flag)         ((uint32_t) (flag) << ABK_INPUTS_AXIS_SHIFT)
+
+static const ABK_input_channel_t ABK_input_channels[] = {
+    { SLOWFEED_FW,      ABK_INPUT_SLOWFEED_FW,      false,  ABK_DEBOUNCE_SLOWFEED },
+    { SLOWFEED_RW,      ABK_INPUT_SLOWFEED_RW,      false,  ABK_DEBOUNCE_SLOWFEED },
+    { VFD_STS,          ABK_INPUT_VFD_FAULT,        true,   ABK_DEBOUNCE_VFD },
+    { EMERGENCY_STOP,   ABK_INPUT_EMERGENCY_STOP,   true,   ABK_DEBOUNCE_ESTOP },
+#if !ABK_SIMULATE
+    { TRIGGER_INPUT,    ABK_INPUT_TRIGGER,          true,   ABK_DEBOUNCE_TRIGGER },
+#endif
+#if ABK_AXES > 1
+    { SLOWFEED_FW_2,    ABK_AXIS2(ABK_INPUT_SLOWFEED_FW),   false,  ABK_DEBOUNCE_SLOWFEED },
+    { SLOWFEED_RW_2,    ABK_AXIS2(ABK_INPUT_SLOWFEED_RW),   false,  ABK_DEBOUNCE_SLOWFEED },
+    { VFD_STS_2,        ABK_AXIS2(ABK_INPUT_VFD_FAULT),     true,   ABK_DEBOUNCE_VFD },
+    { EMERGENCY_STOP,   ABK_AXIS2(ABK_INPUT_EMERGENCY_STOP), true,  ABK_DEBOUNCE_ESTOP },  // Shared
+    { TRIGGER_INPUT_2,  ABK_AXIS2(ABK_INPUT_TRIGGER),       true,   ABK_DEBOUNCE_TRIGGER },
+#endif
+};
+
+#define ABK_INPUTS_CHANNELS     (sizeof(ABK_input_channels) / sizeof(ABK_input_channels[0]))
+
+static Ticker ABK_inputs_ticker;
+
+static LPC_GPIO_TypeDef *ABK_inputs_ports[ABK_INPUTS_PORTS];
+static uint32_t ABK_inputs_polarity;                // Active-low channels
+static uint32_t ABK_inputs_window[ABK_INPUTS_PLANES]; // Window of every channel, bit-sliced
+
+static uint32_t ABK_inputs_count[ABK_INPUTS_PLANES]; // Vertical counters
+static volatile uint32_t ABK_inputs_state;
+static ABK_inputs_stats_t ABK_inputs_stats;
+
+// Every channel as an active-high flag, from one read of each port
+static uint32_t ABK_inputs_raw(void) {
+    uint32_t levels[ABK_INPUTS_PORTS];
+    uint32_t raw = 0;
+
+    for (int i=0; i<ABK_INPUTS_PORTS; i++)
+        levels[i] = ABK_inputs_ports[i] ? ABK_inputs_ports[i]->FIOPIN : 0;
+
+    for (unsigned int i=0; i<ABK_INPUTS_CHANNELS; i++) {
+        PinName pin = ABK_input_channels[i].pin;
+
+        if (levels[ABK_PIN_PORT(pin)] & (1U << ABK_PIN_BIT(pin)))
+            raw |= ABK_input_channels[i].flag;
+    }
+
+    return raw ^ ABK_inputs_polarity;
+}
+
+// Ticker interrupt
+static void ABK_inputs_sample(void) {
+    uint32_t raw = ABK_inputs_raw();
+    uint32_t state = ABK_inputs_state;
+    uint32_t delta = raw ^ state;   // Channels disagreeing with their debounced state
+    uint32_t counting = 0;
+
+    // Count up where the sample disagrees, clear where it agrees
+    uint32_t carry = delta;
+    for (int k=0; k<ABK_INPUTS_PLANES; k++) {
+        counting |= ABK_inputs_count[k];
+
+        uint32_t next = ABK_inputs_count[k] & carry;
+        ABK_inputs_count[k] = (ABK_inputs_count[k] ^ carry) & delta;
+        carry = next;
+    }
+
+    // Channels whose counter reached their window flip
+    uint32_t flip = delta;
+    for (int k=0; k<ABK_INPUTS_PLANES; k++)
+        flip &= ~(ABK_inputs_count[k] ^ ABK_inputs_window[k]);
+
+    for (int k=0; k<ABK_INPUTS_PLANES; k++)
+        ABK_inputs_count[k] &= ~flip;
+
+    ABK_inputs_state = state ^ flip;
+
+    ABK_inputs_stats.samples++;
+    ABK_inputs_stats.changes += __builtin_popcount(flip);
+    ABK_inputs_stats.glitches += __builtin_popcount(counting & ~delta);
+    ABK_inputs_stats.raw = raw;
+}
+
+void ABK_inputs_init(void) {
+    memset(ABK_inputs_ports, 0, sizeof(ABK_inputs_ports));
+    memset(ABK_inputs_window, 0, sizeof(ABK_inputs_window));
+    memset(ABK_inputs_count, 0, sizeof(ABK_inputs_count));
+    memset(&ABK_inputs_stats, 0, sizeof(ABK_inputs_stats_t));
+    ABK_inputs_polarity = 0;
+
+    LPC_GPIO_TypeDef *ports[ABK_INPUTS_PORTS] = { LPC_GPIO0, LPC_GPIO1, LPC_GPIO2 };
+
+    for (unsigned int i=0; i<ABK_INPUTS_CHANNELS; i++) {
+        const ABK_input_channel_t *channel = &ABK_input_channels[i];
+        gpio_t gpio;
+
+        gpio_init_in(&gpio, channel->pin); // GPIO input, default pull-up as DigitalIn
+
+        ABK_inputs_ports[ABK_PIN_PORT(channel->pin)] = ports[ABK_PIN_PORT(channel->pin)];
+        if (channel->active_low)
+            ABK_inputs_polarity |= channel->flag;
+        for (int k=0; k<ABK_INPUTS_PLANES; k++) {
+            if (channel->window & (1 << k))
+                ABK_inputs_window[k] |= channel->flag;
+        }
+    }
+
+    // Start from the current levels rather than debouncing the power-up state
+    ABK_inputs_state = ABK_inputs_raw();
+    ABK_inputs_stats.raw = ABK_inputs_state;
+
+    ABK_inputs_ticker.attach_us(&ABK_inputs_sample, ABK_INPUT_SAMPLE_US);
+}
+
+uint32_t ABK_inputs_read(void) {
+    return ABK_inputs_state;
+}
+
+void ABK_inputs_get_stats(ABK_inputs_stats_t *stats) {
+    core_util_critical_section_enter();
+    memcpy(stats, &ABK_inputs_stats, sizeof(ABK_inputs_stats_t));
+    core_util_critical_section_exit();
+}
+
+#endif
@@ -0,0 +1,45 @@
+/*
+ * ABKinputs.h
+ * Copyright (C) 2017 Benoit Rapidel <benoit.rapidel+devs@exmachina.fr>
+ *
+ * Distributed under terms of the MIT license.
+ */
+
+#ifndef ABKINPUTS_H
+#define ABKINPUTS_H
+
+#include "config.h"
+
+#include "mbed.h"
+
+#include "ABKcontrol.h"
+
+// Every control input is sampled from a ticker, all ports read at once, and
+// debounced bit-parallel: one vertical counter per input, held as bit planes
+// so a single pass of logic updates all of them together.
+//
+// The snapshot holds the debounced inputs as active-high ABK_INPUT_* flags,
+// axis n at bits n * ABK_INPUTS_AXIS_SHIFT.
+
+#define ABK_INPUTS_AXIS_SHIFT   (8)
+#define ABK_INPUTS_PLANES       (5)     // Counter bits, windows up to 31 samples
+
+typedef struct {
+    uint32_t samples;
+    uint32_t changes;           // Debounced edges
+    uint32_t glitches;          // Raw changes dropped before their window elapsed
+    uint32_t raw;               // Last sample, active-high
+} ABK_inputs_stats_t;
+
+void ABK_inputs_init(void);
+
+// Debounced snapshot, read once per control tick
+uint32_t ABK_inputs_read(void);
+
+inline uint8_t ABK_inputs_axis(uint32_t snapshot, int axis) {
+    return (snapshot >> (axis * ABK_INPUTS_AXIS_SHIFT)) & 0xFF;
+}
+
+void ABK_inputs_get_stats(ABK_inputs_stats_t *stats);
+
+#endif /* !ABKINPUTS_H */
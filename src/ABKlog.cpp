@@ -0,0 +1,203 @@
+/*
+ * ABKlog.cpp
+ * Copyright (C) 2017 Benoit Rapidel <benoit.rapidel+devs@exmachina.fr>
+ *
+ * Distributed under terms of the MIT license.
+ */
+
+#include "ABKlog.h"
+
+#if ABK_HAS_EEPROM
+
+static_assert(ABK_LOG_START >= ABK_EEPROM_CUE_END, "Log ring overlaps the configuration and cue blocks");
+
+typedef struct {
+    bool running;
+    uint32_t start_ms;          // Trigger time of the current run
+    uint8_t error;              // Fault flags seen at the last tick
+    uint32_t error_ms;          // When they were raised
+} ABK_log_track_t;
+
+static AT24CXX_I2C *ABK_log_eeprom;
+static Mutex *ABK_log_mutex;
+static Thread ABK_log_thread(osPriorityBelowNormal, 1024);
+static Semaphore ABK_log_sem(0);
+static Timer ABK_log_uptime;
+
+static ABK_log_track_t ABK_log_tracks[ABK_AXES];
+
+// Filled by the control thread, drained by the log thread
+static ABK_log_record_t ABK_log_queue[ABK_LOG_QUEUE];
+static volatile uint32_t ABK_log_queue_head = 0;
+static volatile uint32_t ABK_log_queue_tail = 0;
+
+static uint32_t ABK_log_head;   // Slot of the next record
+static uint32_t ABK_log_seq;    // Sequence of the next record
+static ABK_log_stats_t ABK_log_stats;
+
+static void ABK_log_push(uint8_t type, uint8_t axis, uint8_t error, uint32_t time, uint32_t duration) {
+    core_util_critical_section_enter();
+    if (ABK_log_queue_head - ABK_log_queue_tail >= ABK_LOG_QUEUE) {
+        ABK_log_stats.dropped++;
+        core_util_critical_section_exit();
+        return;
+    }
+
+    ABK_log_record_t *record = &ABK_log_queue[ABK_log_queue_head % ABK_LOG_QUEUE];
+    record->type = type;
+    record->axis = axis;
+    record->error = error;
+    record->time = time;
+    record->duration = duration;
+    ABK_log_queue_head++;
+    core_util_critical_section_exit();
+
+    ABK_log_sem.release();
+}
+
+static void ABK_log_update_count(void) {
+    ABK_log_stats.count = (ABK_log_seq - 1 < ABK_LOG_SLOTS) ? ABK_log_seq - 1 : ABK_LOG_SLOTS;
+}
+
+// The head search reads every page, the mutex is only held one read at a time
+static bool ABK_log_read(void *ctx, uint32_t address, uint8_t *buf, int len) {
+    ABK_supervisor_checkin(ABK_TASK_LOG);
+
+    ABK_log_mutex->lock();
+    bool ok = ABK_log_eeprom->read(address, buf, len);
+    ABK_log_mutex->unlock();
+
+    return ok;
+}
+
+// Writes the queued records, one page write per page they land in
+static void ABK_log_flush(void) {
+    uint8_t buf[ABK_LOG_PAGE_SIZE];
+
+    while (ABK_log_queue_tail != ABK_log_queue_head) {
+        uint32_t first = ABK_log_head;
+        int len = 0;
+
+        do {
+            ABK_log_record_t record = ABK_log_queue[ABK_log_queue_tail % ABK_LOG_QUEUE];
+            record.seq = ABK_log_seq + len / ABK_LOG_RECORD_SIZE;
+            ABK_log_encode(&buf[len], &record);
+            len += ABK_LOG_RECORD_SIZE;
+
+            core_util_critical_section_enter();
+            ABK_log_queue_tail++;
+            core_util_critical_section_exit();
+        } while (ABK_log_queue_tail != ABK_log_queue_head
+                && (first + len / ABK_LOG_RECORD_SIZE) % ABK_LOG_PER_PAGE != 0);
+
+        // The head moves under the mutex too, ABK_log_get() reads it there
+        ABK_log_mutex->lock();
+        if (ABK_log_eeprom->write(ABK_log_slot_address(first), buf, len)) {
+            ABK_log_head = (first + len / ABK_LOG_RECORD_SIZE) % ABK_LOG_SLOTS;
+            ABK_log_seq += len / ABK_LOG_RECORD_SIZE;
+            ABK_log_update_count();
+        } else {
+            ABK_log_stats.write_errors++; // Records lost, their slots are used again
+        }
+        ABK_log_stats.writes++;
+        ABK_log_mutex->unlock();
+    }
+}
+
+static void ABK_log_task(void) {
+    uint32_t head, seq;
+
+    if (!ABK_log_find_head(&ABK_log_read, NULL, &head, &seq)) {
+        head = 0;
+        seq = 1;
+    }
+
+    ABK_log_mutex->lock();
+    ABK_log_head = head;
+    ABK_log_seq = seq;
+
+    // Some of these may be unreadable (torn write), ABK_log_get() fails on them
+    ABK_log_update_count();
+    ABK_log_stats.ready = true;
+    ABK_log_mutex->unlock();
+
+    while (true) {
+        ABK_supervisor_idle(ABK_TASK_LOG);
+        ABK_log_sem.wait();
+        Thread::wait(ABK_LOG_FLUSH_DELAY); // Let the rest of the run and its faults come in
+        ABK_supervisor_checkin(ABK_TASK_LOG);
+
+        while (ABK_log_sem.wait(0) > 0); // Everything queued so far is written below
+
+        ABK_log_flush();
+    }
+}
+
+void ABK_log_init(AT24CXX_I2C *eeprom, Mutex *eeprom_mutex, bool wdog_reset) {
+    ABK_log_eeprom = eeprom;
+    ABK_log_mutex = eeprom_mutex;
+    memset(ABK_log_tracks, 0, sizeof(ABK_log_tracks));
+    memset(&ABK_log_stats, 0, sizeof(ABK_log_stats_t));
+
+    ABK_log_uptime.start();
+    ABK_log_push(ABK_LOG_BOOT, 0, wdog_reset ? 1 : 0, 0, 0);
+
+    ABK_log_thread.start(ABK_log_task);
+}
+
+void ABK_log_axis(int index, ABK_axis_t *axis) {
+    ABK_log_track_t *track = &ABK_log_tracks[index];
+    uint32_t now = ABK_log_uptime.read_ms();
+    uint8_t error = axis->error & ABK_LOG_FAULTS;
+
+    // Locked axes are being tested (the diag loopback drives the E-stop input), nothing
+    // is recorded until they are released: a fault still active then is logged at that time
+    if (axis->state == ABK_STATE_CALIBRATION)
+        return;
+
+    if (!track->running && axis->state == ABK_STATE_RUN && axis->triggered) {
+        track->running = true;
+        track->start_ms = now - (int32_t) (us_ticker_read() - axis->trigger_time) / 1000;
+    } else if (track->running && axis->state != ABK_STATE_RUN) {
+        track->running = false;
+        ABK_log_push(ABK_LOG_RUN, index, error, track->start_ms, now - track->start_ms);
+    }
+
+    uint8_t raised = error & ~track->error;
+    uint8_t cleared = track->error & ~error;
+
+    if (raised) {
+        ABK_log_push(ABK_LOG_FAULT, index, raised, now, 0);
+        track->error_ms = now;
+    }
+    if (cleared)
+        ABK_log_push(ABK_LOG_CLEAR, index, cleared, now, now - track->error_ms);
+
+    track->error = error;
+}
+
+// Serial thread, takes the EEPROM mutex
+bool ABK_log_get(uint32_t n, ABK_log_record_t *record) {
+    uint8_t buf[ABK_LOG_RECORD_SIZE];
+
+    ABK_log_mutex->lock();
+    if (!ABK_log_stats.ready || n >= ABK_log_stats.count) {
+        ABK_log_mutex->unlock();
+        return false;
+    }
+
+    uint32_t expected = ABK_log_seq - 1 - n;
+    bool ok = ABK_log_eeprom->read(ABK_log_slot_address(ABK_log_slot_before(ABK_log_head, n + 1)),
+            buf, ABK_LOG_RECORD_SIZE);
+    ABK_log_mutex->unlock();
+
+    return ok && ABK_log_decode(buf, record) && record->seq == expected;
+}
+
+void ABK_log_get_stats(ABK_log_stats_t *stats) {
+    core_util_critical_section_enter();
+    memcpy(stats, &ABK_log_stats, sizeof(ABK_log_stats_t));
+    stats->pending = ABK_log_queue_head - ABK_log_queue_tail;
+    core_util_critical_section_exit();
+}
+#endif
@@ -0,0 +1,46 @@
+/*
+ * ABKlog.h
+ * Copyright (C) 2017 Benoit Rapidel <benoit.rapidel+devs@exmachina.fr>
+ *
+ * Distributed under terms of the MIT license.
+ */
+
+#ifndef ABKLOG_H
+#define ABKLOG_H
+
+#include "config.h"
+
+#include "mbed.h"
+
+#include "ABKcontrol.h"
+#include "ABKlogproto.h"
+#include "ABKsupervisor.h"
+
+#include "AT24Cxx_I2C.h"
+
+#define ABK_LOG_QUEUE           (8)     // Records waiting for the log thread
+#define ABK_LOG_FLUSH_DELAY     (1000)  // ms records are held so a run and its faults share a page write
+#define ABK_LOG_DEADLINE        (500)   // Max time in ms the log thread may be busy
+#define ABK_LOG_FAULTS          ABK_ERROR_FAULTS
+
+typedef struct {
+    bool ready;                 // Head found, records can be read
+    uint32_t count;             // Records in the EEPROM
+    uint32_t pending;           // Queued, not written yet
+    uint32_t dropped;           // Lost because the queue was full
+    uint32_t writes;            // Page writes
+    uint32_t write_errors;
+} ABK_log_stats_t;
+
+// Starts the log thread, which owns every log write. EEPROM accesses are
+// serialised with the other users through eeprom_mutex.
+void ABK_log_init(AT24CXX_I2C *eeprom, Mutex *eeprom_mutex, bool wdog_reset);
+
+// Control thread, after every tick: queues records for what changed, no I/O
+void ABK_log_axis(int index, ABK_axis_t *axis);
+
+// n-th newest record in the EEPROM, 0 is the newest
+bool ABK_log_get(uint32_t n, ABK_log_record_t *record);
+void ABK_log_get_stats(ABK_log_stats_t *stats);
+
+#endif /* !ABKLOG_H */
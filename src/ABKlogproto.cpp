@@ -0,0 +1,118 @@
+/*
+ * ABKlogproto.cpp
+ * Copyright (C) 2017 Benoit Rapidel <benoit.rapidel+devs@exmachina.fr>
+ *
+ * Distributed under terms of the MIT license.
+ */
+
+#include "ABKlogproto.h"
+
+#include <string.h>
+
+static void ABK_log_put_u32(uint8_t *buf, uint32_t value) {
+    buf[0] = value & 0xFF;
+    buf[1] = (value >> 8) & 0xFF;
+    buf[2] = (value >> 16) & 0xFF;
+    buf[3] = (value >> 24) & 0xFF;
+}
+
+static uint32_t ABK_log_get_u32(const uint8_t *buf) {
+    return buf[0] | (buf[1] << 8) | (buf[2] << 16) | ((uint32_t) buf[3] << 24);
+}
+
+static uint8_t ABK_log_check(const uint8_t *buf) {
+    uint8_t check = 0xA5;
+
+    for (int i=0; i<ABK_LOG_RECORD_SIZE - 1; i++)
+        check = (check << 1 | check >> 7) ^ buf[i];
+
+    return check;
+}
+
+void ABK_log_encode(uint8_t *buf, const ABK_log_record_t *record) {
+    ABK_log_put_u32(&buf[0], record->seq);
+    ABK_log_put_u32(&buf[4], record->time);
+    ABK_log_put_u32(&buf[8], record->duration);
+    buf[12] = record->type;
+    buf[13] = record->axis;
+    buf[14] = record->error;
+    buf[15] = ABK_log_check(buf);
+}
+
+bool ABK_log_decode(const uint8_t *buf, ABK_log_record_t *record) {
+    memset(record, 0, sizeof(ABK_log_record_t));
+
+    record->seq = ABK_log_get_u32(&buf[0]);
+    if (record->seq == ABK_LOG_SEQ_BLANK || buf[15] != ABK_log_check(buf))
+        return false;
+
+    record->time = ABK_log_get_u32(&buf[4]);
+    record->duration = ABK_log_get_u32(&buf[8]);
+    record->type = buf[12];
+    record->axis = buf[13];
+    record->error = buf[14];
+
+    return record->type >= ABK_LOG_BOOT && record->type < ABK_LOG_TYPE_END;
+}
+
+uint32_t ABK_log_slot_address(uint32_t slot) {
+    return ABK_LOG_START + slot * ABK_LOG_RECORD_SIZE;
+}
+
+uint32_t ABK_log_slot_before(uint32_t slot, uint32_t n) {
+    return (slot + ABK_LOG_SLOTS - (n % ABK_LOG_SLOTS)) % ABK_LOG_SLOTS;
+}
+
+// Pages are filled in order, so the first record of each page is enough to
+// find the newest page, and the head is right after its last valid record.
+bool ABK_log_find_head(ABK_log_read_t read, void *ctx, uint32_t *head, uint32_t *next_seq) {
+    uint8_t buf[ABK_LOG_PAGE_SIZE];
+    ABK_log_record_t record;
+    bool found = false;
+    uint32_t newest_page = 0, newest_seq = 0;
+
+    for (uint32_t page=0; page<ABK_LOG_SLOTS / ABK_LOG_PER_PAGE; page++) {
+        if (!read(ctx, ABK_log_slot_address(page * ABK_LOG_PER_PAGE), buf, ABK_LOG_RECORD_SIZE))
+            return false;
+
+        if (ABK_log_decode(buf, &record) && (!found || record.seq > newest_seq)) {
+            found = true;
+            newest_page = page;
+            newest_seq = record.seq;
+        }
+    }
+
+    *head = 0;
+    *next_seq = 1;
+    if (!found)
+        return true;
+
+    if (!read(ctx, ABK_log_slot_address(newest_page * ABK_LOG_PER_PAGE), buf, ABK_LOG_PAGE_SIZE))
+        return false;
+
+    int last = 0;
+    for (int i=1; i<ABK_LOG_PER_PAGE; i++) {
+        if (!ABK_log_decode(&buf[i * ABK_LOG_RECORD_SIZE], &record) || record.seq != newest_seq + i)
+            break;
+        last = i;
+    }
+
+    *head = (newest_page * ABK_LOG_PER_PAGE + last + 1) % ABK_LOG_SLOTS;
+    *next_seq = newest_seq + last + 1;
+    return true;
+}
+
+const char *ABK_log_type_name(int type) {
+    switch (type) {
+        case ABK_LOG_BOOT:
+            return "boot";
+        case ABK_LOG_RUN:
+            return "run";
+        case ABK_LOG_FAULT:
+            return "fault";
+        case ABK_LOG_CLEAR:
+            return "clear";
+        default:
+            return "unknown";
+    }
+}
@@ -0,0 +1,63 @@
+/*
+ * ABKlogproto.h
+ * Copyright (C) 2017 Benoit Rapidel <benoit.rapidel+devs@exmachina.fr>
+ *
+ * Distributed under terms of the MIT license.
+ */
+
+#ifndef ABKLOGPROTO_H
+#define ABKLOGPROTO_H
+
+// Black-box run and fault log. Kept free of mbed dependencies so tools/abkctl
+// decodes EEPROM images with the exact same code.
+//
+// Records are fixed-size and appended to a ring that fills the EEPROM after
+// the configuration block. Every record carries a sequence number: the newest
+// one is found again at boot, so successive writes walk the whole ring and
+// wear every page evenly. A record that fails its check (blank, torn write)
+// ends the log.
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define ABK_LOG_EEPROM_SIZE     (32768)     // AT24C256
+#define ABK_LOG_PAGE_SIZE       (64)        // Bytes written by a single page write
+#define ABK_LOG_START           (512)       // First page after the configuration and cue blocks
+#define ABK_LOG_RECORD_SIZE     (16)
+#define ABK_LOG_PER_PAGE        (ABK_LOG_PAGE_SIZE / ABK_LOG_RECORD_SIZE)
+#define ABK_LOG_SLOTS           ((ABK_LOG_EEPROM_SIZE - ABK_LOG_START) / ABK_LOG_RECORD_SIZE)
+
+#define ABK_LOG_SEQ_BLANK       (0xFFFFFFFF)
+
+typedef enum {
+    ABK_LOG_BOOT = 1,           // error: 1 after a watchdog reset
+    ABK_LOG_RUN,                // time: trigger, duration: until stopped, error: flags that aborted it
+    ABK_LOG_FAULT,              // error: flags raised
+    ABK_LOG_CLEAR,              // error: flags cleared, duration: how long they were raised
+    ABK_LOG_TYPE_END
+} ABK_log_type_t;
+
+typedef struct {
+    uint32_t seq;
+    uint32_t time;              // ms since boot
+    uint32_t duration;          // ms
+    uint8_t type;
+    uint8_t axis;
+    uint8_t error;              // ABK_ERROR_* flags
+} ABK_log_record_t;
+
+// Reads len bytes of the EEPROM at address
+typedef bool (*ABK_log_read_t)(void *ctx, uint32_t address, uint8_t *buf, int len);
+
+void ABK_log_encode(uint8_t *buf, const ABK_log_record_t *record);
+bool ABK_log_decode(const uint8_t *buf, ABK_log_record_t *record);
+
+uint32_t ABK_log_slot_address(uint32_t slot);
+uint32_t ABK_log_slot_before(uint32_t slot, uint32_t n);
+
+// Slot the next record goes to and its sequence number
+bool ABK_log_find_head(ABK_log_read_t read, void *ctx, uint32_t *head, uint32_t *next_seq);
+
+const char *ABK_log_type_name(int type);
+
+#endif /* !ABKLOGPROTO_H */
@@ -0,0 +1,183 @@
+/*
+ * ABKserial.cpp
+ * Copyright (C) 2017 Benoit Rapidel <benoit.rapidel+devs@exmachina.fr>
+ *
+ * Distributed under terms of the MIT license.
+ */
+
+#include "ABKserial.h"
+
+#include <stdarg.h>
+
+#if ABK_HAS_USBSERIAL
+#include "USBSerial.h"
+extern USBSerial USBport;
+#else
+extern Serial USBport;
+#endif
+
+static void ABK_serial_tx_task(void);
+
+static char ABK_serial_tx_buffer[ABK_SERIAL_TX_BUFFER_SIZE];
+static volatile uint32_t ABK_serial_tx_head = 0;    // Next byte to write
+static volatile uint32_t ABK_serial_tx_tail = 0;    // Next byte to send
+static volatile uint32_t ABK_serial_tx_fill = 0;
+
+static ABK_serial_tx_stats_t ABK_serial_tx_stats;
+
+static Mutex ABK_serial_tx_mutex;           // Keeps each write contiguous in the buffer
+static Semaphore ABK_serial_tx_data_sem(0); // Released when data is queued
+static Semaphore ABK_serial_tx_space_sem(0);// Released when space is freed for a waiting writer
+static volatile bool ABK_serial_tx_waiting = false; // A writer found the buffer full
+
+static Thread ABK_serial_tx_thread(osPriorityNormal, 1024);
+
+void ABK_serial_tx_start(void) {
+    memset(&ABK_serial_tx_stats, 0, sizeof(ABK_serial_tx_stats_t));
+    ABK_serial_tx_thread.start(ABK_serial_tx_task);
+}
+
+void ABK_serial_tx_get_stats(ABK_serial_tx_stats_t *stats) {
+    core_util_critical_section_enter();
+    memcpy(stats, &ABK_serial_tx_stats, sizeof(ABK_serial_tx_stats_t));
+    core_util_critical_section_exit();
+}
+
+// Copy as much of buf as fits, returns the number of bytes queued
+static int ABK_serial_tx_push(const char *buf, int len) {
+    int n = 0;
+
+    core_util_critical_section_enter();
+    while (n < len) {
+        if (ABK_serial_tx_fill == ABK_SERIAL_TX_BUFFER_SIZE) {
+#if ABK_SERIAL_TX_DROP_OLDEST
+            ABK_serial_tx_tail = (ABK_serial_tx_tail + 1) % ABK_SERIAL_TX_BUFFER_SIZE;
+            ABK_serial_tx_fill--;
+            ABK_serial_tx_stats.bytes_dropped++;
+#else
+            ABK_serial_tx_waiting = true; // Set with the full buffer seen, no wake-up is missed
+            break;
+#endif
+        }
+
+        ABK_serial_tx_buffer[ABK_serial_tx_head] = buf[n++];
+        ABK_serial_tx_head = (ABK_serial_tx_head + 1) % ABK_SERIAL_TX_BUFFER_SIZE;
+        ABK_serial_tx_fill++;
+    }
+
+    if (ABK_serial_tx_fill > ABK_serial_tx_stats.max_fill)
+        ABK_serial_tx_stats.max_fill = ABK_serial_tx_fill;
+    core_util_critical_section_exit();
+
+    return n;
+}
+
+// Copy at most one packet out of the buffer, wakes a writer waiting for space.
+// Only signalled when one waits: stale tokens would make the next writer spin.
+static int ABK_serial_tx_pop(char *packet) {
+    int n = 0;
+    bool wake = false;
+
+    core_util_critical_section_enter();
+    while (n < ABK_SERIAL_TX_PACKET_SIZE && ABK_serial_tx_fill > 0) {
+        packet[n++] = ABK_serial_tx_buffer[ABK_serial_tx_tail];
+        ABK_serial_tx_tail = (ABK_serial_tx_tail + 1) % ABK_SERIAL_TX_BUFFER_SIZE;
+        ABK_serial_tx_fill--;
+    }
+    if (n > 0 && ABK_serial_tx_waiting) {
+        ABK_serial_tx_waiting = false;
+        wake = true;
+    }
+    core_util_critical_section_exit();
+
+    if (wake)
+        ABK_serial_tx_space_sem.release();
+
+    return n;
+}
+
+int ABK_serial_write(const char *buf, int len) {
+    int queued = 0;
+    uint32_t start = us_ticker_read();
+
+    ABK_serial_tx_mutex.lock();
+
+    while (true) {
+        queued += ABK_serial_tx_push(buf + queued, len - queued);
+        ABK_serial_tx_data_sem.release();
+
+        if (queued >= len)
+            break;
+
+        // Back-pressure: wait for the writer to free some space, but never longer than the timeout
+        int elapsed = (us_ticker_read() - start) / 1000;
+        if (elapsed >= ABK_SERIAL_TX_TIMEOUT
+                || ABK_serial_tx_space_sem.wait(ABK_SERIAL_TX_TIMEOUT - elapsed) <= 0) {
+            core_util_critical_section_enter();
+            ABK_serial_tx_waiting = false;
+            ABK_serial_tx_stats.overflows++;
+            ABK_serial_tx_stats.bytes_dropped += len - queued;
+            core_util_critical_section_exit();
+            break;
+        }
+    }
+
+    ABK_serial_tx_mutex.unlock();
+
+    return queued;
+}
+
+int ABK_serial_puts(const char *str) {
+    return ABK_serial_write(str, strlen(str));
+}
+
+int ABK_serial_putc(int c) {
+    char ch = (char) c;
+    return ABK_serial_write(&ch, 1);
+}
+
+int ABK_serial_printf(const char *format, ...) {
+    char line[ABK_SERIAL_TX_FORMAT_SIZE];
+    va_list args;
+
+    va_start(args, format);
+    int len = vsnprintf(line, ABK_SERIAL_TX_FORMAT_SIZE, format, args);
+    va_end(args);
+
+    if (len < 0)
+        return len;
+    if (len >= ABK_SERIAL_TX_FORMAT_SIZE)
+        len = ABK_SERIAL_TX_FORMAT_SIZE - 1;
+
+    return ABK_serial_write(line, len);
+}
+
+static void ABK_serial_tx_task(void) {
+    char packet[ABK_SERIAL_TX_PACKET_SIZE];
+    int len;
+
+    while (true) {
+        ABK_serial_tx_data_sem.wait();
+
+        // Give the producer a chance to complete a full packet
+        if (ABK_serial_tx_fill < ABK_SERIAL_TX_PACKET_SIZE)
+            Thread::wait(ABK_SERIAL_TX_COALESCE);
+
+        while ((len = ABK_serial_tx_pop(packet)) > 0) {
+#if ABK_HAS_USBSERIAL
+            bool sent = USBport.writeBlock((uint8_t *) packet, len);
+#else
+            bool sent = true;
+            for (int i=0; i<len; i++)
+                USBport.putc(packet[i]);
+#endif
+
+            core_util_critical_section_enter();
+            if (sent)
+                ABK_serial_tx_stats.bytes_written += len;
+            else
+                ABK_serial_tx_stats.bytes_dropped += len;
+            core_util_critical_section_exit();
+        }
+    }
+}
@@ -0,0 +1,34 @@
+/*
+ * ABKserial.h
+ * Copyright (C) 2017 Benoit Rapidel <benoit.rapidel+devs@exmachina.fr>
+ *
+ * Distributed under terms of the MIT license.
+ */
+
+#ifndef ABKSERIAL_H
+#define ABKSERIAL_H
+
+#include "config.h"
+
+#include "mbed.h"
+
+#define ABK_SERIAL_TX_PACKET_SIZE   (64)    // USB CDC bulk endpoint size
+#define ABK_SERIAL_TX_FORMAT_SIZE   (128)   // Longest line produced by ABK_serial_printf
+
+typedef struct {
+    uint32_t bytes_written;     // Bytes handed to the port
+    uint32_t bytes_dropped;     // Bytes lost to overflow or port errors
+    uint32_t overflows;         // Number of writes that didn't fit in time
+    uint32_t max_fill;          // Highest buffer fill level seen
+} ABK_serial_tx_stats_t;
+
+void ABK_serial_tx_start(void);
+void ABK_serial_tx_get_stats(ABK_serial_tx_stats_t *stats);
+
+// All writers are non-blocking past ABK_SERIAL_TX_TIMEOUT and return the number of bytes queued
+int ABK_serial_write(const char *buf, int len);
+int ABK_serial_puts(const char *str);
+int ABK_serial_putc(int c);
+int ABK_serial_printf(const char *format, ...);
+
+#endif /* !ABKSERIAL_H */
@@ -0,0 +1,138 @@
+/*
+ * ABKsupervisor.cpp
+ * Copyright (C) 2017 Benoit Rapidel <benoit.rapidel+devs@exmachina.fr>
+ *
+ * Distributed under terms of the MIT license.
+ */
+
+#include "ABKsupervisor.h"
+
+typedef struct {
+    bool registered;
+    bool idle;                  // Blocked on an event, not expected to check in
+    bool late;                  // Current overrun already counted
+    uint32_t deadline_us;
+    uint32_t last_checkin;      // us_ticker timestamp
+} ABK_task_state_t;
+
+ABK_health_record_t ABK_health ABK_NOINIT;
+
+static ABK_task_state_t ABK_tasks[ABK_TASK_COUNT];
+
+static uint32_t ABK_supervisor_checksum(void) {
+    uint32_t sum = 0;
+    uint32_t *words = (uint32_t *) &ABK_health;
+
+    for (unsigned int i=0; i<(offsetof(ABK_health_record_t, checksum) / sizeof(uint32_t)); i++)
+        sum = (sum << 1 | sum >> 31) ^ words[i];
+
+    return sum;
+}
+
+void ABK_supervisor_init(bool wdog_reset) {
+    if (ABK_health.magic != ABK_HEALTH_MAGIC || ABK_health.checksum != ABK_supervisor_checksum()) {
+        memset(&ABK_health, 0, sizeof(ABK_health_record_t));
+        ABK_health.magic = ABK_HEALTH_MAGIC;
+        ABK_health.last_culprit = ABK_TASK_COUNT;
+    }
+
+    if (wdog_reset)
+        ABK_health.wdog_resets++;
+
+    ABK_health.checksum = ABK_supervisor_checksum();
+
+    memset(ABK_tasks, 0, sizeof(ABK_tasks));
+}
+
+void ABK_supervisor_register(ABK_task_id_t task, uint32_t deadline_ms) {
+    core_util_critical_section_enter();
+    ABK_tasks[task].deadline_us = deadline_ms * 1000;
+    ABK_tasks[task].last_checkin = us_ticker_read();
+    ABK_tasks[task].idle = false;
+    ABK_tasks[task].late = false;
+    ABK_tasks[task].registered = true;
+    core_util_critical_section_exit();
+}
+
+// Account lateness of a task, must be called inside a critical section
+static void ABK_supervisor_update(ABK_task_id_t task, uint32_t now) {
+    ABK_task_state_t *t = &ABK_tasks[task];
+    uint32_t elapsed = now - t->last_checkin;
+
+    if (elapsed <= t->deadline_us)
+        return;
+
+    uint32_t late_ms = (elapsed - t->deadline_us) / 1000;
+
+    if (!t->late) {
+        t->late = true;
+        ABK_health.tasks[task].missed++;
+    }
+    if (late_ms > ABK_health.tasks[task].worst_late_ms)
+        ABK_health.tasks[task].worst_late_ms = late_ms;
+
+    ABK_health.checksum = ABK_supervisor_checksum();
+}
+
+void ABK_supervisor_checkin(ABK_task_id_t task) {
+    uint32_t now = us_ticker_read();
+
+    core_util_critical_section_enter();
+    if (!ABK_tasks[task].idle)
+        ABK_supervisor_update(task, now);
+    ABK_tasks[task].last_checkin = now;
+    ABK_tasks[task].idle = false;
+    ABK_tasks[task].late = false;
+    core_util_critical_section_exit();
+}
+
+void ABK_supervisor_idle(ABK_task_id_t task) {
+    core_util_critical_section_enter();
+    ABK_tasks[task].idle = true;
+    core_util_critical_section_exit();
+}
+
+// Returns true if every registered task met its deadline: only then the watchdog should be fed
+bool ABK_supervisor_check(void) {
+    bool healthy = true;
+    uint32_t now = us_ticker_read();
+
+    core_util_critical_section_enter();
+    for (int i=0; i<ABK_TASK_COUNT; i++) {
+        if (!ABK_tasks[i].registered || ABK_tasks[i].idle)
+            continue;
+
+        ABK_supervisor_update((ABK_task_id_t) i, now);
+
+        if (ABK_tasks[i].late) {
+            healthy = false;
+            ABK_health.last_culprit = i;
+            ABK_health.checksum = ABK_supervisor_checksum();
+        }
+    }
+    core_util_critical_section_exit();
+
+    return healthy;
+}
+
+void ABK_supervisor_clear(void) {
+    core_util_critical_section_enter();
+    memset(&ABK_health, 0, sizeof(ABK_health_record_t));
+    ABK_health.magic = ABK_HEALTH_MAGIC;
+    ABK_health.last_culprit = ABK_TASK_COUNT;
+    ABK_health.checksum = ABK_supervisor_checksum();
+    core_util_critical_section_exit();
+}
+
+const char *ABK_supervisor_task_name(uint32_t task) {
+    switch (task) {
+        case ABK_TASK_APP:
+            return "app";
+        case ABK_TASK_SERIAL:
+            return "serial";
+        case ABK_TASK_LOG:
+            return "log";
+        default:
+            return "none";
+    }
+}
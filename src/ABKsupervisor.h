@@ -0,0 +1,51 @@
+/*
+ * ABKsupervisor.h
+ * Copyright (C) 2017 Benoit Rapidel <benoit.rapidel+devs@exmachina.fr>
+ *
+ * Distributed under terms of the MIT license.
+ */
+
+#ifndef ABKSUPERVISOR_H
+#define ABKSUPERVISOR_H
+
+#include "config.h"
+
+#include "mbed.h"
+
+// Not zeroed by the startup code: the content survives a watchdog or software reset
+#define ABK_NOINIT                  __attribute__((section("AHBSRAM0")))
+
+#define ABK_HEALTH_MAGIC            (0x41424B48)    // "ABKH"
+
+typedef enum {
+    ABK_TASK_APP = 0,
+    ABK_TASK_SERIAL,
+    ABK_TASK_LOG,
+    ABK_TASK_COUNT
+} ABK_task_id_t;
+
+typedef struct {
+    uint32_t missed;            // Number of deadline misses
+    uint32_t worst_late_ms;     // Worst lateness past the deadline
+} ABK_task_health_t;
+
+typedef struct {
+    uint32_t magic;
+    uint32_t wdog_resets;       // Resets caused by the hardware watchdog
+    uint32_t last_culprit;      // Task late when the watchdog stopped being fed
+    ABK_task_health_t tasks[ABK_TASK_COUNT];
+    uint32_t checksum;
+} ABK_health_record_t;
+
+extern ABK_health_record_t ABK_health;
+
+void ABK_supervisor_init(bool wdog_reset);
+void ABK_supervisor_register(ABK_task_id_t task, uint32_t deadline_ms);
+void ABK_supervisor_checkin(ABK_task_id_t task);
+void ABK_supervisor_idle(ABK_task_id_t task);
+bool ABK_supervisor_check(void);
+void ABK_supervisor_clear(void);
+
+const char *ABK_supervisor_task_name(uint32_t task);
+
+#endif /* !ABKSUPERVISOR_H */
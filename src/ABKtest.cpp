@@ -0,0 +1,69 @@
+/*
+ * ABKtest.cpp
+ * Copyright (C) 2017 Benoit Rapidel <benoit.rapidel+devs@exmachina.fr>
+ *
+ * Distributed under terms of the MIT license.
+ */
+
+#include "ABKtest.h"
+
+#include "pins.h"
+
+#if ABK_TEST
+void ABK_io_test(Watchdog *wdog) {
+    DigitalOut output1_1(OUTPUT1_1);
+    DigitalOut output1_2(OUTPUT1_2);
+    DigitalOut output1_3(OUTPUT1_3);
+    DigitalOut output1_4(OUTPUT1_4);
+
+    DigitalOut output2_1(OUTPUT2_1);
+    DigitalOut output2_2(OUTPUT2_2);
+    DigitalOut output2_3(OUTPUT2_3);
+    DigitalOut output2_4(OUTPUT2_4);
+
+    uint16_t period = 0;
+    while (true) {
+        led1 = (period % 2 == 0) ? true : false;
+        led2 = (period % 4 == 0) ? true : false;
+
+        output1_1 = !output1_1;
+        output1_2 = !output1_2;
+        output1_3 = !output1_3;
+        output1_4 = !output1_4;
+
+        output2_1 = !output2_1;
+        output2_2 = !output2_2;
+        output2_3 = !output2_3;
+        output2_4 = !output2_4;
+
+        period++;
+        Thread::wait(2000);
+
+        wdog->kick();
+    }
+}
+#endif
+
+#if ABK_MOTOR_TEST
+void ABK_motor_test(ABK_axis_t *axis, Watchdog *wdog) {
+    for (int i=0; i<100; i++) {
+        ABK_set_drum_mode(axis, ABK_DRUM_FREEWHEEL);
+        ABK_set_speed(axis, i);
+        ABK_set_motor_mode(axis, ABK_MOTOR_FW);
+        Thread::wait(200);
+
+        wdog->kick();
+    }
+
+    for (int i=100; i>0; i--) {
+        ABK_set_drum_mode(axis, ABK_DRUM_FREEWHEEL);
+        ABK_set_speed(axis, i);
+        ABK_set_motor_mode(axis, ABK_MOTOR_FW);
+        Thread::wait(200);
+
+        wdog->kick();
+    }
+
+    ABK_set_motor_mode(axis, ABK_MOTOR_DISABLED);
+}
+#endif
@@ -0,0 +1,31 @@
+/*
+ * ABKtest.h
+ * Copyright (C) 2017 Benoit Rapidel <benoit.rapidel+devs@exmachina.fr>
+ *
+ * Distributed under terms of the MIT license.
+ */
+
+#ifndef ABKTEST_H
+#define ABKTEST_H
+
+#include "config.h"
+
+#include "mbed.h"
+
+#include "watchdog.h"
+
+#include "ABKcontrol.h"
+
+// Bench images, each one only exists in its own variant
+
+#if ABK_TEST
+// Toggles every output every 2s, never returns
+void ABK_io_test(Watchdog *wdog);
+#endif
+
+#if ABK_MOTOR_TEST
+// Ramps the motor of the axis up to full speed and back down, then disables it
+void ABK_motor_test(ABK_axis_t *axis, Watchdog *wdog);
+#endif
+
+#endif /* !ABKTEST_H */
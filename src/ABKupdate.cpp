@@ -0,0 +1,190 @@
+/*
+ * ABKupdate.cpp
+ * Copyright (C) 2017 Benoit Rapidel <benoit.rapidel+devs@exmachina.fr>
+ *
+ * Distributed under terms of the MIT license.
+ */
+
+#include "ABKupdate.h"
+
+#include "ABKiap.h"
+
+#if ABK_HAS_CONTROL
+
+#define ABK_UPDATE_SECTOR_SIZE  (0x8000)        // Every staging sector
+
+static bool ABK_update_active = false;
+static ABK_upd_header_t ABK_update_header;
+static ABK_upd_decoder_t ABK_update_decoder;
+static ABK_update_progress_t ABK_update_progress;
+
+static ABK_axis_t *ABK_update_axes;
+static int ABK_update_count;
+static ABK_state_t ABK_update_saved[ABK_AXES];
+static ABK_task_id_t ABK_update_task;           // Serial task, a frame can decode a whole image
+
+// Decoded bytes wait here for a whole write block
+static uint8_t ABK_update_block[ABK_IAP_BLOCK_SIZE] __attribute__((aligned(4)));
+static uint32_t ABK_update_fill;
+static uint32_t ABK_update_flushed;             // Image bytes already in flash
+
+static uint8_t ABK_update_read_base(void *ctx, uint32_t offset) {
+    return *ABK_iap_map(ABK_UPD_APP_START + offset);
+}
+
+static uint8_t ABK_update_read_image(void *ctx, uint32_t offset) {
+    if (offset >= ABK_update_flushed)
+        return ABK_update_block[offset - ABK_update_flushed];
+
+    return *ABK_iap_map(ABK_UPD_STAGING_START + offset);
+}
+
+static bool ABK_update_flush(void) {
+    if (ABK_update_fill == 0)
+        return true;
+
+    ABK_supervisor_checkin(ABK_update_task);
+
+    memset(ABK_update_block + ABK_update_fill, 0xFF, ABK_IAP_BLOCK_SIZE - ABK_update_fill);
+    if (!ABK_iap_write(ABK_UPD_STAGING_START + ABK_update_flushed, ABK_update_block))
+        return false;
+
+    ABK_update_flushed += ABK_update_fill;
+    ABK_update_fill = 0;
+    return true;
+}
+
+static bool ABK_update_write_byte(void *ctx, uint8_t byte) {
+    ABK_update_block[ABK_update_fill++] = byte;
+
+    return (ABK_update_fill < ABK_IAP_BLOCK_SIZE) || ABK_update_flush();
+}
+
+static void ABK_update_release(void) {
+    ABK_axes_unlock(ABK_update_axes, ABK_update_count, ABK_update_saved);
+    ABK_update_active = false;
+}
+
+ABK_upd_status_t ABK_update_begin(const uint8_t header[ABK_UPD_HEADER_SIZE], ABK_axis_t *axes, int count,
+        ABK_task_id_t task) {
+    ABK_upd_header_t *hdr = &ABK_update_header;
+
+    if (!ABK_upd_decode_header(header, hdr))
+        return ABK_UPD_BAD_HEADER;
+
+    if (hdr->image_size == 0 || hdr->image_size > ABK_UPD_SLOT_SIZE || hdr->base_size > ABK_UPD_SLOT_SIZE)
+        return ABK_UPD_TOO_BIG;
+
+    if (hdr->base_size > 0
+            && ABK_upd_crc32(0, ABK_iap_map(ABK_UPD_APP_START), hdr->base_size) != hdr->base_crc)
+        return ABK_UPD_BASE_MISMATCH;
+
+    if (!ABK_axes_lock(axes, count, ABK_update_saved))
+        return ABK_UPD_BUSY;
+
+    ABK_update_axes = axes;
+    ABK_update_count = count;
+    ABK_update_task = task;
+    ABK_update_active = true;
+    memset(&ABK_update_progress, 0, sizeof(ABK_update_progress_t));
+
+    // One 32KB sector at a time, each one blocks the interrupts for ~100ms. That is past the
+    // app deadline, so the control loop (its axes are locked) isn't expected to check in across it.
+    uint32_t start = us_ticker_read();
+    for (uint32_t offset=0; offset<hdr->image_size; offset+=ABK_UPDATE_SECTOR_SIZE) {
+        ABK_supervisor_checkin(task);
+        ABK_supervisor_idle(ABK_TASK_APP);
+        if (!ABK_iap_erase(ABK_UPD_STAGING_START + offset, ABK_UPD_STAGING_START + offset + ABK_UPDATE_SECTOR_SIZE)) {
+            ABK_update_release();
+            return ABK_UPD_FLASH;
+        }
+    }
+    ABK_update_progress.erase_ms = (us_ticker_read() - start) / 1000;
+
+    ABK_update_fill = 0;
+    ABK_update_flushed = 0;
+    ABK_upd_decoder_init(&ABK_update_decoder, hdr, &ABK_update_read_base, &ABK_update_read_image,
+            &ABK_update_write_byte, NULL);
+
+    return ABK_UPD_OK;
+}
+
+ABK_upd_status_t ABK_update_write(const uint8_t *buf, uint32_t len) {
+    if (!ABK_update_active)
+        return ABK_UPD_BAD_HEADER;
+
+    if (len > ABK_update_header.payload_size - ABK_update_progress.payload) {
+        ABK_update_release();
+        return ABK_UPD_CORRUPT;
+    }
+
+    ABK_upd_status_t ret = ABK_upd_decode(&ABK_update_decoder, buf, len);
+    ABK_update_progress.payload += len;
+    ABK_update_progress.image = ABK_update_decoder.written;
+
+    if (ret != ABK_UPD_OK)
+        ABK_update_release();
+
+    return ret;
+}
+
+bool ABK_update_complete(void) {
+    return ABK_update_active && ABK_update_progress.payload == ABK_update_header.payload_size;
+}
+
+// The record is the switch: it is only written once the staged image reads back right
+ABK_upd_status_t ABK_update_finish(void) {
+    static uint8_t record[ABK_IAP_BLOCK_SIZE] __attribute__((aligned(4)));
+    ABK_upd_status_t ret;
+    ABK_upd_record_t rec;
+
+    if (!ABK_update_active)
+        return ABK_UPD_BAD_HEADER;
+
+    ret = ABK_upd_decoder_finish(&ABK_update_decoder, &ABK_update_header);
+    if (ret == ABK_UPD_OK && !ABK_update_flush())
+        ret = ABK_UPD_FLASH;
+
+    if (ret == ABK_UPD_OK && ABK_upd_crc32(0, ABK_iap_map(ABK_UPD_STAGING_START), ABK_update_header.image_size)
+            != ABK_update_header.image_crc)
+        ret = ABK_UPD_CRC;
+
+    if (ret == ABK_UPD_OK) {
+        rec.image_size = ABK_update_header.image_size;
+        rec.image_crc = ABK_update_header.image_crc;
+
+        memset(record, 0xFF, sizeof(record));
+        ABK_upd_encode_record(record, &rec);
+
+        if (!ABK_iap_erase(ABK_UPD_RECORD_ADDRESS, ABK_UPD_RECORD_ADDRESS + 1)
+                || !ABK_iap_write(ABK_UPD_RECORD_ADDRESS, record))
+            ret = ABK_UPD_FLASH;
+    }
+
+    ABK_update_release();
+    return ret;
+}
+
+void ABK_update_abort(void) {
+    if (ABK_update_active)
+        ABK_update_release();
+}
+
+void ABK_update_get_progress(ABK_update_progress_t *progress) {
+    memcpy(progress, &ABK_update_progress, sizeof(ABK_update_progress_t));
+}
+
+void ABK_update_get_info(ABK_update_info_t *info) {
+    const uint8_t *done = ABK_iap_map(ABK_UPD_RECORD_ADDRESS + ABK_UPD_DONE_OFFSET);
+
+    memset(info, 0, sizeof(ABK_update_info_t));
+    info->staged = ABK_upd_decode_record(ABK_iap_map(ABK_UPD_RECORD_ADDRESS), &info->record);
+
+    // Any programmed byte, the bootloader only marks images it checked
+    for (int i=0; i<ABK_UPD_RECORD_SIZE && info->staged; i++) {
+        if (done[i] != 0xFF)
+            info->installed = true;
+    }
+}
+
+#endif
@@ -0,0 +1,50 @@
+/*
+ * ABKupdate.h
+ * Copyright (C) 2017 Benoit Rapidel <benoit.rapidel+devs@exmachina.fr>
+ *
+ * Distributed under terms of the MIT license.
+ */
+
+#ifndef ABKUPDATE_H
+#define ABKUPDATE_H
+
+#include "config.h"
+
+#include "mbed.h"
+
+#include "ABKcontrol.h"
+#include "ABKsupervisor.h"
+#include "ABKupdproto.h"
+
+// Receives an update image into the staging slot (see ABKupdproto.h) while
+// every axis is held out of the control loop. Nothing changes for the running
+// firmware until the record is written, the bootloader switches at the next reset.
+
+#define ABK_UPDATE_RX_TIMEOUT   (2000)  // ms without a frame before the transfer is dropped
+
+typedef struct {
+    bool staged;                // Record written, installed at the next reset
+    bool installed;             // Done mark of the bootloader
+    ABK_upd_record_t record;
+} ABK_update_info_t;
+
+typedef struct {
+    uint32_t payload;           // Bytes received
+    uint32_t image;             // Bytes decoded to flash
+    uint32_t erase_ms;
+} ABK_update_progress_t;
+
+// Checks the header against the running image, locks the axes and erases staging.
+// Only a running axis refuses: unconfigured or faulted (E-stop) units can be updated.
+ABK_upd_status_t ABK_update_begin(const uint8_t header[ABK_UPD_HEADER_SIZE], ABK_axis_t *axes, int count,
+        ABK_task_id_t task);
+ABK_upd_status_t ABK_update_write(const uint8_t *buf, uint32_t len);
+// Whole payload in: checks the staged image and writes the record
+ABK_upd_status_t ABK_update_finish(void);
+void ABK_update_abort(void);
+
+bool ABK_update_complete(void);  // Every payload byte received
+void ABK_update_get_progress(ABK_update_progress_t *progress);
+void ABK_update_get_info(ABK_update_info_t *info);
+
+#endif /* !ABKUPDATE_H */
@@ -0,0 +1,31 @@
+/*
+ * ABKvariant.h
+ * Copyright (C) 2017 Benoit Rapidel <benoit.rapidel+devs@exmachina.fr>
+ *
+ * Distributed under terms of the MIT license.
+ */
+
+#ifndef ABKVARIANT_H
+#define ABKVARIANT_H
+
+#include "config.h"
+
+// Checks on the variant being built. Features are selected by the
+// preprocessor switches of config.h alone: the test variants leave out
+// objects (threads, EEPROM, CAN) that the control image defines, so code
+// using them can't be kept behind a plain constant branch.
+static_assert(ABK_VARIANT >= ABK_VARIANT_PRODUCTION && ABK_VARIANT <= ABK_VARIANT_MOTOR_TEST, "Unknown ABK_VARIANT");
+static_assert(ABK_AXES >= 1 && ABK_AXES <= 2, "ABK_AXES must be 1 or 2");
+static_assert(!ABK_HAS_CAN || ABK_HAS_EEPROM, "CAN needs the EEPROM for its node id");
+
+#if ABK_SIMULATE
+#define ABK_VARIANT_NAME    "simulate"
+#elif ABK_TEST
+#define ABK_VARIANT_NAME    "io_test"
+#elif ABK_MOTOR_TEST
+#define ABK_VARIANT_NAME    "motor_test"
+#else
+#define ABK_VARIANT_NAME    "production"
+#endif
+
+#endif /* !ABKVARIANT_H */
@@ -8,17 +8,60 @@
 #ifndef CONFIG_H
 #define CONFIG_H
 
-#define ABK_VERSION         "v2.0"
-#define ABK_HAS_LCD         0
-#define ABK_HAS_EEPROM      1
-#define ABK_HAS_USBSERIAL   1
+#define ABK_VERSION         "v2.1"
+
+// Build variants, each one is its own image (variants/*.json, tools/build_variants.py)
+#define ABK_VARIANT_PRODUCTION  0
+#define ABK_VARIANT_SIMULATE    1   // Forced config and periodic trigger, no inputs needed
+#define ABK_VARIANT_IO_TEST     2   // Toggles every output
+#define ABK_VARIANT_MOTOR_TEST  3   // Ramps the VFD output of axis 0 up and down
+
+#ifndef ABK_VARIANT
+#define ABK_VARIANT         ABK_VARIANT_PRODUCTION
+#endif
 
-#define ABK_SIMULATE        0
-#define ABK_TEST            0
-#define ABK_MOTOR_TEST      0
+// Features follow from the variant, ABKvariant.h checks them
+#define ABK_SIMULATE        (ABK_VARIANT == ABK_VARIANT_SIMULATE)
+#define ABK_TEST            (ABK_VARIANT == ABK_VARIANT_IO_TEST)
+#define ABK_MOTOR_TEST      (ABK_VARIANT == ABK_VARIANT_MOTOR_TEST)
+#define ABK_HAS_CONTROL     (!ABK_TEST && !ABK_MOTOR_TEST)  // Control loop, console, supervisor
+#define ABK_HAS_EEPROM      ABK_HAS_CONTROL
+#define ABK_HAS_CAN         (ABK_VARIANT == ABK_VARIANT_PRODUCTION)
+#define ABK_HAS_BRAKE       0       // Brake output isn't wired (see pins.cpp)
+
+#define ABK_HAS_USBSERIAL   1
 #define ABK_DEBUG           1
 
+#define ABK_AXES            1       // Number of drums driven by this unit (1 or 2)
+
+#define ABK_CAN_BITRATE     (500000)
+#define ABK_CAN_CUE_LEAD    (5000)  // Time in us between a cue broadcast and its execution
+#define ABK_CAN_SYNC_LATENCY (110)  // SYNC frame duration and RX interrupt entry in us
+
 #define ABK_INTERVAL        (10)
-#define ABK_SERIAL_INTERVAL (10)
+#define ABK_SERIAL_INTERVAL (10)         // Only used as RX poll period without USB serial
+#define ABK_SUPERVISOR_INTERVAL (250)   // Must stay well below the 1s watchdog timeout
+#define ABK_APP_DEADLINE        (100)   // Max time in ms between two app task check-ins
+#define ABK_SERIAL_DEADLINE     (500)   // Max time in ms the serial task may be busy
+
+#define ABK_VFD_ISR_BUDGET      (50)    // Per mille of the CPU the VFD ramp interrupt may take at full speed
+
+#define ABK_INPUT_SAMPLE_US     (500)   // Control inputs sampling period
+// Consecutive samples an input must hold before its debounced state follows (1..31)
+#define ABK_DEBOUNCE_TRIGGER    (2)     // Kept short, it is the cue latency
+#define ABK_DEBOUNCE_ESTOP      (4)
+#define ABK_DEBOUNCE_VFD        (20)
+#define ABK_DEBOUNCE_SLOWFEED   (20)
+
+#define ABK_SERIAL_TX_BUFFER_SIZE   (2048)
+#define ABK_SERIAL_TX_TIMEOUT       (20)    // Max time in ms a writer waits for buffer space
+#define ABK_SERIAL_TX_COALESCE      (2)     // Time in ms the TX thread waits to fill a packet
+#define ABK_SERIAL_TX_DROP_OLDEST   0       // 1: overwrite oldest data, 0: back-pressure then drop
+
+#if defined(ABK_DEBUG) && (ABK_DEBUG != 0)
+#define DEBUG_PRINTF(...) (printf(__VA_ARGS__))
+#else
+#define DEBUG_PRINTF(...) (0)
+#endif
 
 #endif /* !CONFIG_H */
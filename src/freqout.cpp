@@ -0,0 +1,207 @@
+/*
+ * freqout.cpp
+ * Copyright (C) 2017 Benoit Rapidel <benoit.rapidel+devs@exmachina.fr>
+ *
+ * Distributed under terms of the MIT license.
+ */
+
+#include "freqout.h"
+
+// PCLKSEL can't be changed once PLL0 is connected (errata), both outputs stay at CCLK/4
+#define FREQOUT_PCLK    (SystemCoreClock / 4)
+
+void FreqOut::record(float hz, float actual_hz) {
+    _hz = hz;
+    _actual_hz = actual_hz;
+
+    if (hz > 0) {
+        float error = (actual_hz > hz) ? actual_hz - hz : hz - actual_hz;
+        uint32_t ppm = (uint32_t) (error * 1000000.0 / hz);
+        if (ppm > _max_error_ppm)
+            _max_error_ppm = ppm;
+    }
+}
+
+PwmFreqOut *PwmFreqOut::_instance = NULL;
+
+PwmFreqOut::PwmFreqOut(PinName pin, int channel) : _pwm(pin), _channel(channel),
+        _freq(0), _target(0), _rate(0), _frac(0), _ticks(0), _isr_count(0), _isr_max_cycles(0) {
+    volatile uint32_t *match[] = {
+        &LPC_PWM1->MR0, &LPC_PWM1->MR1, &LPC_PWM1->MR2, &LPC_PWM1->MR3,
+        &LPC_PWM1->MR4, &LPC_PWM1->MR5, &LPC_PWM1->MR6
+    };
+    _match = match[channel];
+
+    // PwmOut has left a 1us prescaler, count PCLK instead
+    LPC_PWM1->TCR = 0x2;
+    LPC_PWM1->PR = 0;
+    LPC_PWM1->MR0 = FREQOUT_PCLK / 1000;
+    *_match = 0;
+    LPC_PWM1->LER = (1 << 0) | (1 << _channel);
+    LPC_PWM1->TCR = (1 << 0) | (1 << 3);        // Counter and PWM mode enabled
+
+    _pclk_q7 = FREQOUT_PCLK << 7;
+    _ticks = FREQOUT_PCLK / 1000;
+
+    // Cycle counter for the interrupt cost
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+
+    _instance = this;
+    NVIC_SetVector(PWM1_IRQn, (uint32_t) &PwmFreqOut::period_isr);
+    NVIC_EnableIRQ(PWM1_IRQn);
+}
+
+// Shadow registers, latched together when the current period ends
+void PwmFreqOut::load(uint32_t ticks) {
+    if (ticks < 2)
+        ticks = 2;
+
+    LPC_PWM1->MR0 = ticks;
+    *_match = ticks / 2;
+    LPC_PWM1->LER = (1 << 0) | (1 << _channel);
+}
+
+void PwmFreqOut::write_hz(float hz) {
+    uint32_t ticks = (uint32_t) (FREQOUT_PCLK / hz + 0.5);
+
+    core_util_critical_section_enter();
+    LPC_PWM1->MCR &= ~(1 << 0);                 // Ramp over
+    _freq = _target = (uint32_t) (hz * 128);
+    _ticks = ticks;
+    load(ticks);
+    core_util_critical_section_exit();
+
+    record(hz, (float) FREQOUT_PCLK / ticks);
+}
+
+void PwmFreqOut::ramp_hz(float hz, uint32_t ms) {
+    uint32_t target = (uint32_t) (hz * 128);
+
+    if (ms == 0 || _freq == 0) {                // Nothing to sweep from
+        write_hz(hz);
+        return;
+    }
+
+    uint32_t delta = (target > _freq) ? target - _freq : _freq - target;
+    double rate = delta * 65536.0 * 1000 / ((double) ms * FREQOUT_PCLK);
+
+    if (rate > 0xFFFFFFFF)
+        rate = 0xFFFFFFFF;
+    else if (delta > 0 && rate < 1)
+        rate = 1;
+
+    core_util_critical_section_enter();
+    _target = target;
+    _rate = (uint32_t) rate;
+    _frac = 0;
+    LPC_PWM1->IR = (1 << 0);
+    LPC_PWM1->MCR |= (1 << 0);                  // Interrupt at every period end
+    core_util_critical_section_exit();
+
+    uint32_t ticks = (_pclk_q7 + target / 2) / target;
+    record(hz, (float) FREQOUT_PCLK / (ticks < 2 ? 2 : ticks));
+}
+
+void PwmFreqOut::stop() {
+    core_util_critical_section_enter();
+    LPC_PWM1->MCR &= ~(1 << 0);
+    _freq = _target = 0;
+    *_match = 0;
+    LPC_PWM1->LER = (1 << _channel);
+    core_util_critical_section_exit();
+
+    record(0, 0);
+}
+
+void PwmFreqOut::clear_isr_stats() {
+    core_util_critical_section_enter();
+    _isr_count = 0;
+    _isr_max_cycles = 0;
+    core_util_critical_section_exit();
+}
+
+// A period has just started with the values loaded one period ago, prepare the next one
+void PwmFreqOut::step(void) {
+    uint64_t acc = (uint64_t) _rate * _ticks + _frac;
+    uint32_t delta = (uint32_t) (acc >> 16);
+    uint32_t freq = _freq;
+
+    _frac = (uint32_t) acc & 0xFFFF;
+
+    if (freq < _target)
+        freq = (_target - freq > delta) ? freq + delta : _target;
+    else
+        freq = (freq - _target > delta) ? freq - delta : _target;
+
+    _freq = freq;
+    _ticks = (_pclk_q7 + freq / 2) / freq;
+    load(_ticks);
+
+    if (freq == _target)
+        LPC_PWM1->MCR &= ~(1 << 0);
+}
+
+void PwmFreqOut::period_isr(void) {
+    uint32_t start = DWT->CYCCNT;
+
+    LPC_PWM1->IR = (1 << 0);
+    _instance->step();
+
+    uint32_t cycles = DWT->CYCCNT - start;
+    _instance->_isr_count++;
+    if (cycles > _instance->_isr_max_cycles)
+        _instance->_isr_max_cycles = cycles;
+}
+
+volatile uint32_t TimerFreqOut::_pending = 0;
+
+TimerFreqOut::TimerFreqOut() {
+    LPC_SC->PCONP |= (1 << 2);                  // Power TIMER1, PCLK is CCLK/4 by default
+    LPC_PINCON->PINSEL3 |= (3 << 12);           // P1.22 as MAT1.0
+
+    LPC_TIM1->TCR = 0x2;                        // Hold in reset
+    LPC_TIM1->PR = 0;
+    LPC_TIM1->MCR = (1 << 1);                   // Reset on MR0
+    LPC_TIM1->EMR = 0;                          // Output low until started
+
+    NVIC_SetVector(TIMER1_IRQn, (uint32_t) &TimerFreqOut::match_isr);
+    NVIC_EnableIRQ(TIMER1_IRQn);
+}
+
+// TC has just been reset by MR0, the new half period starts cleanly from here
+void TimerFreqOut::match_isr(void) {
+    LPC_TIM1->IR = (1 << 0);
+    LPC_TIM1->MR0 = _pending;
+    LPC_TIM1->MCR &= ~(1 << 0);
+}
+
+void TimerFreqOut::write_hz(float hz) {
+    uint32_t ticks = (uint32_t) (FREQOUT_PCLK / (2.0 * hz) + 0.5);   // Toggle twice per period
+
+    if (ticks < 2)
+        ticks = 2;
+
+    core_util_critical_section_enter();
+    if (LPC_TIM1->TCR & 0x1) {
+        _pending = ticks - 1;
+        LPC_TIM1->MCR |= (1 << 0);              // Interrupt on the next match
+    } else {
+        LPC_TIM1->MR0 = ticks - 1;
+        LPC_TIM1->EMR = (LPC_TIM1->EMR & 0x1) | (3 << 4);   // Toggle MAT1.0 on match
+        LPC_TIM1->TCR = 0x1;
+    }
+    core_util_critical_section_exit();
+
+    record(hz, (float) FREQOUT_PCLK / (2 * ticks));
+}
+
+void TimerFreqOut::stop() {
+    core_util_critical_section_enter();
+    LPC_TIM1->MCR &= ~(1 << 0);
+    LPC_TIM1->TCR = 0x2;
+    LPC_TIM1->EMR = 0;                          // Force MAT1.0 low
+    core_util_critical_section_exit();
+
+    record(0, 0);
+}
@@ -0,0 +1,95 @@
+/*
+ * freqout.h
+ * Copyright (C) 2017 Benoit Rapidel <benoit.rapidel+devs@exmachina.fr>
+ *
+ * Distributed under terms of the MIT license.
+ */
+
+#ifndef FREQOUT_H
+#define FREQOUT_H
+
+#include "mbed.h"
+
+// Square wave output driving a VFD frequency input
+class FreqOut {
+
+public:
+    FreqOut() : _hz(0), _actual_hz(0), _max_error_ppm(0) {}
+
+    virtual void write_hz(float hz) = 0;
+    virtual void stop() = 0;
+
+    // Sweep linearly from the current frequency to hz over the next ms. Outputs
+    // that can't interpolate on their own step straight to hz.
+    virtual void ramp_hz(float hz, uint32_t ms) { write_hz(hz); }
+
+    // Last commanded frequency, frequency actually synthesised and worst quantisation error seen
+    float hz() const { return _hz; }
+    float actual_hz() const { return _actual_hz; }
+    uint32_t max_error_ppm() const { return _max_error_ppm; }
+    void clear_error() { _max_error_ppm = 0; }
+
+protected:
+    void record(float hz, float actual_hz);
+
+private:
+    float _hz;
+    float _actual_hz;
+    uint32_t _max_error_ppm;
+};
+
+// PWM1 channel counting at full PCLK, every PWM1 channel shares the same period so only one axis can use it.
+// While ramping, the period interrupt moves the frequency by rate * period every cycle, integer only.
+class PwmFreqOut : public FreqOut {
+
+public:
+    PwmFreqOut(PinName pin, int channel);
+
+    virtual void write_hz(float hz);
+    virtual void ramp_hz(float hz, uint32_t ms);
+    virtual void stop();
+
+    // Period interrupt cost in core cycles, entry and exit excluded
+    uint32_t isr_count() const { return _isr_count; }
+    uint32_t isr_max_cycles() const { return _isr_max_cycles; }
+    void clear_isr_stats();
+
+private:
+    static void period_isr(void);
+    void step(void);
+    void load(uint32_t ticks);
+
+    static PwmFreqOut *_instance;       // Owner of the PWM1 interrupt
+
+    PwmOut _pwm;                        // Sets up the pin and the channel before we take over
+    int _channel;
+    volatile uint32_t *_match;
+    uint32_t _pclk_q7;                  // PCLK << 7, ticks = _pclk_q7 / frequency
+
+    // Frequencies in 1/128 Hz
+    volatile uint32_t _freq;            // Current period
+    volatile uint32_t _target;
+    volatile uint32_t _rate;            // Frequency change per PCLK tick, 16 fractional bits
+    uint32_t _frac;
+    uint32_t _ticks;                    // Length of the period in progress
+
+    volatile uint32_t _isr_count;
+    volatile uint32_t _isr_max_cycles;
+};
+
+// TIMER1 match 0 in toggle mode on P1.22 (MAT1.0)
+class TimerFreqOut : public FreqOut {
+
+public:
+    TimerFreqOut();
+
+    virtual void write_hz(float hz);
+    virtual void stop();
+
+private:
+    static void match_isr(void);
+
+    static volatile uint32_t _pending;  // MR0 loaded right after the next toggle
+};
+
+#endif /* !FREQOUT_H */
@@ -19,12 +19,25 @@ Watchdog wdog;
 volatile uint32_t   ABK_timer1ms = 0U;   // variable increments each millisecond
 
 #if !ABK_TEST
-Ticker ticker_sync;
 Ticker ticker_leds;
 #endif
+#if ABK_HAS_CONTROL
+Ticker ticker_supervisor;
+#endif
 
 Timer ABK_timer;
 Timer ABK_leds_timer;
+Timer ABK_stats_timer;
+
+// Wake-up sources
+#if ABK_HAS_CONTROL
+Semaphore ABK_serial_rx_sem(0);
+Semaphore ABK_supervisor_sem(0);
+Semaphore ABK_boot_done_sem(0);    // Released by the app task once it is armed (or can't be)
+Semaphore ABK_app_sem(0);          // Wakes the control loop before its next tick
+#endif
+
+ABK_wakeup_stats_t ABK_wakeup_stats;
 
 // Serial
 #if ABK_HAS_USBSERIAL
@@ -39,184 +52,182 @@ I2C i2c_eeprom(I2C0_SDA, I2C0_SCL);
 AT24CXX_I2C eeprom(&i2c_eeprom, 0x50);
 #endif
 
+// Axes
+PwmFreqOut motor_out(CTL_PWM_VFD, CTL_PWM_VFD_CHANNEL);
+#if ABK_AXES > 1
+TimerFreqOut motor_out_2;
+#endif
+
 Mutex ABK_config_mutex;
-ABK_config_t ABK_config;
-ABK_state_t ABK_state = ABK_STATE_NOT_CONFIGURED;
-uint8_t ABK_error = ABK_ERROR_NONE;
+ABK_axis_t ABK_axes[ABK_AXES];
 unsigned int EXM_previous_time[3];
 
 bool ABK_reset = false;
-uint8_t ABK_slowfeed = 0;
 
-#if !ABK_TEST
+#if ABK_HAS_CONTROL
 Thread ABK_app_thread;
 Thread ABK_serial_thread;
 #endif
 
 int main(void) {
+    ABK_boot_mark(ABK_BOOT_CLOCK);
+
+#if ABK_HAS_CONTROL
+    bool wdt_reset = wdog.caused_reset(); // Reading clears the flag, every user gets this copy
+#endif
 
 #if MBED_CONF_APP_MEMTRACE
     mbed_stats_heap_t heap_stats;
     mbed_mem_trace_set_callback(mbed_mem_trace_default_callback);
 #endif
 
-    ABK_set_motor_mode(ABK_MOTOR_DISABLED);
-    ABK_set_speed(0);
+    ABK_axis_init(&ABK_axes[0], &dir_fw, &dir_rw, &brake, &motor_out);
+#if ABK_AXES > 1
+    ABK_axis_init(&ABK_axes[1], &dir_fw_2, &dir_rw_2, &brake_2, &motor_out_2);
+#endif
+
+    for (int i=0; i<ABK_AXES; i++) {
+        ABK_set_motor_mode(&ABK_axes[i], ABK_MOTOR_DISABLED);
+        ABK_set_drum_mode(&ABK_axes[i], ABK_DRUM_FREEWHEEL);
+        ABK_axes[i].motor->stop();
+    }
 
-    brake = 0;
-    motor_ctl = 0;
-    dir_fw = 0;
-    dir_rw = 0;
+#if ABK_HAS_CONTROL
+    ABK_supervisor_init(wdt_reset);
+#endif
 
 #if !ABK_HAS_USBSERIAL
     USBport.baud(115200);
 #endif
 
-#if ABK_TEST
-    DigitalOut output1_1(OUTPUT1_1);
-    DigitalOut output1_2(OUTPUT1_2);
-    DigitalOut output1_3(OUTPUT1_3);
-    DigitalOut output1_4(OUTPUT1_4);
-
-    DigitalOut output2_1(OUTPUT2_1);
-    DigitalOut output2_2(OUTPUT2_2);
-    DigitalOut output2_3(OUTPUT2_3);
-    DigitalOut output2_4(OUTPUT2_4);
-#else
+#if !ABK_TEST
     ticker_leds.attach_us(&ABK_leds_task, 50000);
     ABK_leds_timer.start();
 #endif
 
-    wdog.kick(10); // First watchdog kick to trigger it
+    memset(&ABK_wakeup_stats, 0, sizeof(ABK_wakeup_stats_t));
+    ABK_stats_timer.start();
+    Thread::attach_idle_hook(&ABK_idle_hook);
 
-    USBport.printf("|=====================|\r\n");
-    USBport.printf("|     Abrakabuki      |\r\n");
-    USBport.printf("|    by ExMachina     |\r\n");
-    USBport.printf("|=====================|\r\n");
-    USBport.printf("\r\n");
+    wdog.kick(10); // First watchdog kick to trigger it
 
-#if ABK_SIMULATE
-    USBport.printf("SIMULATOR MODE ON\r\n");
+    ABK_serial_tx_start();
+#if ABK_HAS_USBSERIAL && ABK_HAS_CONTROL
+    USBport.attach(&ABK_serial_rx_isr);
 #endif
+    ABK_boot_mark(ABK_BOOT_USB);
 
+    // Banner and config dumps are deferred until the unit is armed
 #if ABK_HAS_EEPROM
     ABK_config_mutex.lock();
 
-    // get_eeprom data
-    if (ABK_eeprom_read_config(&eeprom, &ABK_config)) { // get_eeprom data success
-        ABK_state = ABK_STATE_CONFIGURED;
-        ABK_error = REMOVE_FLAG(ABK_error, ABK_ERROR_NOT_CONFIGURED);
-        printf("Configured:\r\n");
-        printf("state %d\r\n", ABK_config.state);
-        printf("start %dms\r\n", ABK_config.start_time);
-        printf("point1 %dms @%d\r\n", ABK_config.p1.time, ABK_config.p1.speed);
-        printf("point2 %dms @%d\r\n", ABK_config.p2.time, ABK_config.p2.speed);
-        printf("point3 %dms @%d\r\n", ABK_config.p3.time, ABK_config.p3.speed);
-        printf("stop %dms\r\n", ABK_config.stop_time);
-        if (ABK_config.state == 1) {
-            if (ABK_validate_config(&ABK_config)) {
-                ABK_state = ABK_STATE_CONFIGURED;
-                printf("Valid config\r\n");
-            } else {
-                ABK_state = ABK_STATE_NOT_CONFIGURED;
-                ABK_error = ADD_FLAG(ABK_error, ABK_ERROR_INVALID_CONFIG);
+    for (int i=0; i<ABK_AXES; i++) {
+        ABK_axis_t *axis = &ABK_axes[i];
+        ABK_config_t *config = &axis->config;
+
+        // get_eeprom data
+        bool read = ABK_eeprom_read_config(&eeprom, config, i);
+        ABK_boot_mark(ABK_BOOT_EEPROM);
+
+        if (read) { // get_eeprom data success
+            axis->state = ABK_STATE_CONFIGURED;
+            axis->error = REMOVE_FLAG(axis->error, ABK_ERROR_NOT_CONFIGURED);
+            if (config->state == 1) {
+                if (ABK_validate_config(config)) {
+                    axis->state = ABK_STATE_CONFIGURED;
+                } else {
+                    axis->state = ABK_STATE_NOT_CONFIGURED;
+                    axis->error = ADD_FLAG(axis->error, ABK_ERROR_INVALID_CONFIG);
+                }
+            } else if (config->state == 0 || config->state == 255) {
+                ABK_serial_printf("Erasing axis %d!\r\n", i);
+                ABK_eeprom_erase_config(&eeprom, i);
+                ABK_eeprom_read_config(&eeprom, config, i);
+                axis->state = ABK_STATE_NOT_CONFIGURED;
             }
-        } else if (ABK_config.state == 0 || ABK_config.state == 255) {
-            USBport.printf("Erasing!\r\n");
-            ABK_eeprom_erase_config(&eeprom);
-            ABK_eeprom_read_config(&eeprom, &ABK_config);
-            ABK_state = ABK_STATE_NOT_CONFIGURED;
-        }
-    } else {
-        ABK_state = ABK_STATE_NOT_CONFIGURED;
-        ABK_error = ADD_FLAG(ABK_error, ABK_ERROR_NOT_CONFIGURED);
-        printf("Not ABK_configured\r\n");
+        } else {
+            axis->state = ABK_STATE_NOT_CONFIGURED;
+            axis->error = ADD_FLAG(axis->error, ABK_ERROR_NOT_CONFIGURED);
+            DEBUG_PRINTF("Axis %d not configured\r\n", i);
 #if ABK_SIMULATE
-        ABK_config.state = 1;
-        ABK_config.start_time = 1000;
-        ABK_config.p1.time = 2500;
-        ABK_config.p1.speed = 80;
-        ABK_config.p2.time = 5000;
-        ABK_config.p2.speed = 100;
-        ABK_config.stop_time = 10000;
-        ABK_state = ABK_STATE_RUN;
-        DEBUG_PRINTF("Forced ABK_config:\r\n");
-        DEBUG_PRINTF("start %dms\r\n", ABK_config.start_time);
-        DEBUG_PRINTF("point1 %dms @%d\r\n", ABK_config.p1.time, ABK_config.p1.speed);
-        DEBUG_PRINTF("point2 %dms @%d\r\n", ABK_config.p2.time, ABK_config.p2.speed);
-        DEBUG_PRINTF("point3 %dms @%d\r\n", ABK_config.p3.time, ABK_config.p3.speed);
-        DEBUG_PRINTF("stop %dms\r\n", ABK_config.stop_time);
+            config->state = 1;
+            config->start_time = 1000;
+            config->p1.time = 2500;
+            config->p1.speed = 80;
+            config->p2.time = 5000;
+            config->p2.speed = 100;
+            config->stop_time = 10000;
+            axis->state = ABK_STATE_RUN;
+            DEBUG_PRINTF("Forced config:\r\n");
+            DEBUG_PRINTF("start %dms\r\n", config->start_time);
+            DEBUG_PRINTF("point1 %dms @%d\r\n", config->p1.time, config->p1.speed);
+            DEBUG_PRINTF("point2 %dms @%d\r\n", config->p2.time, config->p2.speed);
+            DEBUG_PRINTF("point3 %dms @%d\r\n", config->p3.time, config->p3.speed);
+            DEBUG_PRINTF("stop %dms\r\n", config->stop_time);
 #endif
+        }
+        ABK_boot_mark(ABK_BOOT_VALIDATION);
+
+        for (int c=1; c<ABK_CUES; c++)
+            ABK_eeprom_read_cue(&eeprom, &axis->cues[c - 1], i, c);
+
+        ABK_eeprom_read_lead(&eeprom, &axis->lead, i);
     }
 
     ABK_config_mutex.unlock();
 #endif
 
 #if ABK_TEST
-    uint16_t period = 0;
-    while (true) {
-        led1 = (period % 2 == 0) ? true : false;
-        led2 = (period % 4 == 0) ? true : false;
-
-        output1_1 = !output1_1;
-        output1_2 = !output1_2;
-        output1_3 = !output1_3;
-        output1_4 = !output1_4;
-
-        output2_1 = !output2_1;
-        output2_2 = !output2_2;
-        output2_3 = !output2_3;
-        output2_4 = !output2_4;
-
-        period++;
-        Thread::wait(2000);
-
-        wdog.kick();
-    }
+    ABK_print_banner();
+    ABK_io_test(&wdog);
 
 #elif ABK_MOTOR_TEST
+    ABK_print_banner();
+    ABK_motor_test(&ABK_axes[0], &wdog);
 
-    for (int i=0; i<100; i++) {
-        brake = 0;
-        ABK_set_speed(i);
-        dir_fw = 1;
-        dir_rw = 0;
-        Thread::wait(200);
-
-        wdog.kick();
-    }
+#else
 
-    for (int i=100; i>0; i--) {
-        brake = 0;
-        ABK_set_speed(i);
-        dir_fw = 1;
-        dir_rw = 0;
-        Thread::wait(200);
+    ABK_timer.start();
 
-        wdog.kick();
-    }
 
-    dir_fw = 0;
-    dir_rw = 0;
+#if ABK_HAS_CAN
+    ABK_can_init(&eeprom, ABK_CAN_RXD, ABK_CAN_TXD, ABK_axes, &ABK_app_wake);
+#endif
 
-#else
+    ABK_inputs_init();
 
-    ABK_timer.start();
+    ABK_supervisor_register(ABK_TASK_APP, ABK_APP_DEADLINE);
+    ABK_supervisor_register(ABK_TASK_SERIAL, ABK_SERIAL_DEADLINE);
+    ABK_supervisor_register(ABK_TASK_LOG, ABK_LOG_DEADLINE);
 
+    ABK_log_init(&eeprom, &ABK_config_mutex, wdt_reset);
+    ABK_events_init(ABK_axes, &ABK_serial_wake);
 
     ABK_app_thread.start(ABK_app_task);
     ABK_serial_thread.start(ABK_serial_task);
+    ABK_boot_mark(ABK_BOOT_THREADS);
 
     wdog.kick(1); // Set watchdog to 1s
 
+    ticker_supervisor.attach_us(&ABK_supervisor_isr, ABK_SUPERVISOR_INTERVAL * 1000);
+
     while(true) {
+        ABK_supervisor_sem.wait(); // Woken up by the supervisor ticker or a reset request
+        ABK_wakeup_stats.supervisor_wakeups++;
+
         led1 = !led1;
-        wdog.kick();
+
+        if (ABK_supervisor_check()) // Only feed the watchdog if every task is alive
+            wdog.kick();
+
+#if ABK_HAS_CAN
+        ABK_can_poll(); // Master sends the timebase, slaves report their last cue
+#endif
 
 #if ABK_SIMULATE
         if (!ac_trigger && ABK_timer.read_ms() > 5000) {
             ac_trigger = 1;
-            USBport.printf("Simulated trigger");
+            ABK_serial_printf("Simulated trigger");
         }
 #endif
 
@@ -224,8 +235,6 @@ int main(void) {
             NVIC_SystemReset();
             break;
         }
-
-        Thread::wait(100);
     }
 
     // Reset
@@ -235,6 +244,17 @@ int main(void) {
 #endif
 }
 
+static void ABK_print_banner(void) {
+    ABK_serial_printf("|=====================|\r\n");
+    ABK_serial_printf("|     Abrakabuki      |\r\n");
+    ABK_serial_printf("|    by ExMachina     |\r\n");
+    ABK_serial_printf("|=====================|\r\n");
+    ABK_serial_printf("\r\n");
+
+    if (ABK_VARIANT != ABK_VARIANT_PRODUCTION)
+        ABK_serial_printf("VARIANT %s\r\n", ABK_VARIANT_NAME);
+}
+
 void EXM_blink_led(DigitalOut led, uint8_t led_index, unsigned int interval, int time) {
     if (interval == 0) {
         led = 0;
@@ -246,13 +266,23 @@ void EXM_blink_led(DigitalOut led, uint8_t led_index, unsigned int interval, int
         EXM_previous_time[led_index]= time;
     }
 }
-// Led update task
+#if !ABK_TEST
+// Led update task, the I/O test drives the LEDs itself
 static void ABK_leds_task(void) {
     int current_time = ABK_leds_timer.read_ms();
-    EXM_blink_led(led2, 0, ABK_state * 100, current_time);
+    ABK_state_t state = ABK_axes[0].state;
+    uint8_t error = ABK_ERROR_NONE;
+
+    for (int i=0; i<ABK_AXES; i++)
+        error |= ABK_axes[i].error;
 
-    if (ABK_error == ABK_ERROR_NONE)
-        switch (ABK_state) {
+    EXM_blink_led(led2, 0, state * 100, current_time);
+
+    if (state == ABK_STATE_CALIBRATION) // Status LEDs may be under test (diag loopback 2)
+        return;
+
+    if (error == ABK_ERROR_NONE)
+        switch (state) {
             case ABK_STATE_READY:
                 led_sts = 1;
                 break;
@@ -268,169 +298,90 @@ static void ABK_leds_task(void) {
     else
         led_sts = 0;
 
-    EXM_blink_led(led_err, 2, ABK_error * 100, current_time);
+    EXM_blink_led(led_err, 2, error * 100, current_time);
 }
+#endif
 
-static void ABK_app_task(void) {
-    bool _triggered = false;
-    int _trigger_time = 0U;
-    ABK_state_t last_state = ABK_STATE_CONFIGURED;
-    ABK_config_t _config;
-
-    if (ABK_state == ABK_STATE_CONFIGURED) {
-        ABK_config_mutex.lock();
-        memcpy(&_config, &ABK_config, sizeof(ABK_config_t));
-        USBport.printf("Config copied.\r\n");
-        ABK_config_mutex.unlock();
-
-        printf("start %dms\r\n", _config.start_time);
-        printf("point1 %dms @%d\r\n", _config.p1.time, _config.p1.speed);
-        printf("point2 %dms @%d\r\n", _config.p2.time, _config.p2.speed);
-        printf("point3 %dms @%d\r\n", _config.p3.time, _config.p3.speed);
-        printf("stop %dms\r\n", _config.stop_time);
-
-        ABK_state = ABK_STATE_READY;
-    }
-
-    while (ABK_state != ABK_STATE_RESET) {
-        Thread::wait(ABK_INTERVAL);
+// Replaces the default idle hook to account the time the MCU sleeps
+static void ABK_idle_hook(void) {
+    uint32_t start = us_ticker_read();
+    sleep();
+    ABK_wakeup_stats.idle_us += (uint32_t) (us_ticker_read() - start);
+}
 
-        if (ABK_state == ABK_STATE_NOT_CONFIGURED) {
-            ABK_error = ADD_FLAG(ABK_error, ABK_ERROR_INVALID_CONFIG);
-        } else {
-            ABK_error = REMOVE_FLAG(ABK_error, ABK_ERROR_INVALID_CONFIG);
-        }
+#if ABK_HAS_CONTROL
+// Called from the USB CDC interrupt when a packet is received
+static void ABK_serial_rx_isr(void) {
+    ABK_serial_rx_sem.release();
+}
 
-        if ((bool) !drive_status) { // Stop motor on VFD error
-            ABK_error = ADD_FLAG(ABK_error, ABK_ERROR_VFD_ERROR);
-            ABK_set_drum_mode(ABK_DRUM_BRAKED);
-            ABK_set_speed(0.0);
-            ABK_set_motor_mode(ABK_MOTOR_DISABLED);
+#if ABK_HAS_CAN
+// Run the control loop now, used when a scheduled trigger fires
+static void ABK_app_wake(void) {
+    ABK_app_sem.release();
+}
+#endif
 
-            if (_triggered) {
-                ABK_state = ABK_STATE_STANDBY;
-            }
-        } else {
-            ABK_error = REMOVE_FLAG(ABK_error, ABK_ERROR_VFD_ERROR);
-        }
+// Send the queued events, used when an axis state or error changes
+static void ABK_serial_wake(void) {
+    ABK_serial_rx_sem.release();
+}
 
-        if ((bool) !emergency_stop) { // Stop motor on emergency input
-            ABK_error = ADD_FLAG(ABK_error, ABK_ERROR_EMERGENCY_STOP);
-            ABK_set_drum_mode(ABK_DRUM_BRAKED);
-            ABK_set_speed(0.0);
-            ABK_set_motor_mode(ABK_MOTOR_DISABLED);
+static void ABK_supervisor_isr(void) {
+    ABK_supervisor_sem.release();
+}
 
-            if (_triggered) {
-                ABK_state = ABK_STATE_STANDBY;
-            }
-        } else {
-            ABK_error = REMOVE_FLAG(ABK_error, ABK_ERROR_EMERGENCY_STOP);
-        }
+static void ABK_app_task(void) {
+    bool armed = false;
 
-        if (ABK_error != ABK_ERROR_NONE) // Block here if we have any error.
-            continue;
+    for (int i=0; i<ABK_AXES; i++) {
+        ABK_axis_t *axis = &ABK_axes[i];
 
-        if ((bool) slowfeed_fw_input || (bool) slowfeed_rw_input
-                || ABK_slowfeed != ABK_SLOWFEED_NONE) { // Overrides default behavior for loading/unloading
-            last_state = ABK_state;
-            ABK_state = ABK_STATE_SLOWFEED;
-            ABK_set_drum_mode(ABK_DRUM_FREEWHEEL);
-            if (slowfeed_fw_input || ABK_slowfeed == ABK_SLOWFEED_FORWARD)
-                ABK_set_motor_mode(ABK_MOTOR_FW);
-            else if (slowfeed_rw_input || ABK_slowfeed == ABK_SLOWFEED_REWIND)
-                ABK_set_motor_mode(ABK_MOTOR_RW);
-            ABK_set_speed(ABK_SLOWFEED_SPEED);
-            _triggered = false;
-            ABK_timer.reset();
-            continue;
-        } else if (ABK_state == ABK_STATE_SLOWFEED) {
-            ABK_state = (last_state == ABK_STATE_READY) ? ABK_STATE_READY : ABK_STATE_STANDBY;
-            ABK_set_motor_mode(ABK_MOTOR_DISABLED);
-            ABK_set_speed(0.0);
-        }
+        ABK_config_mutex.lock();
+        ABK_axis_load_cues(axis);
+        ABK_config_mutex.unlock();
 
+        if (axis->state == ABK_STATE_CONFIGURED)
+            axis->state = ABK_STATE_READY;
+        if (axis->state == ABK_STATE_READY || axis->state == ABK_STATE_RUN) // RUN: simulate forced config
+            armed = true;
+    }
 
-        if (ABK_state == ABK_STATE_RUN || ABK_state == ABK_STATE_READY) {
-            if (!_triggered && (ac_trigger == 0) && (ABK_error == ABK_ERROR_NONE)) {
-                ABK_state = ABK_STATE_RUN;
-                _triggered = true;
-                _trigger_time = ABK_timer.read_ms();    // Store and reset timer: This ensure the timer
-                ABK_timer.reset();                      // doesn't overflow after the ABK been trigered (undefined behaviour)
-                printf("status trigger\r\n");
-            } else if (!_triggered) {
-                ABK_set_drum_mode(ABK_DRUM_BRAKED);
-                ABK_set_motor_mode(ABK_MOTOR_DISABLED);
-                ABK_set_speed(0);
-                continue;
-            }
+    if (armed)
+        ABK_boot_mark(ABK_BOOT_READY);
+    ABK_boot_done_sem.release(); // Let the serial task print the deferred banner
 
+    while (ABK_axes[0].state != ABK_STATE_RESET) {
+        ABK_app_sem.wait(ABK_INTERVAL);
+        ABK_supervisor_checkin(ABK_TASK_APP);
 
-            if (ABK_state == ABK_STATE_RUN) {
-                int _stime = ABK_timer.read_ms(); // Update time since trigger
-                led2 = !led2;
-                DEBUG_PRINTF("stime: %d \r\n", _stime);
+        bool running = false;
+        uint32_t snapshot = ABK_inputs_read(); // Debounced, every axis sees the same instant
 
-                if (_stime >= _config.start_time && _stime < _config.p1.time) {
-                    ABK_set_drum_mode(ABK_DRUM_FREEWHEEL);
-                    ABK_set_motor_mode(ABK_MOTOR_FW);
+        // Every axis is evaluated in the same tick
+        for (int i=0; i<ABK_AXES; i++) {
+            ABK_axis_t *axis = &ABK_axes[i];
+            uint32_t start = us_ticker_read();
 
-                    float rspeed = ABK_map(_config.start_time, _config.p1.time,
-                           0, _config.p1.speed, _stime);
-                    ABK_set_speed(rspeed);
-                    DEBUG_PRINTF("T0 %f\r\n", rspeed);
-                }
-                else if (_stime >= _config.p1.time && _stime < _config.p2.time) {
-                    ABK_set_drum_mode(ABK_DRUM_FREEWHEEL);
-                    ABK_set_motor_mode(ABK_MOTOR_FW);
-
-                    float rspeed = ABK_map(_config.p1.time, _config.p2.time,
-                            _config.p1.speed, _config.p2.speed, _stime);
-                    ABK_set_speed(rspeed);
-                    DEBUG_PRINTF("T1 %f\r\n", rspeed);
-                }
-                else if (_stime >= _config.p2.time && _stime < _config.p3.time) {
-                    ABK_set_drum_mode(ABK_DRUM_FREEWHEEL);
-                    ABK_set_motor_mode(ABK_MOTOR_FW);
-
-                    float rspeed = ABK_map(_config.p2.time, _config.p3.time,
-                            _config.p2.speed, _config.p3.speed, _stime);
-                    ABK_set_speed(rspeed);
-                    DEBUG_PRINTF("T2 %f\r\n", rspeed);
-                }
-                else if (_stime >= _config.p3.time && _stime < _config.stop_time) {
-                    ABK_set_drum_mode(ABK_DRUM_FREEWHEEL);
-                    ABK_set_motor_mode(ABK_MOTOR_FW);
-
-                    float rspeed = ABK_map(_config.p3.time, _config.stop_time,
-                            _config.p3.speed, 0, _stime);
-                    ABK_set_speed(rspeed);
-                    DEBUG_PRINTF("T3 %f\r\n", rspeed);
-                }
-                else if (_stime >= _config.stop_time) {
-                    ABK_state = ABK_STATE_STANDBY;
-                    ABK_set_speed(0);
-                    ABK_set_drum_mode(ABK_DRUM_BRAKED);
-                    ABK_set_motor_mode(ABK_MOTOR_DISABLED);
-                    DEBUG_PRINTF("S\r\n");
-                    _triggered = false;
-                    ABK_state = ABK_STATE_STANDBY;
-                } else {
-                    ABK_set_speed(0);
-                    ABK_set_drum_mode(ABK_DRUM_BRAKED);
-                    ABK_set_motor_mode(ABK_MOTOR_DISABLED);
-                    DEBUG_PRINTF("U\r\n");
-                }
-            } else {
-                ABK_set_speed(0);
-                ABK_set_drum_mode(ABK_DRUM_BRAKED);
-                ABK_set_motor_mode(ABK_MOTOR_DISABLED);
-            }
+            uint8_t inputs = ABK_inputs_axis(snapshot, i);
+#if ABK_SIMULATE
+            if (i == 0 && ac_trigger == 0)
+                inputs |= ABK_INPUT_TRIGGER;
+#endif
+#if ABK_HAS_CAN
+            inputs = ABK_can_filter_inputs(i, inputs);
+#endif
+            running |= ABK_axis_tick(axis, inputs);
+            ABK_log_axis(i, axis);
+            ABK_events_axis(i, axis);
 
-        } else {
-            ABK_set_speed(0);
-            ABK_set_drum_mode(ABK_DRUM_BRAKED);
-            ABK_set_motor_mode(ABK_MOTOR_DISABLED);
+            axis->tick_us = us_ticker_read() - start;
+            if (axis->tick_us > axis->tick_max_us)
+                axis->tick_max_us = axis->tick_us;
         }
+
+        if (running)
+            led2 = !led2;
     }
 }
 
@@ -439,24 +390,76 @@ static void ABK_serial_task(void) {
     std::string cmd;
     char c='\0';
 
-    ABK_config_t tmp_config;
+    ABK_config_t tmp_configs[ABK_AXES];
+    ABK_config_t *tmp_config = &tmp_configs[0];
+    ABK_cue_t tmp_cues[ABK_AXES][ABK_CUES - 1];
+    ABK_cue_t *tmp_cue = NULL;          // Cue 0 is tmp_config alone
+    ABK_lead_t tmp_leads[ABK_AXES];
+    ABK_lead_t *tmp_lead = &tmp_leads[0];
+    ABK_axis_t *axis = &ABK_axes[0];    // Axis addressed by set/get/save/erase/slowfeed/status
+    int cue = 0;                        // Cue of the axis addressed by set/get/save/erase
+
+    ABK_supervisor_idle(ABK_TASK_SERIAL);
+    ABK_boot_done_sem.wait(ABK_SERIAL_DEADLINE); // Don't hold the EEPROM while the app task arms
+    ABK_supervisor_checkin(ABK_TASK_SERIAL);
 
     ABK_config_mutex.lock();
-    ABK_eeprom_read_config(&eeprom, &tmp_config);
+    for (int i=0; i<ABK_AXES; i++) {
+        ABK_eeprom_read_config(&eeprom, &tmp_configs[i], i);
+        ABK_eeprom_read_lead(&eeprom, &tmp_leads[i], i);
+        for (int c=1; c<ABK_CUES; c++)
+            ABK_eeprom_read_cue(&eeprom, &tmp_cues[i][c - 1], i, c);
+    }
     ABK_config_mutex.unlock();
 
+    ABK_print_banner();
+    for (int i=0; i<ABK_AXES; i++) {
+        if (ABK_axes[i].state == ABK_STATE_READY) {
+            ABK_serial_printf("Axis %d configured:\r\n", i);
+            ABK_serial_printf("start %dms\r\n", tmp_configs[i].start_time);
+            ABK_serial_printf("point1 %dms @%d\r\n", tmp_configs[i].p1.time, tmp_configs[i].p1.speed);
+            ABK_serial_printf("point2 %dms @%d\r\n", tmp_configs[i].p2.time, tmp_configs[i].p2.speed);
+            ABK_serial_printf("point3 %dms @%d\r\n", tmp_configs[i].p3.time, tmp_configs[i].p3.speed);
+            ABK_serial_printf("stop %dms\r\n", tmp_configs[i].stop_time);
+        }
+    }
+    if (ABK_boot_reached(ABK_BOOT_READY))
+        ABK_serial_printf("Armed in %luus from main()\r\n", ABK_boot_times[ABK_BOOT_READY]);
+    else
+        ABK_serial_printf("Not armed, no axis configured.\r\n");
+
     while (true) {
+        ABK_supervisor_checkin(ABK_TASK_SERIAL);
+
+        // Events never split a command line being echoed
+        uint32_t due = line.empty() ? ABK_events_due() : osWaitForever;
+        if (due == 0)
+            ABK_serial_events();
+
+        if (USBport.readable() <= 0 && due != 0) {
+            ABK_supervisor_idle(ABK_TASK_SERIAL);
+#if ABK_HAS_USBSERIAL
+            ABK_serial_rx_sem.wait(due); // Block until the host sends something or events are due
+#else
+            ABK_serial_rx_sem.wait((due < ABK_SERIAL_INTERVAL) ? due : ABK_SERIAL_INTERVAL);
+#endif
+            ABK_supervisor_checkin(ABK_TASK_SERIAL);
+            ABK_wakeup_stats.serial_wakeups++;
+            if (USBport.readable() <= 0)
+                ABK_wakeup_stats.serial_idle_wakeups++;
+        }
+
         if (USBport.readable() > 0) {
             while (USBport.readable() > 0) {
                 c = USBport.getc();
                 line += c;
-                USBport.putc(c);
+                ABK_serial_putc(c);
                 if (c == 0x08) { // Backspace character
                     line.erase(line.end()-1);
                 }
                 if (c == '\r' || c == '\n') {
                     if (c == '\r')
-                        USBport.putc('\n');
+                        ABK_serial_putc('\n');
 
                     break;
                 }
@@ -464,7 +467,7 @@ static void ABK_serial_task(void) {
 
             if (c == '\r' || c == '\n') {
                 char cmd_buf[10] = {0, 0, 0, 0, 0, 0, 0, 0};
-                char opt_str[10];
+                char opt_str[16];
                 int args;
                 unsigned int nargs = sscanf(line.c_str(), "%s %s %d", cmd_buf, opt_str, &args);
 
@@ -472,10 +475,9 @@ static void ABK_serial_task(void) {
                     cmd = cmd_buf;
 
                     if (cmd == "help") {
-                        USBport.printf(
-"Abrakabuki by ExMachina\r\n\
-    version: %s\r\n\r\n\
-available commands:\r\n\
+                        ABK_serial_printf("Abrakabuki by ExMachina\r\n    version: %s\r\n\r\n", ABK_VERSION);
+                        ABK_serial_puts(
+"available commands:\r\n\
     set OPTION VALUE     Set the option to the desired value.\r\n\
                          Integer and float are accepted.\r\n\
                          DELAYs are in milliseconds, SPEEDs in percent.\r\n\
@@ -487,92 +489,442 @@ available commands:\r\n\
          p3.time DELAY   Delay from trigger to point 3.\r\n\
          p3.speed SPEED  Speed at point 3.\r\n\
          stop DELAY      Delay from trigger to full stop.\r\n\
+         lead.brake DELAY Brake release lead time (after save and reset).\r\n\
+         lead.vfd DELAY  VFD command lead time (after save and reset).\r\n\
+         follow MODE     Cue 1 and up: 0 waits for a trigger once the previous\r\n\
+                         cue stops, 1 starts on its own after its delay.\r\n\
+         delay DELAY     Cue 1 and up: from the previous cue stop (follow 1).\r\n\
 \r\n\
+    axis [INDEX]         Select the axis used by set/get/save/erase/slowfeed/status\r\n\
+    cue [INDEX|arm]      Select the cue used by set/get/save/erase (0 is the\r\n\
+                         axis configuration, the list ends at the first unused\r\n\
+                         cue, after a reset), or go back to cue 0 from STANDBY\r\n\
     status               Display status\r\n\
+    subscribe [off]      Push state and error changes of every axis, one line each:\r\n\
+                         ev SEQ TIME_MS AXIS STATE ERROR MERGED STATES ERRORS\r\n\
+                         Close changes are merged, STATES (one bit per\r\n\
+                         state) and ERRORS then hold every value seen\r\n\
+    lead                 Display the actuator lead times in use\r\n\
+    calib                Measure the actuator lead times from the drum feedback\r\n\
+                         (axis 0, idle, drum must be free to turn)\r\n\
     get                  Return current configuration\r\n\
     save                 Save configuration to eeprom\r\n\
     erase                Erase configuration from eeprom\r\n\
     reset                Reset the microcontroller\r\n\
-    help                 Display this help message\r\n", ABK_VERSION);
+    stats                Display wake-up, idle, serial TX, input debouncing,\r\n\
+                         control loop, VFD frequency and ramp interrupt statistics\r\n\
+    boot                 Display boot phase timestamps, in us from main()\r\n\
+    can [node N|cue AXES] Display CAN sync status and per-unit skew, set this\r\n\
+                         unit node id (0 master, 255 off, after reset) or\r\n\
+                         broadcast a cue to an axis mask (master only)\r\n\
+    health [clear]       Display (or clear) task deadline misses, kept across resets\r\n\
+    log [COUNT]          Display the newest run and fault records (16 by default)\r\n\
+    update [begin]       Display the staged firmware update, or receive one\r\n\
+                         (framed binary, see tools/abkctl), installed at reset\r\n\
+    diag TEST [ARG]      Commissioning tests, axes must be idle:\r\n\
+         loopback BLOCK  Output to input latency, OUTPUTn_x wired to INPUTn_x\r\n\
+         eeprom          EEPROM throughput, the area used is restored\r\n\
+         pwm [SPEED]     VFD frequency accuracy, output wired to P1.19, motor off\r\n\
+         ramp            Motor ramp of the selected axis, drum must be free to turn\r\n\
+    help                 Display this help message\r\n");
                     } else if (cmd == "set") {
                         if (nargs > 1) {
-                            USBport.printf("%s set to %d\r\n", opt_str, args);
+                            ABK_serial_printf("%s set to %d\r\n", opt_str, args);
 
                             if (strcmp(opt_str, "start") == 0) {
-                                tmp_config.start_time = (uint16_t) args;
+                                tmp_config->start_time = (uint16_t) args;
                             } else if (strcmp(opt_str, "p1.time") == 0) {
-                                tmp_config.p1.time = (uint16_t) args;
+                                tmp_config->p1.time = (uint16_t) args;
                             } else if (strcmp(opt_str, "p1.speed") == 0) {
-                                tmp_config.p1.speed = (uint16_t) args;
+                                tmp_config->p1.speed = (uint16_t) args;
                             } else if (strcmp(opt_str, "p2.time") == 0) {
-                                tmp_config.p2.time = (uint16_t) args;
+                                tmp_config->p2.time = (uint16_t) args;
                             } else if (strcmp(opt_str, "p2.speed") == 0) {
-                                tmp_config.p2.speed = (uint16_t) args;
+                                tmp_config->p2.speed = (uint16_t) args;
                             } else if (strcmp(opt_str, "p3.time") == 0) {
-                                tmp_config.p3.time = (uint16_t) args;
+                                tmp_config->p3.time = (uint16_t) args;
                             } else if (strcmp(opt_str, "p3.speed") == 0) {
-                                tmp_config.p3.speed = (uint16_t) args;
+                                tmp_config->p3.speed = (uint16_t) args;
                             } else if (strcmp(opt_str, "stop") == 0) {
-                                tmp_config.stop_time = (uint16_t) args;
+                                tmp_config->stop_time = (uint16_t) args;
+                            } else if (strcmp(opt_str, "lead.brake") == 0) {
+                                if (args >= 0 && args <= ABK_LEAD_MAX)
+                                    tmp_lead->brake = (uint16_t) args;
+                                else
+                                    ABK_serial_printf("invalid lead time, max %d.\r\n", ABK_LEAD_MAX);
+                            } else if (strcmp(opt_str, "lead.vfd") == 0) {
+                                if (args >= 0 && args <= ABK_LEAD_MAX)
+                                    tmp_lead->vfd = (uint16_t) args;
+                                else
+                                    ABK_serial_printf("invalid lead time, max %d.\r\n", ABK_LEAD_MAX);
+                            } else if (strcmp(opt_str, "follow") == 0 && tmp_cue) {
+                                tmp_cue->follow = (uint8_t) args;
+                            } else if (strcmp(opt_str, "delay") == 0 && tmp_cue) {
+                                tmp_cue->delay = (uint16_t) args;
                             } else {
-                                USBport.printf("unrecognized option: %s.\r\n", opt_str);
+                                ABK_serial_printf("unrecognized option: %s.\r\n", opt_str);
                             }
                         } else {
-                            USBport.printf("misformatted command: %s.\r\n", cmd_buf);
+                            ABK_serial_printf("misformatted command: %s.\r\n", cmd_buf);
                         }
                     } else if (cmd == "get") {
                         ABK_config_mutex.lock();
 
-                        USBport.printf("start %d\r\n", ABK_config.start_time);
-                        USBport.printf("p1.time %d\r\np1.speed %d\r\n", ABK_config.p1.time, ABK_config.p1.speed);
-                        USBport.printf("p2.time %d\r\np2.speed %d\r\n", ABK_config.p2.time, ABK_config.p2.speed);
-                        USBport.printf("p3.time %d\r\np3.speed %d\r\n", ABK_config.p3.time, ABK_config.p3.speed);
-                        USBport.printf("stop %d\r\n", ABK_config.stop_time);
+                        ABK_config_t *config = (cue == 0) ? &axis->config : &axis->cues[cue - 1].profile;
+                        ABK_serial_printf("start %d\r\n", config->start_time);
+                        ABK_serial_printf("p1.time %d\r\np1.speed %d\r\n", config->p1.time, config->p1.speed);
+                        ABK_serial_printf("p2.time %d\r\np2.speed %d\r\n", config->p2.time, config->p2.speed);
+                        ABK_serial_printf("p3.time %d\r\np3.speed %d\r\n", config->p3.time, config->p3.speed);
+                        ABK_serial_printf("stop %d\r\n", config->stop_time);
+                        if (cue > 0) {
+                            ABK_serial_printf("follow %d\r\ndelay %d\r\n",
+                                    axis->cues[cue - 1].follow, axis->cues[cue - 1].delay);
+                        }
 
                         ABK_config_mutex.unlock();
                     } else if (cmd == "gett") {
-                        USBport.printf("start %d\r\n", tmp_config.start_time);
-                        USBport.printf("p1.time %d\r\np1.speed %d\r\n", tmp_config.p1.time, tmp_config.p1.speed);
-                        USBport.printf("p2.time %d\r\np2.speed %d\r\n", tmp_config.p2.time, tmp_config.p2.speed);
-                        USBport.printf("p3.time %d\r\np3.speed %d\r\n", tmp_config.p3.time, tmp_config.p3.speed);
-                        USBport.printf("stop %d\r\n", tmp_config.stop_time);
+                        ABK_serial_printf("start %d\r\n", tmp_config->start_time);
+                        ABK_serial_printf("p1.time %d\r\np1.speed %d\r\n", tmp_config->p1.time, tmp_config->p1.speed);
+                        ABK_serial_printf("p2.time %d\r\np2.speed %d\r\n", tmp_config->p2.time, tmp_config->p2.speed);
+                        ABK_serial_printf("p3.time %d\r\np3.speed %d\r\n", tmp_config->p3.time, tmp_config->p3.speed);
+                        ABK_serial_printf("stop %d\r\n", tmp_config->stop_time);
+                        if (tmp_cue)
+                            ABK_serial_printf("follow %d\r\ndelay %d\r\n", tmp_cue->follow, tmp_cue->delay);
+                        else
+                            ABK_serial_printf("lead.brake %d\r\nlead.vfd %d\r\n", tmp_lead->brake, tmp_lead->vfd);
+                    } else if (cmd == "lead") {
+                        ABK_serial_printf("lead.brake %d\r\nlead.vfd %d\r\n", axis->lead.brake, axis->lead.vfd);
+                    } else if (cmd == "calib") {
+                        ABK_calib_t calib;
+                        ABK_calib_result_t result = ABK_CALIB_BUSY;
+
+                        if (axis == &ABK_axes[0])
+                            result = ABK_calibrate(axis, &feedback_input, ABK_TASK_SERIAL, &calib);
+
+                        ABK_serial_printf("calib.result %s\r\n", ABK_calib_result_name(result));
+                        if (result == ABK_CALIB_OK) {
+                            ABK_serial_printf("calib.vfd_us %lu\r\n", calib.vfd_us);
+
+                            // Pending until saved, like any other setting
+                            tmp_lead->vfd = (calib.vfd_us + 500) / 1000;
+                            if (calib.brake) {
+                                ABK_serial_printf("calib.brake_us %lu\r\n", calib.brake_us);
+                                tmp_lead->brake = (calib.brake_us + 500) / 1000;
+                            } else {
+                                ABK_serial_printf("calib.brake_us unavailable\r\n");
+                            }
+                            ABK_serial_printf("lead.brake %d\r\nlead.vfd %d\r\n", tmp_lead->brake, tmp_lead->vfd);
+                        }
                     } else if (cmd == "save") {
                         ABK_config_mutex.lock();
 
-                        tmp_config.state = 1;
+                        tmp_config->state = 1;
 
-                        if (ABK_eeprom_write_config(&eeprom, &tmp_config))
-                            USBport.printf("config saved to EEPROM.\r\n");
+                        if (tmp_cue) {
+                            if (ABK_eeprom_write_cue(&eeprom, tmp_cue, (int) (axis - ABK_axes), cue))
+                                ABK_serial_printf("cue saved to EEPROM.\r\n");
+                            else
+                                ABK_serial_printf("error occured during writing to EEPROM.\r\n");
+                        } else if (ABK_eeprom_write_config(&eeprom, tmp_config, (int) (axis - ABK_axes))
+                                && ABK_eeprom_write_lead(&eeprom, tmp_lead, (int) (axis - ABK_axes)))
+                            ABK_serial_printf("config saved to EEPROM.\r\n");
                         else
-                            USBport.printf("error occured during writing to EEPROM.\r\n");
+                            ABK_serial_printf("error occured during writing to EEPROM.\r\n");
 
                         ABK_config_mutex.unlock();
                     } else if (cmd == "erase") {
                         ABK_config_mutex.lock();
 
-                        if (ABK_eeprom_erase_config(&eeprom))
-                            USBport.printf("config erased EEPROM.\r\n");
+                        if (tmp_cue) {
+                            if (ABK_eeprom_erase_cue(&eeprom, (int) (axis - ABK_axes), cue))
+                                ABK_serial_printf("cue erased from EEPROM.\r\n");
+                            else
+                                ABK_serial_printf("error occured during erasing.\r\n");
+                        } else if (ABK_eeprom_erase_config(&eeprom, (int) (axis - ABK_axes)))
+                            ABK_serial_printf("config erased EEPROM.\r\n");
                         else
-                            USBport.printf("error occured during erasing.\r\n");
+                            ABK_serial_printf("error occured during erasing.\r\n");
 
                         ABK_config_mutex.unlock();
                     } else if (cmd == "reset") {
                         ABK_reset = true;
+                        ABK_supervisor_sem.release();
                     } else if (cmd == "slowfeed") {
-                        ABK_slowfeed = ABK_SLOWFEED_NONE;
+                        axis->slowfeed = ABK_SLOWFEED_NONE;
                         if (strcmp(opt_str, "forward") == 0) {
-                            ABK_slowfeed = ABK_SLOWFEED_FORWARD;
+                            axis->slowfeed = ABK_SLOWFEED_FORWARD;
                         } else if (strcmp(opt_str, "rewind") == 0) {
-                            ABK_slowfeed = ABK_SLOWFEED_REWIND;
+                            axis->slowfeed = ABK_SLOWFEED_REWIND;
                         }
                     } else if (cmd == "version") {
-                        USBport.printf("%s\r\n", ABK_VERSION);
+                        ABK_serial_printf("%s\r\n", ABK_VERSION);
                     } else if (cmd == "status") {
-                        USBport.printf("status: 0x%x error: 0x%x\r\n", ABK_state, ABK_error);
+                        ABK_serial_printf("status: 0x%x error: 0x%x\r\n", axis->state, axis->error);
+                    } else if (cmd == "subscribe") {
+                        ABK_events_stats_t events_stats;
+
+                        ABK_events_subscribe(nargs < 2 || strcmp(opt_str, "off") != 0);
+                        ABK_events_get_stats(&events_stats);
+
+                        ABK_serial_printf("subscribe.active %d\r\n", events_stats.subscribed);
+                        ABK_serial_printf("events.sent %lu\r\nevents.merged %lu\r\n",
+                                events_stats.sent, events_stats.merged);
+                    } else if (cmd == "axis") {
+                        if (nargs > 1) {
+                            int index = atoi(opt_str);
+
+                            if (index >= 0 && index < ABK_AXES) {
+                                axis = &ABK_axes[index];
+                                tmp_config = (cue == 0) ? &tmp_configs[index] : &tmp_cues[index][cue - 1].profile;
+                                tmp_cue = (cue == 0) ? NULL : &tmp_cues[index][cue - 1];
+                                tmp_lead = &tmp_leads[index];
+                            } else {
+                                ABK_serial_printf("invalid axis: %s.\r\n", opt_str);
+                            }
+                        }
+                        ABK_serial_printf("axis %d\r\n", (int) (axis - ABK_axes));
+                    } else if (cmd == "cue") {
+                        int index = (int) (axis - ABK_axes);
+
+                        if (nargs > 1 && strcmp(opt_str, "arm") == 0) {
+                            if ((axis->state == ABK_STATE_STANDBY || axis->state == ABK_STATE_READY) && !axis->triggered)
+                                axis->rearm = true;
+                            else
+                                ABK_serial_printf("axis running.\r\n");
+                        } else if (nargs > 1) {
+                            int c = atoi(opt_str);
+
+                            if (c >= 0 && c < ABK_CUES) {
+                                cue = c;
+                                tmp_config = (cue == 0) ? &tmp_configs[index] : &tmp_cues[index][cue - 1].profile;
+                                tmp_cue = (cue == 0) ? NULL : &tmp_cues[index][cue - 1];
+                            } else {
+                                ABK_serial_printf("invalid cue: %s.\r\n", opt_str);
+                            }
+                        }
+                        ABK_serial_printf("cue %d\r\ncue.current %d\r\ncue.count %d\r\n", cue, axis->cue, axis->cue_count);
+                    } else if (cmd == "boot") {
+                        for (int i=0; i<ABK_BOOT_PHASE_COUNT; i++) {
+                            if (ABK_boot_reached(i))
+                                ABK_serial_printf("boot.%s_us %lu\r\n", ABK_boot_phase_name(i), ABK_boot_times[i]);
+                            else
+                                ABK_serial_printf("boot.%s_us none\r\n", ABK_boot_phase_name(i));
+                        }
+#if ABK_HAS_CAN
+                    } else if (cmd == "can") {
+                        if (nargs > 2 && strcmp(opt_str, "node") == 0) {
+                            ABK_config_mutex.lock();
+                            if (ABK_can_set_node(&eeprom, (uint8_t) args))
+                                ABK_serial_printf("node saved, reset to apply.\r\n");
+                            else
+                                ABK_serial_printf("error occured during writing to EEPROM.\r\n");
+                            ABK_config_mutex.unlock();
+                        } else if (nargs > 1 && strcmp(opt_str, "cue") == 0) {
+                            if (!ABK_can_send_cue((nargs > 2) ? (uint8_t) args : 1))
+                                ABK_serial_printf("unable to send cue.\r\n");
+                        } else {
+                            const ABK_can_sync_t *sync = ABK_can_get_sync();
+                            uint8_t last_cue = ABK_can_get_last_cue();
+                            int skew_min = INT16_MAX, skew_max = INT16_MIN;
+
+                            ABK_serial_printf("can.node %d\r\ncan.synced %d\r\n", ABK_can_get_node(), sync->synced);
+                            ABK_serial_printf("can.syncs %lu\r\ncan.drift_ppm %d\r\n",
+                                    sync->syncs, (int) (sync->drift * 1000000.0));
+                            ABK_serial_printf("can.residual_us %ld\r\ncan.worst_residual_us %ld\r\n",
+                                    sync->residual, sync->worst_residual);
+                            ABK_serial_printf("can.cue %d\r\n", last_cue);
+
+                            // Skew of each unit for the last cue: interrupt lateness + sync error
+                            for (int i=0; i<ABK_CAN_MAX_NODES; i++) {
+                                const ABK_can_report_t *report = ABK_can_get_report(i);
+                                if (!report->synced || report->cue != last_cue)
+                                    continue;
+
+                                int skew = report->fire_late + report->residual;
+                                if (skew < skew_min)
+                                    skew_min = skew;
+                                if (skew > skew_max)
+                                    skew_max = skew;
+
+                                ABK_serial_printf("node%d.fire_late_us %d\r\nnode%d.residual_us %d\r\n",
+                                        i, report->fire_late, i, report->residual);
+                            }
+                            if (skew_max >= skew_min)
+                                ABK_serial_printf("can.skew_us %d\r\n", skew_max - skew_min);
+                        }
+#endif
+                    } else if (cmd == "health") {
+                        if (nargs > 1 && strcmp(opt_str, "clear") == 0) {
+                            ABK_supervisor_clear();
+                        }
+
+                        ABK_health_record_t health;
+
+                        core_util_critical_section_enter();
+                        memcpy(&health, &ABK_health, sizeof(ABK_health_record_t));
+                        core_util_critical_section_exit();
+
+                        ABK_serial_printf("wdog_resets %lu\r\n", health.wdog_resets);
+                        ABK_serial_printf("last_culprit %s\r\n", ABK_supervisor_task_name(health.last_culprit));
+                        for (int i=0; i<ABK_TASK_COUNT; i++) {
+                            ABK_serial_printf("%s.missed %lu\r\n%s.worst_late_ms %lu\r\n",
+                                    ABK_supervisor_task_name(i), health.tasks[i].missed,
+                                    ABK_supervisor_task_name(i), health.tasks[i].worst_late_ms);
+                        }
+                    } else if (cmd == "log") {
+                        ABK_log_stats_t log_stats;
+                        ABK_log_get_stats(&log_stats);
+
+                        uint32_t count = (nargs > 1) ? (uint32_t) atoi(opt_str) : 16;
+                        if (count > log_stats.count)
+                            count = log_stats.count;
+
+                        ABK_serial_printf("log.count %lu\r\nlog.capacity %d\r\n", log_stats.count, ABK_LOG_SLOTS);
+                        ABK_serial_printf("log.pending %lu\r\nlog.dropped %lu\r\n", log_stats.pending, log_stats.dropped);
+                        ABK_serial_printf("log.writes %lu\r\nlog.write_errors %lu\r\n",
+                                log_stats.writes, log_stats.write_errors);
+
+                        // Oldest first: seq type axis time_ms duration_ms error
+                        for (uint32_t n=count; n>0; n--) {
+                            ABK_log_record_t record;
+
+                            ABK_supervisor_checkin(ABK_TASK_SERIAL);
+                            if (!ABK_log_get(n - 1, &record))
+                                continue;
+
+                            ABK_serial_printf("log %lu %s %d %lu %lu 0x%02x\r\n", record.seq,
+                                    ABK_log_type_name(record.type), record.axis, record.time,
+                                    record.duration, record.error);
+                        }
+                    } else if (cmd == "diag") {
+                        ABK_diag_result_t result = ABK_DIAG_UNAVAILABLE;
+
+                        if (nargs < 2) {
+                            ABK_serial_printf("misformatted command: %s.\r\n", cmd_buf);
+                        } else if (strcmp(opt_str, "loopback") == 0) {
+                            ABK_diag_loopback_t loopback[ABK_DIAG_LOOPBACK_PAIRS];
+                            int block = (nargs > 2) ? args : 1;
+
+                            result = ABK_diag_loopback(ABK_axes, ABK_AXES, block, ABK_TASK_SERIAL, loopback);
+                            ABK_serial_printf("diag.loopback.result %s\r\n", ABK_diag_result_name(result));
+                            for (int i=0; i<ABK_DIAG_LOOPBACK_PAIRS
+                                    && (result == ABK_DIAG_OK || result == ABK_DIAG_FAILED); i++) {
+                                if (!loopback[i].tested)
+                                    continue;
+
+                                // OUTPUTb_n to INPUTb_n
+                                ABK_serial_printf("diag.loopback.%d_%d %s %lu %lu\r\n", block, i + 1,
+                                        loopback[i].ok ? "ok" : "timeout", loopback[i].rise_us, loopback[i].fall_us);
+                            }
+                        } else if (strcmp(opt_str, "eeprom") == 0) {
+                            ABK_diag_eeprom_t diag;
+
+                            result = ABK_diag_eeprom(&eeprom, &ABK_config_mutex, &diag);
+                            ABK_serial_printf("diag.eeprom.result %s\r\n", ABK_diag_result_name(result));
+                            ABK_serial_printf("diag.eeprom.bytes %lu\r\n", diag.bytes);
+                            ABK_serial_printf("diag.eeprom.write_us %lu\r\ndiag.eeprom.read_us %lu\r\n",
+                                    diag.write_us, diag.read_us);
+                            ABK_serial_printf("diag.eeprom.write_bps %lu\r\ndiag.eeprom.read_bps %lu\r\n",
+                                    diag.write_us ? (uint32_t) ((uint64_t) diag.bytes * 1000000 / diag.write_us) : 0,
+                                    diag.read_us ? (uint32_t) ((uint64_t) diag.bytes * 1000000 / diag.read_us) : 0);
+                            ABK_serial_printf("diag.eeprom.verified %d\r\n", diag.verified);
+                        } else if (strcmp(opt_str, "pwm") == 0) {
+                            ABK_diag_pwm_t diag;
+                            int speed = (nargs > 2) ? args : ABK_DIAG_PWM_SPEED;
+
+                            if (speed >= 0 && speed <= 100)
+                                result = ABK_diag_pwm(&ABK_axes[0], speed, ABK_TASK_SERIAL, &diag);
+
+                            ABK_serial_printf("diag.pwm.result %s\r\n", ABK_diag_result_name(result));
+                            if (result == ABK_DIAG_OK || result == ABK_DIAG_NO_SIGNAL) {
+                                ABK_serial_printf("diag.pwm.edges %lu\r\n", diag.edges);
+                                ABK_serial_printf("diag.pwm.commanded_mhz %lu\r\ndiag.pwm.measured_mhz %lu\r\n",
+                                        diag.commanded_mhz, diag.measured_mhz);
+                                ABK_serial_printf("diag.pwm.error_ppm %ld\r\n", diag.error_ppm);
+                            }
+                        } else if (strcmp(opt_str, "ramp") == 0) {
+                            ABK_diag_ramp_t diag;
+
+                            result = ABK_diag_ramp(axis, (axis == &ABK_axes[0]) ? &feedback_input : NULL,
+                                    ABK_TASK_SERIAL, &diag);
+                            ABK_serial_printf("diag.ramp.result %s\r\n", ABK_diag_result_name(result));
+                            if (result == ABK_DIAG_OK || result == ABK_DIAG_ERROR) {
+                                ABK_serial_printf("diag.ramp.peak_speed %d\r\n", ABK_DIAG_RAMP_SPEED);
+                                ABK_serial_printf("diag.ramp.duration_ms %lu\r\n", diag.duration_ms);
+                                ABK_serial_printf("diag.ramp.feedback_edges %lu\r\n", diag.feedback_edges);
+                            }
+                        } else {
+                            ABK_serial_printf("unrecognized test: %s.\r\n", opt_str);
+                        }
+                    } else if (cmd == "update") {
+                        if (nargs > 1 && strcmp(opt_str, "begin") == 0) {
+                            ABK_serial_update();
+                        } else {
+                            ABK_update_info_t info;
+                            ABK_update_get_info(&info);
+
+                            ABK_serial_printf("update.staged %d\r\nupdate.installed %d\r\n", info.staged, info.installed);
+                            ABK_serial_printf("update.image_size %lu\r\nupdate.image_crc 0x%08lx\r\n",
+                                    info.record.image_size, info.record.image_crc);
+                            ABK_serial_printf("update.slot_size %d\r\n", ABK_UPD_SLOT_SIZE);
+                        }
+                    } else if (cmd == "stats") {
+                        ABK_wakeup_stats_t stats;
+
+                        core_util_critical_section_enter();
+                        memcpy(&stats, &ABK_wakeup_stats, sizeof(ABK_wakeup_stats_t));
+                        memset(&ABK_wakeup_stats, 0, sizeof(ABK_wakeup_stats_t));
+                        int window = ABK_stats_timer.read_ms();
+                        ABK_stats_timer.reset();
+                        core_util_critical_section_exit();
+
+                        ABK_serial_printf("window_ms %d\r\n", window);
+                        ABK_serial_printf("wakeups.serial %lu\r\nwakeups.serial_idle %lu\r\n",
+                                stats.serial_wakeups, stats.serial_idle_wakeups);
+                        ABK_serial_printf("wakeups.supervisor %lu\r\n", stats.supervisor_wakeups);
+                        ABK_serial_printf("idle_ms %lu\r\n", (uint32_t) (stats.idle_us / 1000));
+
+                        ABK_serial_tx_stats_t tx_stats;
+                        ABK_serial_tx_get_stats(&tx_stats);
+
+                        ABK_serial_printf("tx.written %lu\r\ntx.dropped %lu\r\n",
+                                tx_stats.bytes_written, tx_stats.bytes_dropped);
+                        ABK_serial_printf("tx.overflows %lu\r\ntx.max_fill %lu\r\n",
+                                tx_stats.overflows, tx_stats.max_fill);
+
+                        ABK_inputs_stats_t inputs_stats;
+                        ABK_inputs_get_stats(&inputs_stats);
+
+                        ABK_serial_printf("inputs.samples %lu\r\ninputs.changes %lu\r\ninputs.glitches %lu\r\n",
+                                inputs_stats.samples, inputs_stats.changes, inputs_stats.glitches);
+                        ABK_serial_printf("inputs.raw 0x%04lx\r\ninputs.state 0x%04lx\r\n",
+                                inputs_stats.raw, ABK_inputs_read());
+
+                        for (int i=0; i<ABK_AXES; i++) {
+                            ABK_serial_printf("axis%d.tick_us %lu\r\naxis%d.tick_max_us %lu\r\n",
+                                    i, ABK_axes[i].tick_us, i, ABK_axes[i].tick_max_us);
+
+                            // Commanded vs synthesised VFD frequency, in mHz
+                            FreqOut *motor = ABK_axes[i].motor;
+                            ABK_serial_printf("axis%d.freq_mhz %lu\r\naxis%d.freq_out_mhz %lu\r\n",
+                                    i, (uint32_t) (motor->hz() * 1000), i, (uint32_t) (motor->actual_hz() * 1000));
+                            ABK_serial_printf("axis%d.freq_err_max_ppm %lu\r\n", i, motor->max_error_ppm());
+                            motor->clear_error();
+                        }
+
+                        // Ramp interrupt of the PWM output, its share of the CPU at the top frequency
+                        uint32_t isr_load = (uint32_t) ((uint64_t) motor_out.isr_max_cycles()
+                                * (uint32_t) ABK_MOT_MAX_FREQ * 1000 / SystemCoreClock);
+
+                        ABK_serial_printf("vfd_isr.count %lu\r\nvfd_isr.max_cycles %lu\r\n",
+                                motor_out.isr_count(), motor_out.isr_max_cycles());
+                        ABK_serial_printf("vfd_isr.load_permille %lu\r\nvfd_isr.budget_permille %d\r\n",
+                                isr_load, ABK_VFD_ISR_BUDGET);
+                        motor_out.clear_isr_stats();
                     } else if (cmd == "") {
                         // Don't do anything if cmd is empty
                     } else {
-                        USBport.printf("unrecognized command: '%s'. Type 'help' for help\r\n", cmd_buf);
+                        ABK_serial_printf("unrecognized command: '%s'. Type 'help' for help\r\n", cmd_buf);
                     }
                 }
 
@@ -580,8 +932,105 @@ available commands:\r\n\
                 cmd = "\0";
             }
         }
+    }
+}
+
+static void ABK_serial_events(void) {
+    ABK_event_t events[ABK_AXES];
+    int count = ABK_events_take(events);
+
+    for (int i=0; i<count; i++) {
+        ABK_serial_printf("ev %lu %lu %d 0x%x 0x%x %d 0x%02x 0x%02x\r\n", events[i].seq, events[i].time,
+                events[i].axis, events[i].state, events[i].error, events[i].merged, events[i].states,
+                events[i].errors);
+    }
+}
+
+// Blocking read for binary transfers, false once the host stays silent too long
+static bool ABK_serial_read_raw(uint8_t *buf, uint32_t len) {
+    uint32_t last = us_ticker_read();
+
+    for (uint32_t i=0; i<len; ) {
+        ABK_supervisor_checkin(ABK_TASK_SERIAL);
+
+        if (USBport.readable() > 0) {
+            buf[i++] = USBport.getc();
+            last = us_ticker_read();
+        } else if ((us_ticker_read() - last) >= ABK_UPDATE_RX_TIMEOUT * 1000) {
+            return false;
+        } else {
+            ABK_serial_rx_sem.wait(ABK_SERIAL_INTERVAL);
+        }
+    }
+
+    return true;
+}
+
+// Update image transfer, framed as described in ABKupdproto.h and not echoed.
+// The first frame is the header, the console comes back once it is over.
+static void ABK_serial_update(void) {
+    static uint8_t frame[ABK_UPD_FRAME_MAX + ABK_UPD_FRAME_OVERHEAD];
+    ABK_upd_status_t ret = ABK_UPD_OK;
+    ABK_update_progress_t progress;
+    bool started = false;
+    bool finished = false;
+    uint32_t start = us_ticker_read();
+
+    memset(&progress, 0, sizeof(ABK_update_progress_t));
+    ABK_serial_puts("update.ready\r\n");
+
+    while (!finished) {
+        if (!ABK_serial_read_raw(frame, 2)) {
+            ret = ABK_UPD_TIMEOUT;
+            break;
+        }
+
+        uint32_t len = frame[0] | (frame[1] << 8);
+        if (len == 0 || len > ABK_UPD_FRAME_MAX) { // Framing lost
+            ret = ABK_UPD_CORRUPT;
+            break;
+        }
 
+        if (!ABK_serial_read_raw(frame + 2, len + 4)) {
+            ret = ABK_UPD_TIMEOUT;
+            break;
+        }
 
-        Thread::wait(ABK_SERIAL_INTERVAL);
+        uint8_t *data = frame + 2;
+        uint32_t crc = data[len] | (data[len + 1] << 8) | (data[len + 2] << 16) | ((uint32_t) data[len + 3] << 24);
+        if (ABK_upd_crc32(0, data, len) != crc) {
+            ABK_serial_printf("update.nak %lu\r\n", progress.payload);
+            continue;
+        }
+
+        if (!started) {
+            ret = (len == ABK_UPD_HEADER_SIZE) ? ABK_update_begin(data, ABK_axes, ABK_AXES, ABK_TASK_SERIAL)
+                : ABK_UPD_BAD_HEADER;
+            started = (ret == ABK_UPD_OK);
+        } else {
+            ret = ABK_update_write(data, len);
+        }
+
+        if (started)
+            ABK_update_get_progress(&progress);
+        if (ret != ABK_UPD_OK)
+            break;
+
+        if (ABK_update_complete()) {
+            ret = ABK_update_finish();
+            finished = true;
+        } else {
+            ABK_serial_printf("update.ack %lu\r\n", progress.payload);
+        }
     }
+
+    if (!finished)
+        ABK_update_abort();
+
+    // The result line ends the transfer for the host
+    ABK_serial_printf("update.payload_bytes %lu\r\nupdate.image_bytes %lu\r\n", progress.payload, progress.image);
+    ABK_serial_printf("update.erase_ms %lu\r\nupdate.time_ms %lu\r\n", progress.erase_ms,
+            (us_ticker_read() - start) / 1000);
+    ABK_serial_printf("update.result %s\r\n", ABK_upd_status_name(ret));
 }
+#endif
@@ -12,15 +12,25 @@
 
 #include "watchdog.h"
 
+#include "ABKboot.h"
+#include "ABKcalib.h"
+#if ABK_HAS_CAN
+#include "ABKcan.h"
+#endif
 #include "ABKcontrol.h"
+#include "ABKdiag.h"
+#include "ABKevents.h"
+#include "ABKinputs.h"
+#include "ABKlog.h"
+#include "ABKserial.h"
+#include "ABKsupervisor.h"
+#include "ABKtest.h"
+#include "ABKupdate.h"
+#include "ABKvariant.h"
 #include "pins.h"
 
 #include "mbed.h"
 
-#if ABK_HAS_LCD
-#include "TextLCD.h"
-#endif
-
 #if ABK_HAS_EEPROM
 #include "AT24Cxx_I2C.h"
 #endif
@@ -29,14 +39,30 @@
 #include "USBSerial.h"
 #endif
 
-#if defined(ABK_DEBUG) && (ABK_DEBUG != 0)
-#define DEBUG_PRINTF(...) (printf(__VA_ARGS__))
-#else
-#define DEBUG_PRINTF(...) (0)
-#endif
+typedef struct {
+    uint32_t serial_wakeups;        // Serial thread wake-ups
+    uint32_t serial_idle_wakeups;   // Serial thread wake-ups with nothing to read
+    uint32_t supervisor_wakeups;    // Supervisor (main) wake-ups
+    uint64_t idle_us;               // Time spent sleeping in the idle thread
+} ABK_wakeup_stats_t;
 
+static void ABK_print_banner(void);
+#if !ABK_TEST
 static void ABK_leds_task(void);
+#endif
+static void ABK_idle_hook(void);
+#if ABK_HAS_CONTROL
 static void ABK_app_task(void);
+#if ABK_HAS_CAN
+static void ABK_app_wake(void);
+#endif
 static void ABK_serial_task(void);
+static void ABK_serial_wake(void);
+static void ABK_serial_events(void);
+static bool ABK_serial_read_raw(uint8_t *buf, uint32_t len);
+static void ABK_serial_update(void);
+static void ABK_serial_rx_isr(void);
+static void ABK_supervisor_isr(void);
+#endif
 
 #endif /* !MAIN_H */
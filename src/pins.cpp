@@ -0,0 +1,34 @@
+/*
+ * pins.cpp
+ * Copyright (C) 2017 Benoit Rapidel <benoit.rapidel+devs@exmachina.fr>
+ *
+ * Distributed under terms of the MIT license.
+ */
+
+#include "pins.h"
+
+// Leds
+DigitalOut led1(LED1);
+DigitalOut led2(LED2);
+
+DigitalOut led_sts(LED_STS);
+DigitalOut led_err(LED_ERR);
+
+// Inputs, the control inputs are sampled by ABKinputs
+DigitalIn feedback_input(ABK_FEEDBACK_INPUT);
+
+#if ABK_SIMULATE
+bool ac_trigger;
+#endif
+
+// Outputs
+DigitalOut dir_fw(CTL_FW_DIR);
+DigitalOut dir_rw(CTL_RW_DIR);
+// DigitalOut brake(CTL_BRAKE);
+bool brake;
+
+#if ABK_AXES > 1
+DigitalOut dir_fw_2(CTL_FW_DIR_2);
+DigitalOut dir_rw_2(CTL_RW_DIR_2);
+bool brake_2;
+#endif
@@ -53,6 +53,8 @@
 
 #define CAN1_RXD        P0_0
 #define CAN1_TXD        P0_1
+#define CAN2_RXD        P0_4
+#define CAN2_TXD        P0_5
 
 // Application specific IO map
 
@@ -71,40 +73,54 @@
 #define LED_ERR         OUTPUT2_2
 
 #define CTL_PWM_VFD     OUTPUT3_1
+#define CTL_PWM_VFD_CHANNEL (6)     // P1.26 is PWM1.6
+
+// CAN1 shares P0_0 with CTL_FW_DIR
+#define ABK_CAN_RXD     CAN2_RXD
+#define ABK_CAN_TXD     CAN2_TXD
+
+// Drum motion feedback used to calibrate the actuator lead times of axis 1
+#define ABK_FEEDBACK_INPUT ENC_A
+
+// Spare pin, the VFD frequency output is wired to it to check its accuracy (diag pwm)
+#define ABK_DIAG_CAPTURE P1_19      // CAP1.1
+
+// Second axis: status LEDs use OUTPUT2_1/2, brake isn't wired (as on axis 1)
+#define SLOWFEED_FW_2   INPUT2_1
+#define SLOWFEED_RW_2   INPUT2_2
+#define VFD_STS_2       INPUT2_3
+#define TRIGGER_INPUT_2 INPUT2_4
+
+#define CTL_FW_DIR_2    OUTPUT1_4
+#define CTL_RW_DIR_2    OUTPUT2_3
+#define CTL_FREQ_VFD_2  OUTPUT2_4   // P1.22 is MAT1.0, driven by TimerFreqOut
 
 #define ISP_RXD         P0_3
 #define ISP_TXD         P0_2
 #define USBRX           ISP_RXD
 #define USBTX           ISP_TXD
 
-// Leds
-DigitalOut led1(LED1);
-DigitalOut led2(LED2);
+// Objects, defined in pins.cpp
+extern DigitalOut led1;
+extern DigitalOut led2;
 
-DigitalOut led_sts(LED_STS);
-DigitalOut led_err(LED_ERR);
-#if ABK_TEST
-DigitalOut output1_4(OUTPUT1_4);
-#endif
+extern DigitalOut led_sts;
+extern DigitalOut led_err;
 
-// Inputs
-DigitalIn slowfeed_fw_input(SLOWFEED_FW);
-DigitalIn slowfeed_rw_input(SLOWFEED_RW);
-DigitalIn drive_status(VFD_STS);
-DigitalIn emergency_stop(EMERGENCY_STOP);
+extern DigitalIn feedback_input;
 
 #if ABK_SIMULATE
-bool ac_trigger;
-#else
-DigitalIn ac_trigger(TRIGGER_INPUT);
+extern bool ac_trigger;
 #endif
 
-// Outputs
-DigitalOut dir_fw(CTL_FW_DIR);
-DigitalOut dir_rw(CTL_RW_DIR);
-// DigitalOut brake(CTL_BRAKE);
-bool brake;
+extern DigitalOut dir_fw;
+extern DigitalOut dir_rw;
+extern bool brake;
 
-PwmOut motor_ctl(CTL_PWM_VFD);
+#if ABK_AXES > 1
+extern DigitalOut dir_fw_2;
+extern DigitalOut dir_rw_2;
+extern bool brake_2;
+#endif
 
 #endif /* !PINS_H */
@@ -0,0 +1,70 @@
+/*
+ * ABKiap.cpp
+ * Copyright (C) 2017 Benoit Rapidel <benoit.rapidel+devs@exmachina.fr>
+ *
+ * Distributed under terms of the MIT license.
+ */
+
+#include "ABKiap.h"
+
+#include "ABKupdproto.h"
+
+#include <string.h>
+
+#include "cmsis.h"
+
+#define ABK_IAP_LOCATION        (0x1FFF1FF1)
+
+#define ABK_IAP_PREPARE         (50)
+#define ABK_IAP_COPY            (51)
+#define ABK_IAP_ERASE           (52)
+#define ABK_IAP_SUCCESS         (0)
+
+typedef void (*ABK_iap_entry_t)(uint32_t *command, uint32_t *result);
+
+static uint32_t ABK_iap_call(uint32_t *command) {
+    ABK_iap_entry_t entry = (ABK_iap_entry_t) ABK_IAP_LOCATION;
+    uint32_t result[5];
+
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    entry(command, result);
+    __set_PRIMASK(primask);
+
+    return result[0];
+}
+
+static bool ABK_iap_prepare(int first, int last) {
+    uint32_t command[5] = { ABK_IAP_PREPARE, (uint32_t) first, (uint32_t) last };
+
+    return ABK_iap_call(command) == ABK_IAP_SUCCESS;
+}
+
+bool ABK_iap_erase(uint32_t start, uint32_t end) {
+    int first = ABK_upd_sector(start);
+    int last = ABK_upd_sector(end - 1);
+
+    // One sector per call, so interrupts come back in between
+    for (int i=first; i<=last; i++) {
+        uint32_t command[5] = { ABK_IAP_ERASE, (uint32_t) i, (uint32_t) i, SystemCoreClock / 1000 };
+
+        if (!ABK_iap_prepare(i, i) || ABK_iap_call(command) != ABK_IAP_SUCCESS)
+            return false;
+    }
+
+    return true;
+}
+
+bool ABK_iap_write(uint32_t address, const uint8_t *buf) {
+    int sector = ABK_upd_sector(address);
+    uint32_t command[5] = { ABK_IAP_COPY, address, (uint32_t) buf, ABK_IAP_BLOCK_SIZE, SystemCoreClock / 1000 };
+
+    if (!ABK_iap_prepare(sector, sector) || ABK_iap_call(command) != ABK_IAP_SUCCESS)
+        return false;
+
+    return memcmp(ABK_iap_map(address), buf, ABK_IAP_BLOCK_SIZE) == 0;
+}
+
+const uint8_t *ABK_iap_map(uint32_t address) {
+    return (const uint8_t *) address;
+}
@@ -0,0 +1,28 @@
+/*
+ * ABKiap.h
+ * Copyright (C) 2017 Benoit Rapidel <benoit.rapidel+devs@exmachina.fr>
+ *
+ * Distributed under terms of the MIT license.
+ */
+
+#ifndef ABKIAP_H
+#define ABKIAP_H
+
+// LPC17xx in-application programming through the boot ROM. The flash can't be
+// read while it is erased or written, so interrupts are off for the duration
+// of each call: up to ~100ms for a 32KB sector, ~1ms for a block write.
+// The host simulation provides its own implementation over a file.
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define ABK_IAP_BLOCK_SIZE      (1024)  // Bytes per write: 256, 512, 1024 or 4096
+
+// Erases every sector from the one holding start to the one holding end - 1
+bool ABK_iap_erase(uint32_t start, uint32_t end);
+// Writes ABK_IAP_BLOCK_SIZE bytes from word aligned RAM to an erased, aligned address
+bool ABK_iap_write(uint32_t address, const uint8_t *buf);
+// Flash contents, memory mapped on the target
+const uint8_t *ABK_iap_map(uint32_t address);
+
+#endif /* !ABKIAP_H */
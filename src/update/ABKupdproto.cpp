@@ -0,0 +1,259 @@
+/*
+ * ABKupdproto.cpp
+ * Copyright (C) 2017 Benoit Rapidel <benoit.rapidel+devs@exmachina.fr>
+ *
+ * Distributed under terms of the MIT license.
+ */
+
+#include "ABKupdproto.h"
+
+#include <string.h>
+
+typedef enum {
+    ABK_UPD_STATE_TOKEN = 0,
+    ABK_UPD_STATE_LITERAL,
+    ABK_UPD_STATE_LENGTH,
+    ABK_UPD_STATE_OFFSET,
+} ABK_upd_state_t;
+
+// Reflected 0xEDB88320 a nibble at a time, small enough for the bootloader
+static const uint32_t ABK_upd_crc_table[16] = {
+    0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+    0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C, 0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C,
+};
+
+static uint32_t ABK_upd_crc_byte(uint32_t crc, uint8_t byte) {
+    crc ^= byte;
+    crc = (crc >> 4) ^ ABK_upd_crc_table[crc & 0x0F];
+    crc = (crc >> 4) ^ ABK_upd_crc_table[crc & 0x0F];
+    return crc;
+}
+
+uint32_t ABK_upd_crc32(uint32_t crc, const uint8_t *buf, uint32_t len) {
+    crc = ~crc;
+    for (uint32_t i=0; i<len; i++)
+        crc = ABK_upd_crc_byte(crc, buf[i]);
+
+    return ~crc;
+}
+
+static void ABK_upd_put_u32(uint8_t *buf, uint32_t value) {
+    buf[0] = value & 0xFF;
+    buf[1] = (value >> 8) & 0xFF;
+    buf[2] = (value >> 16) & 0xFF;
+    buf[3] = (value >> 24) & 0xFF;
+}
+
+static uint32_t ABK_upd_get_u32(const uint8_t *buf) {
+    return buf[0] | (buf[1] << 8) | (buf[2] << 16) | ((uint32_t) buf[3] << 24);
+}
+
+void ABK_upd_encode_header(uint8_t *buf, const ABK_upd_header_t *header) {
+    memset(buf, 0, ABK_UPD_HEADER_SIZE);
+    ABK_upd_put_u32(&buf[0], ABK_UPD_MAGIC);
+    buf[4] = ABK_UPD_VERSION;
+    ABK_upd_put_u32(&buf[8], header->image_size);
+    ABK_upd_put_u32(&buf[12], header->image_crc);
+    ABK_upd_put_u32(&buf[16], header->base_size);
+    ABK_upd_put_u32(&buf[20], header->base_crc);
+    ABK_upd_put_u32(&buf[24], header->payload_size);
+    ABK_upd_put_u32(&buf[28], ABK_upd_crc32(0, buf, 28));
+}
+
+bool ABK_upd_decode_header(const uint8_t *buf, ABK_upd_header_t *header) {
+    memset(header, 0, sizeof(ABK_upd_header_t));
+
+    if (ABK_upd_get_u32(&buf[0]) != ABK_UPD_MAGIC || buf[4] != ABK_UPD_VERSION
+            || ABK_upd_get_u32(&buf[28]) != ABK_upd_crc32(0, buf, 28))
+        return false;
+
+    header->image_size = ABK_upd_get_u32(&buf[8]);
+    header->image_crc = ABK_upd_get_u32(&buf[12]);
+    header->base_size = ABK_upd_get_u32(&buf[16]);
+    header->base_crc = ABK_upd_get_u32(&buf[20]);
+    header->payload_size = ABK_upd_get_u32(&buf[24]);
+
+    return true;
+}
+
+void ABK_upd_encode_record(uint8_t *buf, const ABK_upd_record_t *record) {
+    ABK_upd_put_u32(&buf[0], ABK_UPD_RECORD_MAGIC);
+    ABK_upd_put_u32(&buf[4], record->image_size);
+    ABK_upd_put_u32(&buf[8], record->image_crc);
+    ABK_upd_put_u32(&buf[12], ABK_upd_crc32(0, buf, 12));
+}
+
+// Blank or torn records fail
+bool ABK_upd_decode_record(const uint8_t *buf, ABK_upd_record_t *record) {
+    memset(record, 0, sizeof(ABK_upd_record_t));
+
+    if (ABK_upd_get_u32(&buf[0]) != ABK_UPD_RECORD_MAGIC
+            || ABK_upd_get_u32(&buf[12]) != ABK_upd_crc32(0, buf, 12))
+        return false;
+
+    record->image_size = ABK_upd_get_u32(&buf[4]);
+    record->image_crc = ABK_upd_get_u32(&buf[8]);
+
+    return record->image_size > 0 && record->image_size <= ABK_UPD_SLOT_SIZE;
+}
+
+void ABK_upd_decoder_init(ABK_upd_decoder_t *dec, const ABK_upd_header_t *header,
+        ABK_upd_read_t read_base, ABK_upd_read_t read_image, ABK_upd_write_t write, void *ctx) {
+    memset(dec, 0, sizeof(ABK_upd_decoder_t));
+
+    dec->read_base = read_base;
+    dec->read_image = read_image;
+    dec->write = write;
+    dec->ctx = ctx;
+    dec->base_size = header->base_size;
+    dec->image_size = header->image_size;
+    dec->crc = 0xFFFFFFFF;
+}
+
+static bool ABK_upd_emit(ABK_upd_decoder_t *dec, uint8_t byte) {
+    if (!dec->write(dec->ctx, byte))
+        return false;
+
+    dec->crc = ABK_upd_crc_byte(dec->crc, byte);
+    dec->written++;
+    return true;
+}
+
+static ABK_upd_status_t ABK_upd_copy(ABK_upd_decoder_t *dec) {
+    bool from_base = (dec->token & 0x40) != 0;
+    uint32_t src;
+
+    if (dec->length > dec->image_size - dec->written)
+        return ABK_UPD_CORRUPT;
+
+    if (from_base) {
+        // Zigzag: even values are positive
+        int32_t delta = (dec->value & 1) ? -(int32_t) (dec->value >> 1) - 1 : (int32_t) (dec->value >> 1);
+
+        src = dec->written + delta;
+        if ((delta < 0 && (uint32_t) -delta > dec->written) || src >= dec->base_size
+                || dec->length > dec->base_size - src)
+            return ABK_UPD_CORRUPT;
+    } else {
+        if (dec->value == 0 || dec->value > dec->written)
+            return ABK_UPD_CORRUPT;
+        src = dec->written - dec->value;
+    }
+
+    for (uint32_t i=0; i<dec->length; i++) {
+        uint8_t byte = from_base ? dec->read_base(dec->ctx, src + i) : dec->read_image(dec->ctx, src + i);
+
+        if (!ABK_upd_emit(dec, byte))
+            return ABK_UPD_FLASH;
+    }
+
+    return ABK_UPD_OK;
+}
+
+// Accumulates a varint into value, true once its last byte is in
+static bool ABK_upd_varint(ABK_upd_decoder_t *dec, uint8_t byte, bool *error) {
+    if (dec->shift > 28) {
+        *error = true;
+        return false;
+    }
+
+    dec->value |= (uint32_t) (byte & 0x7F) << dec->shift;
+    dec->shift += 7;
+    return (byte & 0x80) == 0;
+}
+
+ABK_upd_status_t ABK_upd_decode(ABK_upd_decoder_t *dec, const uint8_t *buf, uint32_t len) {
+    ABK_upd_status_t ret;
+    bool error = false;
+
+    for (uint32_t i=0; i<len; i++) {
+        uint8_t byte = buf[i];
+
+        switch (dec->state) {
+            case ABK_UPD_STATE_TOKEN:
+                dec->token = byte;
+                dec->value = 0;
+                dec->shift = 0;
+
+                if (byte < 0x80) {
+                    dec->length = byte + 1;
+                    dec->state = ABK_UPD_STATE_LITERAL;
+                } else {
+                    dec->length = (byte & 0x3F) + ABK_UPD_MIN_MATCH;
+                    dec->state = ((byte & 0x3F) == 0x3F) ? ABK_UPD_STATE_LENGTH : ABK_UPD_STATE_OFFSET;
+                }
+                break;
+
+            case ABK_UPD_STATE_LITERAL:
+                if (dec->written >= dec->image_size)
+                    return ABK_UPD_CORRUPT;
+                if (!ABK_upd_emit(dec, byte))
+                    return ABK_UPD_FLASH;
+                if (--dec->length == 0)
+                    dec->state = ABK_UPD_STATE_TOKEN;
+                break;
+
+            case ABK_UPD_STATE_LENGTH:
+                if (ABK_upd_varint(dec, byte, &error)) {
+                    dec->length += dec->value;
+                    dec->value = 0;
+                    dec->shift = 0;
+                    dec->state = ABK_UPD_STATE_OFFSET;
+                }
+                break;
+
+            case ABK_UPD_STATE_OFFSET:
+                if (ABK_upd_varint(dec, byte, &error)) {
+                    ret = ABK_upd_copy(dec);
+                    if (ret != ABK_UPD_OK)
+                        return ret;
+                    dec->state = ABK_UPD_STATE_TOKEN;
+                }
+                break;
+        }
+
+        if (error)
+            return ABK_UPD_CORRUPT;
+    }
+
+    return ABK_UPD_OK;
+}
+
+ABK_upd_status_t ABK_upd_decoder_finish(ABK_upd_decoder_t *dec, const ABK_upd_header_t *header) {
+    if (dec->state != ABK_UPD_STATE_TOKEN || dec->written != header->image_size)
+        return ABK_UPD_CORRUPT;
+
+    return (~dec->crc == header->image_crc) ? ABK_UPD_OK : ABK_UPD_CRC;
+}
+
+int ABK_upd_sector(uint32_t address) {
+    if (address < 0x10000)
+        return address >> 12;
+
+    return 16 + ((address - 0x10000) >> 15);
+}
+
+const char *ABK_upd_status_name(int status) {
+    switch (status) {
+        case ABK_UPD_OK:
+            return "ok";
+        case ABK_UPD_BUSY:
+            return "busy";
+        case ABK_UPD_BAD_HEADER:
+            return "bad_header";
+        case ABK_UPD_TOO_BIG:
+            return "too_big";
+        case ABK_UPD_BASE_MISMATCH:
+            return "base_mismatch";
+        case ABK_UPD_CORRUPT:
+            return "corrupt";
+        case ABK_UPD_CRC:
+            return "crc";
+        case ABK_UPD_FLASH:
+            return "flash";
+        case ABK_UPD_TIMEOUT:
+            return "timeout";
+    }
+
+    return "unknown";
+}
@@ -0,0 +1,130 @@
+/*
+ * ABKupdproto.h
+ * Copyright (C) 2017 Benoit Rapidel <benoit.rapidel+devs@exmachina.fr>
+ *
+ * Distributed under terms of the MIT license.
+ */
+
+#ifndef ABKUPDPROTO_H
+#define ABKUPDPROTO_H
+
+// Firmware update images and flash layout. Shared by the application, the
+// bootloader (boot/) and the host tools, so it stays free of mbed dependencies.
+//
+// Flash (LPC1768, 512KB):
+//   0x00000  sectors 0-14   bootloader
+//   0x0F000  sector 15      update record
+//   0x10000  sectors 16-22  application, linked here
+//   0x48000  sectors 23-29  staging, where the application writes the next image
+//
+// The application decodes the incoming image into staging, checks it and
+// writes the update record. At the next reset the bootloader copies staging
+// over the application, checks it and marks the record done: staging stays
+// intact until then, an interrupted copy is simply done again.
+//
+// An update image is a header followed by a compressed payload, a sequence of:
+//   0x00-0x7F  literal, token + 1 bytes follow
+//   0x80-0xBF  copy from the image being written
+//   0xC0-0xFF  copy from the running image (delta)
+// Copies are (token & 0x3F) + ABK_UPD_MIN_MATCH bytes long, 0x3F adds a varint
+// to that. An image copy is followed by its distance back from the write
+// position, a running image copy by its offset from the write position, zigzag
+// encoded. Varints are 7 bits per byte, least significant first.
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define ABK_UPD_FLASH_SIZE      (0x80000)
+#define ABK_UPD_BOOT_START      (0x00000)
+#define ABK_UPD_RECORD_ADDRESS  (0x0F000)
+#define ABK_UPD_APP_START       (0x10000)
+#define ABK_UPD_STAGING_START   (0x48000)
+#define ABK_UPD_SLOT_SIZE       (0x38000)   // 224KB, largest image
+
+#define ABK_UPD_MAGIC           (0x554B4241) // "ABKU"
+#define ABK_UPD_VERSION         (1)
+#define ABK_UPD_HEADER_SIZE     (32)
+#define ABK_UPD_MIN_MATCH       (4)
+
+// Serial transfer: frames of u16 length, data and u32 CRC-32 of the data, all
+// little-endian. Each frame is answered by "update.ack TOTAL", "update.nak TOTAL"
+// (send it again) or "update.result NAME" once the transfer is over.
+#define ABK_UPD_FRAME_MAX       (1024)
+#define ABK_UPD_FRAME_OVERHEAD  (6)
+
+#define ABK_UPD_RECORD_MAGIC    (0x524B4241) // "ABKR"
+#define ABK_UPD_RECORD_SIZE     (16)
+#define ABK_UPD_DONE_OFFSET     (1024)      // Own write block, programmed by the bootloader once installed
+
+typedef enum {
+    ABK_UPD_OK = 0,
+    ABK_UPD_BUSY,               // An axis is running or locked
+    ABK_UPD_BAD_HEADER,
+    ABK_UPD_TOO_BIG,
+    ABK_UPD_BASE_MISMATCH,      // Delta made against another image than the running one
+    ABK_UPD_CORRUPT,            // Payload doesn't decode to the image
+    ABK_UPD_CRC,                // Decoded or written image doesn't match
+    ABK_UPD_FLASH,              // Erase or write failed
+    ABK_UPD_TIMEOUT,
+    ABK_UPD_STATUS_END
+} ABK_upd_status_t;
+
+typedef struct {
+    uint32_t image_size;
+    uint32_t image_crc;
+    uint32_t base_size;         // 0 without delta
+    uint32_t base_crc;
+    uint32_t payload_size;
+} ABK_upd_header_t;
+
+typedef struct {
+    uint32_t image_size;
+    uint32_t image_crc;
+} ABK_upd_record_t;
+
+// Byte of the running image, or of the image already written, at offset
+typedef uint8_t (*ABK_upd_read_t)(void *ctx, uint32_t offset);
+// Appends one byte to the image
+typedef bool (*ABK_upd_write_t)(void *ctx, uint8_t byte);
+
+typedef struct {
+    ABK_upd_read_t read_base;
+    ABK_upd_read_t read_image;
+    ABK_upd_write_t write;
+    void *ctx;
+    uint32_t base_size;
+    uint32_t image_size;
+
+    uint32_t written;
+    uint32_t crc;               // Running, inverted
+
+    // Op being parsed
+    uint8_t state;
+    uint8_t token;
+    uint8_t shift;
+    uint32_t length;
+    uint32_t value;
+} ABK_upd_decoder_t;
+
+// Chainable, starts from 0
+uint32_t ABK_upd_crc32(uint32_t crc, const uint8_t *buf, uint32_t len);
+
+void ABK_upd_encode_header(uint8_t *buf, const ABK_upd_header_t *header);
+bool ABK_upd_decode_header(const uint8_t *buf, ABK_upd_header_t *header);
+
+void ABK_upd_encode_record(uint8_t *buf, const ABK_upd_record_t *record);
+bool ABK_upd_decode_record(const uint8_t *buf, ABK_upd_record_t *record);
+
+void ABK_upd_decoder_init(ABK_upd_decoder_t *dec, const ABK_upd_header_t *header,
+        ABK_upd_read_t read_base, ABK_upd_read_t read_image, ABK_upd_write_t write, void *ctx);
+// Payload bytes in any chunks, ABK_UPD_CORRUPT or ABK_UPD_FLASH stop it
+ABK_upd_status_t ABK_upd_decode(ABK_upd_decoder_t *dec, const uint8_t *buf, uint32_t len);
+// Whole image written and matching its CRC
+ABK_upd_status_t ABK_upd_decoder_finish(ABK_upd_decoder_t *dec, const ABK_upd_header_t *header);
+
+// First sector of an address, sectors are 4KB up to 0x10000 then 32KB
+int ABK_upd_sector(uint32_t address);
+
+const char *ABK_upd_status_name(int status);
+
+#endif /* !ABKUPDPROTO_H */
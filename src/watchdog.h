@@ -23,6 +23,13 @@ public:
         LPC_WDT->WDFEED = 0xAA;
         LPC_WDT->WDFEED = 0x55;
     }
+
+    // True if the last reset was caused by a watchdog timeout, clears the flag
+    bool caused_reset() {
+        bool res = (LPC_WDT->WDMOD & 0x4) != 0; // WDTOF
+        LPC_WDT->WDMOD &= ~0x4;
+        return res;
+    }
 };
 
 #endif
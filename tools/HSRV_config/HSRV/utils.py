@@ -18,6 +18,7 @@ HSRV_STATE = {
         4: 'RUN',
         5: 'SLOWFEED',
         6: 'RESET',
+        7: 'CALIBRATION',
         }
 
 
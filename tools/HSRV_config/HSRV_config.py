@@ -222,6 +222,10 @@ class HSRVConfig(QMainWindow):
             return
 
         try:
+            data = self.parseEvents(data)
+            if not len(data):
+                return
+
             if data[0] == b'version\n':
                 if len(data) > 1:
                     version = data[1]
@@ -234,13 +238,18 @@ class HSRVConfig(QMainWindow):
                     self.main.findChild(QPushButton, 'connectButton').setText('Disconnect')
                     self._connected = True
                     QTimer.singleShot(50, self.doDeviceGet)
-                    QTimer.singleShot(500, self.doDeviceStatus)
                     try:
                         self._connectedVersion = [int(x) for x in version.decode().strip('v').split('.')]
                     except Exception:
                         self.doDisconnect()
                         self.setStatusMessage('Unable to connect to device.')
 
+                    # Newer units push every state change, older ones are asked once
+                    if self.hasEvents():
+                        QTimer.singleShot(500, partial(self.serialSend, b'subscribe\n'))
+                    else:
+                        QTimer.singleShot(500, self.doDeviceStatus)
+
                     self.enableActions()
                 else:
                     self.setStatusMessage('Unable to connect.')
@@ -275,6 +284,29 @@ class HSRVConfig(QMainWindow):
         except IndexError:
             self.setStatusMessage('Bad response from device.')
 
+    # ev SEQ TIME_MS AXIS STATE ERROR MERGED STATES ERRORS, can come with any reply
+    def parseEvents(self, data):
+        others = []
+
+        for line in data:
+            if not line.startswith(b'ev '):
+                others.append(line)
+                continue
+
+            d = line.decode().strip('\r\n').split()
+            if len(d) < 6 or d[3] != '0':
+                continue
+
+            self.main.findChild(QLineEdit, 'statusLineEdit').setText(
+                    HSRV_get_status_text(int(d[4], 16)))
+            self.main.findChild(QLineEdit, 'errorLineEdit').setText(
+                    HSRV_get_error_text(int(d[5], 16)))
+
+        return tuple(others)
+
+    def hasEvents(self):
+        return self.connectedVersion and self.connectedVersion >= [2, 1]
+
     @property
     def connectedVersion(self):
         if hasattr(self, '_connectedVersion') and self._connectedVersion:
@@ -289,6 +321,8 @@ class HSRVConfig(QMainWindow):
 
     def doDisconnect(self):
         self.doDeviceSlowfeed(0, 0)
+        if self._serial_object and self.hasEvents():
+            self.serialSend(b'subscribe off\n')
 
         if self._serial_object:
             self._serial_object.close()
@@ -0,0 +1,299 @@
+/*
+ * abk_client.cpp
+ * Copyright (C) 2017 Benoit Rapidel <benoit.rapidel+devs@exmachina.fr>
+ *
+ * Distributed under terms of the MIT license.
+ */
+
+#include "abk_client.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+bool ABKReply::value(const std::string &key, std::string *value) const {
+    for (size_t i=0; i<lines.size(); i++) {
+        const std::string &line = lines[i];
+
+        if (line.compare(0, key.size(), key) != 0 || line.size() <= key.size())
+            continue;
+
+        size_t pos = key.size();
+        if (line[pos] == ':')
+            pos++;
+        if (line[pos] != ' ')
+            continue;
+
+        *value = line.substr(pos + 1);
+        return true;
+    }
+
+    return false;
+}
+
+ABKPort::ABKPort(const std::string &path, int timeout_ms) :
+        _path(path), _timeout_ms(timeout_ms), _fd(-1), _state(WAIT_ECHO) {
+    _current.active = false;
+}
+
+ABKPort::~ABKPort() {
+    close();
+}
+
+bool ABKPort::open(void) {
+    struct termios tio;
+
+    _fd = ::open(_path.c_str(), O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+    if (_fd < 0) {
+        _error = strerror(errno);
+        return false;
+    }
+
+    // The baudrate doesn't matter over USB CDC, it does on the ISP UART
+    if (tcgetattr(_fd, &tio) == 0) {
+        cfmakeraw(&tio);
+        cfsetispeed(&tio, B115200);
+        cfsetospeed(&tio, B115200);
+        tio.c_cflag |= CLOCAL | CREAD;
+        tio.c_cc[VMIN] = 0;
+        tio.c_cc[VTIME] = 0;
+        tcsetattr(_fd, TCSANOW, &tio);
+    }
+
+    tcflush(_fd, TCIOFLUSH); // Boot banner and whatever came before us
+    return true;
+}
+
+void ABKPort::close(void) {
+    if (_fd >= 0)
+        ::close(_fd);
+    _fd = -1;
+}
+
+void ABKPort::send(const std::string &command, ABKReplyHandler handler) {
+    Request request;
+
+    request.active = true;
+    request.reply = true;
+    request.raw = false;
+    request.command = command;
+    request.handler = handler;
+    request.deadline = 0;
+    _queue.push_back(request);
+}
+
+void ABKPort::send_only(const std::string &command) {
+    send(command, ABKReplyHandler());
+    _queue.back().reply = false;
+}
+
+void ABKPort::send_raw(const std::string &data, const std::vector<std::string> &ends, ABKReplyHandler handler) {
+    send(data, handler);
+    _queue.back().raw = true;
+    _queue.back().ends = ends;
+}
+
+short ABKPort::events(void) const {
+    return POLLIN | (_out.empty() ? 0 : POLLOUT);
+}
+
+int ABKPort::next_timeout(uint64_t now_ms) const {
+    if (!_current.active)
+        return -1;
+
+    return (_current.deadline > now_ms) ? (int) (_current.deadline - now_ms) : 0;
+}
+
+void ABKPort::start(uint64_t now_ms) {
+    _current = _queue.front();
+    _queue.pop_front();
+
+    if (_fd < 0) {
+        finish(false);
+        return;
+    }
+
+    _current.deadline = now_ms + _timeout_ms;
+    _reply = ABKReply();
+
+    if (_current.raw) {
+        _out += _current.command;
+        _state = RAW;
+        return;
+    }
+
+    _out += _current.command + "\r";
+    if (!_current.reply) {
+        _current.active = false;
+        return;
+    }
+
+    _out += ABK_CLIENT_SYNC "\r";
+    _state = WAIT_ECHO;
+    _reply.ok = false;
+    _reply.command = _current.command;
+}
+
+void ABKPort::finish(bool ok) {
+    Request request = _current;
+    ABKReply reply = _reply;
+
+    _current.active = false;
+    reply.ok = ok;
+    reply.command = request.command;
+
+    if (request.handler)
+        request.handler(*this, reply);
+}
+
+// Fails every pending command, the port is unusable from now on
+void ABKPort::fail(const std::string &error) {
+    _error = error;
+    close();
+    _out.clear();
+
+    if (_current.active)
+        finish(false);
+
+    while (!_queue.empty()) {
+        _current = _queue.front();
+        _queue.pop_front();
+        _reply = ABKReply();
+        finish(false);
+    }
+}
+
+void ABKPort::on_line(const std::string &line) {
+    if (!_current.active) // Unsolicited output (trigger, debug)
+        return;
+
+    // Pushed by a unit left subscribed, between two commands
+    if (_state != RAW && line.compare(0, strlen(ABK_CLIENT_EVENT), ABK_CLIENT_EVENT) == 0)
+        return;
+
+    switch (_state) {
+        case WAIT_ECHO:
+            if (line == _current.command)
+                _state = OUTPUT;
+            break;
+        case OUTPUT:
+            if (line == ABK_CLIENT_SYNC)
+                _state = SYNC;
+            else
+                _reply.lines.push_back(line);
+            break;
+        case SYNC:
+            _reply.version = line;
+            finish(true);
+            break;
+        case RAW:
+            _reply.lines.push_back(line);
+            for (size_t i=0; i<_current.ends.size(); i++) {
+                if (line.compare(0, _current.ends[i].size(), _current.ends[i]) == 0) {
+                    finish(true);
+                    break;
+                }
+            }
+            break;
+    }
+}
+
+void ABKPort::handle(short revents, uint64_t now_ms) {
+    char buf[256];
+
+    if (_fd >= 0 && (revents & POLLIN)) {
+        int len;
+
+        while ((len = ::read(_fd, buf, sizeof(buf))) > 0) {
+            for (int i=0; i<len; i++) {
+                if (buf[i] == '\n') {
+                    on_line(_in);
+                    _in.clear();
+                } else if (buf[i] != '\r') {
+                    _in += buf[i];
+                }
+            }
+        }
+
+        // With VMIN 0 an empty tty reads 0, a vanished device fails with EIO
+        if (len < 0 && errno != EAGAIN && errno != EINTR) {
+            fail(strerror(errno));
+            return;
+        }
+    }
+
+    if (_fd >= 0 && (revents & (POLLERR | POLLHUP | POLLNVAL)) && !(revents & POLLIN)) {
+        fail("disconnected");
+        return;
+    }
+
+    if (_current.active && now_ms >= _current.deadline) {
+        _error = _current.raw ? "timeout" : "timeout on '" + _current.command + "'";
+        finish(false);
+    }
+
+    while (!_current.active && !_queue.empty())
+        start(now_ms);
+
+    if (_fd >= 0 && !_out.empty()) {
+        int len = ::write(_fd, _out.data(), _out.size());
+
+        if (len > 0)
+            _out.erase(0, len);
+        else if (len < 0 && errno != EAGAIN && errno != EINTR)
+            fail(strerror(errno));
+    }
+}
+
+uint64_t ABKPortPool::now_ms(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+void ABKPortPool::run(void) {
+    std::vector<struct pollfd> fds;
+
+    while (true) {
+        uint64_t now = now_ms();
+        int timeout = -1;
+        bool busy = false;
+
+        fds.clear();
+        for (size_t i=0; i<_ports.size(); i++) {
+            ABKPort *port = _ports[i];
+
+            port->handle(0, now); // Start queued commands, expire timeouts
+
+            struct pollfd pfd = { port->fd(), 0, 0 };
+            if (port->busy() && port->is_open()) {
+                busy = true;
+                pfd.events = port->events();
+
+                int t = port->next_timeout(now);
+                if (t >= 0 && (timeout < 0 || t < timeout))
+                    timeout = t;
+            } else {
+                pfd.fd = -1; // Ignored by poll
+            }
+            fds.push_back(pfd);
+        }
+
+        if (!busy)
+            break;
+
+        if (poll(fds.data(), fds.size(), timeout) < 0 && errno != EINTR)
+            break;
+
+        now = now_ms();
+        for (size_t i=0; i<_ports.size(); i++) {
+            if (fds[i].fd >= 0 && fds[i].revents)
+                _ports[i]->handle(fds[i].revents, now);
+        }
+    }
+}
@@ -0,0 +1,126 @@
+/*
+ * abk_client.h
+ * Copyright (C) 2017 Benoit Rapidel <benoit.rapidel+devs@exmachina.fr>
+ *
+ * Distributed under terms of the MIT license.
+ */
+
+// Host client for the ABK console protocol.
+//
+// The console has no reply framing: every character is echoed and commands
+// print free-form "key value" lines. Each command is therefore sent followed
+// by "version", and its reply is everything between the echo of the command
+// and the echo of that sync command, whose own output ends the reply. The
+// device handles input in order, so replies can't interleave. Event lines
+// of a subscribed unit ("subscribe" command) may come in between and are
+// left out of replies.
+//
+// Binary transfers (firmware updates) bypass this: raw bytes go out and the
+// reply is every line up to one starting with an expected prefix.
+//
+// Ports are non-blocking and driven by ABKPortPool from a single poll() loop,
+// so any number of units can be talked to at once.
+
+#ifndef ABK_CLIENT_H
+#define ABK_CLIENT_H
+
+#include <stdint.h>
+
+#include <deque>
+#include <functional>
+#include <string>
+#include <vector>
+
+#define ABK_CLIENT_TIMEOUT      (2000)      // Default ms allowed for a reply
+#define ABK_CLIENT_SYNC         "version"
+#define ABK_CLIENT_EVENT        "ev "
+
+struct ABKReply {
+    bool ok;                                // Complete reply received in time
+    std::string command;
+    std::vector<std::string> lines;         // Output only, echo and sync excluded
+    std::string version;                    // Output of the sync command
+
+    // Value of the first "key value" line, or of "key: value"
+    bool value(const std::string &key, std::string *value) const;
+};
+
+class ABKPort;
+
+typedef std::function<void(ABKPort &port, const ABKReply &reply)> ABKReplyHandler;
+
+class ABKPort {
+
+public:
+    ABKPort(const std::string &path, int timeout_ms=ABK_CLIENT_TIMEOUT);
+    ~ABKPort();
+
+    bool open(void);
+    void close(void);
+    bool is_open(void) const { return _fd >= 0; }
+
+    const std::string &path(void) const { return _path; }
+    const std::string &error(void) const { return _error; }
+
+    // Queue a command, the handler runs from ABKPortPool::run() once its reply is in
+    void send(const std::string &command, ABKReplyHandler handler);
+    // Queue a command that doesn't reply (reset)
+    void send_only(const std::string &command);
+    // Queue raw bytes, the reply ends with the first line starting with one of ends
+    void send_raw(const std::string &data, const std::vector<std::string> &ends, ABKReplyHandler handler);
+
+    bool busy(void) const { return _current.active || !_queue.empty() || !_out.empty(); }
+
+    // Event loop interface
+    int fd(void) const { return _fd; }
+    short events(void) const;
+    int next_timeout(uint64_t now_ms) const;
+    void handle(short revents, uint64_t now_ms);
+
+private:
+    enum State { WAIT_ECHO, OUTPUT, SYNC, RAW };
+
+    struct Request {
+        bool active;
+        bool reply;
+        bool raw;
+        std::vector<std::string> ends;          // Raw only
+        std::string command;
+        ABKReplyHandler handler;
+        uint64_t deadline;
+    };
+
+    void start(uint64_t now_ms);
+    void finish(bool ok);
+    void fail(const std::string &error);
+    void on_line(const std::string &line);
+
+    std::string _path;
+    int _timeout_ms;
+    int _fd;
+    std::string _error;
+
+    std::deque<Request> _queue;
+    Request _current;
+    State _state;
+    ABKReply _reply;
+
+    std::string _in;                        // Partial line
+    std::string _out;                       // Not yet written
+};
+
+class ABKPortPool {
+
+public:
+    void add(ABKPort *port) { _ports.push_back(port); }
+
+    // Process every port until none has anything left to do
+    void run(void);
+
+    static uint64_t now_ms(void);
+
+private:
+    std::vector<ABKPort *> _ports;
+};
+
+#endif /* !ABK_CLIENT_H */
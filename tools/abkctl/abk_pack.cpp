@@ -0,0 +1,221 @@
+/*
+ * abk_pack.cpp
+ * Copyright (C) 2017 Benoit Rapidel <benoit.rapidel+devs@exmachina.fr>
+ *
+ * Distributed under terms of the MIT license.
+ */
+
+#include "abk_pack.h"
+
+#include "ABKupdproto.h"
+
+#include <string.h>
+
+#include <vector>
+
+#define ABK_PACK_HASH_BITS      (16)
+#define ABK_PACK_DEPTH          (64)    // Candidates tried per position and source
+#define ABK_PACK_MAX_LITERAL    (128)
+
+#define ABK_PACK_ISP_BAUD       (230400)
+#define ABK_PACK_ISP_ERASE_MS   (100)   // Per 32KB sector
+#define ABK_PACK_ISP_WRITE_MS   (1)     // Per 256 bytes
+
+// Hash chains over every position of a buffer, newest first
+class ABKMatcher {
+
+public:
+    ABKMatcher(const std::string &data) : _data(data), _head(1 << ABK_PACK_HASH_BITS, -1), _prev(data.size(), -1) {}
+
+    void insert(size_t pos) {
+        if (pos + ABK_UPD_MIN_MATCH > _data.size())
+            return;
+
+        uint32_t h = hash(&_data[pos]);
+        _prev[pos] = _head[h];
+        _head[h] = pos;
+    }
+
+    // Longest match of target[pos...] starting before limit, 0 if none
+    size_t find(const std::string &target, size_t pos, size_t limit, size_t *src) const {
+        size_t best = 0;
+        int depth = ABK_PACK_DEPTH;
+
+        if (pos + ABK_UPD_MIN_MATCH > target.size())
+            return 0;
+
+        for (int32_t cand = _head[hash(&target[pos])]; cand >= 0 && depth-- > 0; cand = _prev[cand]) {
+            size_t len = length(target, pos, cand, limit);
+
+            if (len > best) {
+                best = len;
+                *src = cand;
+            }
+        }
+
+        return best;
+    }
+
+    size_t length(const std::string &target, size_t pos, size_t cand, size_t limit) const {
+        size_t len = 0;
+
+        while (pos + len < target.size() && cand + len < _data.size() && cand + len < limit
+                && target[pos + len] == _data[cand + len])
+            len++;
+        return len;
+    }
+
+private:
+    static uint32_t hash(const char *p) {
+        uint32_t v;
+
+        memcpy(&v, p, 4);
+        return (v * 2654435761u) >> (32 - ABK_PACK_HASH_BITS);
+    }
+
+    const std::string &_data;
+    std::vector<int32_t> _head;
+    std::vector<int32_t> _prev;
+};
+
+static void ABK_pack_varint(std::string *out, uint32_t value) {
+    while (value >= 0x80) {
+        *out += (char) (0x80 | (value & 0x7F));
+        value >>= 7;
+    }
+    *out += (char) value;
+}
+
+static void ABK_pack_literals(std::string *out, const std::string &image, size_t start, size_t end) {
+    while (start < end) {
+        size_t n = std::min(end - start, (size_t) ABK_PACK_MAX_LITERAL);
+
+        *out += (char) (n - 1);
+        out->append(image, start, n);
+        start += n;
+    }
+}
+
+static void ABK_pack_copy(std::string *out, bool from_base, uint32_t length, uint32_t value) {
+    uint32_t extra = length - ABK_UPD_MIN_MATCH;
+
+    *out += (char) ((from_base ? 0xC0 : 0x80) | std::min(extra, (uint32_t) 0x3F));
+    if (extra >= 0x3F)
+        ABK_pack_varint(out, extra - 0x3F);
+    ABK_pack_varint(out, value);
+}
+
+// Greedy: longest match of either source. Code moved by a build usually moved
+// by the same amount as its neighbour, so the last base offset is tried first.
+std::string ABK_pack(const std::string &image, const std::string &base) {
+    ABKMatcher image_matcher(image);
+    ABKMatcher base_matcher(base);
+    std::string payload;
+    int64_t last_delta = 0;
+    size_t literal = 0;
+    size_t pos = 0;
+
+    for (size_t i=0; i<base.size(); i++)
+        base_matcher.insert(i);
+
+    while (pos < image.size()) {
+        size_t image_src = 0, base_src = 0;
+        size_t image_len = image_matcher.find(image, pos, image.size(), &image_src);
+        size_t base_len = base_matcher.find(image, pos, base.size(), &base_src);
+
+        int64_t guess = (int64_t) pos + last_delta;
+        if (guess >= 0 && (size_t) guess < base.size()) {
+            size_t len = base_matcher.length(image, pos, guess, base.size());
+            if (len >= base_len) {
+                base_len = len;
+                base_src = guess;
+            }
+        }
+
+        size_t len = std::max(image_len, base_len);
+        if (len < ABK_UPD_MIN_MATCH) {
+            image_matcher.insert(pos++);
+            continue;
+        }
+
+        ABK_pack_literals(&payload, image, literal, pos);
+        if (base_len >= image_len) {
+            int64_t delta = (int64_t) base_src - (int64_t) pos;
+
+            ABK_pack_copy(&payload, true, len, (delta >= 0) ? (uint32_t) (delta * 2) : (uint32_t) (-delta * 2 - 1));
+            last_delta = delta;
+        } else {
+            ABK_pack_copy(&payload, false, len, pos - image_src);
+        }
+
+        for (size_t i=0; i<len; i++)
+            image_matcher.insert(pos++);
+        literal = pos;
+    }
+    ABK_pack_literals(&payload, image, literal, pos);
+
+    ABK_upd_header_t header;
+    uint8_t buf[ABK_UPD_HEADER_SIZE];
+
+    header.image_size = image.size();
+    header.image_crc = ABK_upd_crc32(0, (const uint8_t *) image.data(), image.size());
+    header.base_size = base.size();
+    header.base_crc = ABK_upd_crc32(0, (const uint8_t *) base.data(), base.size());
+    header.payload_size = payload.size();
+    ABK_upd_encode_header(buf, &header);
+
+    return std::string((const char *) buf, sizeof(buf)) + payload;
+}
+
+struct ABKPackCheck {
+    const std::string *base;
+    std::string out;
+};
+
+static uint8_t ABK_pack_read_base(void *ctx, uint32_t offset) {
+    return (*((ABKPackCheck *) ctx)->base)[offset];
+}
+
+static uint8_t ABK_pack_read_image(void *ctx, uint32_t offset) {
+    return ((ABKPackCheck *) ctx)->out[offset];
+}
+
+static bool ABK_pack_write(void *ctx, uint8_t byte) {
+    ((ABKPackCheck *) ctx)->out += (char) byte;
+    return true;
+}
+
+bool ABK_pack_check(const std::string &packed, const std::string &image, const std::string &base) {
+    ABK_upd_header_t header;
+    ABK_upd_decoder_t dec;
+    ABKPackCheck check;
+
+    if (packed.size() < ABK_UPD_HEADER_SIZE || !ABK_upd_decode_header((const uint8_t *) packed.data(), &header))
+        return false;
+    if (header.payload_size != packed.size() - ABK_UPD_HEADER_SIZE || header.base_size != base.size())
+        return false;
+
+    check.base = &base;
+    ABK_upd_decoder_init(&dec, &header, &ABK_pack_read_base, &ABK_pack_read_image, &ABK_pack_write, &check);
+
+    // In frame sized pieces, as the firmware gets it
+    for (size_t i=ABK_UPD_HEADER_SIZE; i<packed.size(); i+=ABK_UPD_FRAME_MAX) {
+        size_t n = std::min(packed.size() - i, (size_t) ABK_UPD_FRAME_MAX);
+
+        if (ABK_upd_decode(&dec, (const uint8_t *) packed.data() + i, n) != ABK_UPD_OK)
+            return false;
+    }
+
+    return ABK_upd_decoder_finish(&dec, &header) == ABK_UPD_OK && check.out == image;
+}
+
+// 45 bytes per uuencoded line of 61 characters and CRLF, a checksum line and
+// its "OK" every 20 lines, 10 bits per character
+uint32_t ABK_pack_isp_ms(uint32_t size) {
+    uint64_t lines = (size + 44) / 45;
+    uint64_t chars = lines * 63 + (lines + 19) / 20 * 16;
+    uint64_t transfer_ms = chars * 10 * 1000 / ABK_PACK_ISP_BAUD;
+    uint64_t sectors = (size + 0x7FFF) / 0x8000;
+
+    return transfer_ms + sectors * ABK_PACK_ISP_ERASE_MS + (size + 255) / 256 * ABK_PACK_ISP_WRITE_MS;
+}
@@ -0,0 +1,26 @@
+/*
+ * abk_pack.h
+ * Copyright (C) 2017 Benoit Rapidel <benoit.rapidel+devs@exmachina.fr>
+ *
+ * Distributed under terms of the MIT license.
+ */
+
+// Firmware update images, the encoder side of src/update/ABKupdproto.h.
+
+#ifndef ABK_PACK_H
+#define ABK_PACK_H
+
+#include <stdint.h>
+
+#include <string>
+
+// Header and payload of image, a delta against base unless base is empty
+std::string ABK_pack(const std::string &image, const std::string &base);
+
+// Decodes a packed image with the firmware decoder, false unless it gives image back
+bool ABK_pack_check(const std::string &packed, const std::string &image, const std::string &base);
+
+// ms to flash size bytes over the ISP UART (make.bat): uuencoded at 230400 baud, then written
+uint32_t ABK_pack_isp_ms(uint32_t size);
+
+#endif /* !ABK_PACK_H */
@@ -0,0 +1,615 @@
+/*
+ * abkctl.cpp
+ * Copyright (C) 2017 Benoit Rapidel <benoit.rapidel+devs@exmachina.fr>
+ *
+ * Distributed under terms of the MIT license.
+ */
+
+// Batch provisioning and status for any number of ABK units at once.
+//
+// Every port runs the same sequence of console commands concurrently. Output
+// lines are prefixed with the port path, each port ends with "ok" or "FAIL"
+// and the exit status is non-zero if any port failed.
+
+#include "abk_client.h"
+#include "abk_pack.h"
+
+#include "ABKlogproto.h"
+#include "ABKupdproto.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <map>
+#include <memory>
+
+typedef std::function<bool(const ABKReply &reply, std::string *error)> ABKCheck;
+
+struct Step {
+    std::string command;
+    ABKCheck check;
+};
+
+struct Job {
+    std::unique_ptr<ABKPort> port;
+    std::vector<Step> steps;
+    std::map<std::string, std::string> values;  // Collected by the get steps
+    std::string packed;                         // Update image
+    uint64_t start_ms;
+    bool done;
+    bool ok;
+    std::string error;
+};
+
+struct Options {
+    int timeout = ABK_CLIENT_TIMEOUT;
+    int axis = -1;
+    int cue = -1;
+    const char *base = NULL;
+};
+
+static const char *ABK_state_names[] = {
+    "STANDBY", "NOT_CONFIGURED", "CONFIGURED", "READY", "RUN", "SLOWFEED", "RESET", "CALIBRATION",
+};
+
+static void ABK_ctl_usage(const char *name) {
+    fprintf(stderr,
+        "usage: %s [-t TIMEOUT_MS] [-a AXIS] [-c CUE] [-b BASE] COMMAND [ARG] PORT...\n"
+        "\n"
+        "commands:\n"
+        "    status            Print the state and errors of each unit\n"
+        "    get               Print the configuration in use\n"
+        "    exec LINE         Run a console command and print its output\n"
+        "    provision FILE    Set every \"key value\" of FILE, check it back and save it\n"
+        "    verify FILE       Check the configuration in use (after a reset) against FILE\n"
+        "    log               Print the run and fault log of each unit\n"
+        "    decode IMAGE      Print the run and fault log of an EEPROM image, no port\n"
+        "    pack FIRMWARE OUT Build an update image of a firmware binary, no port,\n"
+        "                      a delta against the running BASE binary with -b\n"
+        "    update IMAGE      Send an update image, it is installed at the next reset\n",
+        name);
+}
+
+// "key value" lines, '#' starts a comment
+static bool ABK_ctl_read_file(const char *path, std::vector<std::pair<std::string, std::string> > *entries) {
+    char line[256];
+    FILE *f = fopen(path, "r");
+
+    if (!f) {
+        perror(path);
+        return false;
+    }
+
+    while (fgets(line, sizeof(line), f)) {
+        char key[64], value[64];
+
+        char *comment = strchr(line, '#');
+        if (comment)
+            *comment = '\0';
+
+        int n = sscanf(line, "%63s %63s", key, value);
+        if (n == 2) {
+            entries->push_back(std::make_pair(std::string(key), std::string(value)));
+        } else if (n == 1) {
+            fprintf(stderr, "%s: missing value for %s\n", path, key);
+            fclose(f);
+            return false;
+        }
+    }
+
+    fclose(f);
+    return true;
+}
+
+// Same flags as ABK_ERROR_* in src/ABKcontrol.h
+static std::string ABK_ctl_error_names(const ABK_log_record_t &record) {
+    static const char *names[] = { "estop", "not_configured", "invalid_config", "vfd" };
+    std::string out;
+
+    if (record.type == ABK_LOG_BOOT)
+        return record.error ? "watchdog" : "-";
+
+    for (int i=0; i<4; i++) {
+        if (record.error & (1 << i))
+            out += (out.empty() ? "" : ",") + std::string(names[i]);
+    }
+    return out.empty() ? "-" : out;
+}
+
+static void ABK_ctl_print_record(const char *prefix, const ABK_log_record_t &record) {
+    printf("%s %lu %-5s axis %u at %lu.%03lus for %lu.%03lus %s\n", prefix, (unsigned long) record.seq,
+            ABK_log_type_name(record.type), record.axis,
+            (unsigned long) record.time / 1000, (unsigned long) record.time % 1000,
+            (unsigned long) record.duration / 1000, (unsigned long) record.duration % 1000,
+            ABK_ctl_error_names(record).c_str());
+}
+
+static bool ABK_ctl_read_image(void *ctx, uint32_t address, uint8_t *buf, int len) {
+    FILE *f = (FILE *) ctx;
+
+    // Past the end of a short image reads as blank
+    memset(buf, 0xFF, len);
+    if (fseek(f, address, SEEK_SET) != 0)
+        return false;
+    if (fread(buf, 1, len, f) == 0 && ferror(f))
+        return false;
+    return true;
+}
+
+// Decodes the log ring of an EEPROM image, oldest record first
+static int ABK_ctl_decode(const char *path) {
+    FILE *f = fopen(path, "rb");
+    uint32_t head, seq;
+
+    if (!f) {
+        perror(path);
+        return 2;
+    }
+
+    if (!ABK_log_find_head(&ABK_ctl_read_image, f, &head, &seq)) {
+        fprintf(stderr, "%s: read error\n", path);
+        fclose(f);
+        return 1;
+    }
+
+    uint32_t count = (seq - 1 < ABK_LOG_SLOTS) ? seq - 1 : ABK_LOG_SLOTS;
+    for (uint32_t n=count; n>0; n--) {
+        uint8_t buf[ABK_LOG_RECORD_SIZE];
+        ABK_log_record_t record;
+
+        ABK_ctl_read_image(f, ABK_log_slot_address(ABK_log_slot_before(head, n)), buf, sizeof(buf));
+        if (ABK_log_decode(buf, &record) && record.seq == seq - n)
+            ABK_ctl_print_record(path, record);
+    }
+
+    fclose(f);
+    return 0;
+}
+
+static bool ABK_ctl_load(const char *path, std::string *data) {
+    char buf[4096];
+    size_t n;
+    FILE *f = fopen(path, "rb");
+
+    if (!f) {
+        perror(path);
+        return false;
+    }
+
+    data->clear();
+    while ((n = fread(buf, 1, sizeof(buf), f)) > 0)
+        data->append(buf, n);
+
+    bool ok = !ferror(f);
+    fclose(f);
+    return ok;
+}
+
+// Packs a firmware binary and decodes it back with the firmware decoder
+static int ABK_ctl_pack(const char *path, const char *out, const char *base_path) {
+    std::string image, base;
+
+    if (!ABK_ctl_load(path, &image) || (base_path && !ABK_ctl_load(base_path, &base)))
+        return 2;
+
+    if (image.empty() || image.size() > ABK_UPD_SLOT_SIZE || base.size() > ABK_UPD_SLOT_SIZE) {
+        fprintf(stderr, "%s: firmware must be 1 to %d bytes\n", path, ABK_UPD_SLOT_SIZE);
+        return 2;
+    }
+
+    std::string packed = ABK_pack(image, base);
+    if (!ABK_pack_check(packed, image, base)) {
+        fprintf(stderr, "%s: packed image doesn't decode back\n", path);
+        return 1;
+    }
+
+    FILE *f = fopen(out, "wb");
+    if (!f || fwrite(packed.data(), 1, packed.size(), f) != packed.size()) {
+        perror(out);
+        if (f)
+            fclose(f);
+        return 1;
+    }
+    fclose(f);
+
+    printf("firmware_bytes %lu\n", (unsigned long) image.size());
+    printf("base_bytes %lu\n", (unsigned long) base.size());
+    printf("update_bytes %lu\n", (unsigned long) packed.size());
+    printf("ratio_percent %lu\n", (unsigned long) (packed.size() * 100 / image.size()));
+    // make.bat flashes the bootloader area and the application
+    printf("isp_estimate_ms %lu\n", (unsigned long) ABK_pack_isp_ms(ABK_UPD_APP_START + image.size()));
+    return 0;
+}
+
+static bool ABK_ctl_no_error(const ABKReply &reply, std::string *error) {
+    for (size_t i=0; i<reply.lines.size(); i++) {
+        if (reply.lines[i].find("unrecognized") == 0 || reply.lines[i].find("misformatted") == 0
+                || reply.lines[i].find("invalid") == 0 || reply.lines[i].find("error") == 0) {
+            *error = reply.lines[i];
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static void ABK_ctl_print(Job *job, const ABKReply &reply) {
+    for (size_t i=0; i<reply.lines.size(); i++)
+        printf("%s %s\n", job->port->path().c_str(), reply.lines[i].c_str());
+}
+
+// Record every "key value" line of the reply
+static ABKCheck ABK_ctl_collect(Job *job) {
+    return [job](const ABKReply &reply, std::string *error) {
+        for (size_t i=0; i<reply.lines.size(); i++) {
+            const std::string &line = reply.lines[i];
+            size_t pos = line.find(' ');
+
+            if (pos != std::string::npos)
+                job->values[line.substr(0, pos)] = line.substr(pos + 1);
+        }
+        return true;
+    };
+}
+
+static ABKCheck ABK_ctl_compare(Job *job, const std::vector<std::pair<std::string, std::string> > &entries) {
+    return [job, entries](const ABKReply &reply, std::string *error) {
+        for (size_t i=0; i<entries.size(); i++) {
+            std::map<std::string, std::string>::iterator it = job->values.find(entries[i].first);
+
+            if (it == job->values.end()) {
+                *error = entries[i].first + " not reported";
+                return false;
+            }
+            if (atoi(it->second.c_str()) != atoi(entries[i].second.c_str())) {
+                *error = entries[i].first + " is " + it->second + ", expected " + entries[i].second;
+                return false;
+            }
+        }
+        return true;
+    };
+}
+
+static void ABK_ctl_end(Job *job, bool ok, const std::string &error) {
+    job->done = true;
+    job->ok = ok;
+    job->error = error;
+
+    if (ok)
+        printf("%s ok\n", job->port->path().c_str());
+    else
+        printf("%s FAIL %s\n", job->port->path().c_str(), error.c_str());
+}
+
+static void ABK_ctl_run_step(Job *job, size_t index);
+
+// Header first, then the payload, one frame in flight. A frame the unit got
+// damaged is sent again, anything else ends the transfer.
+static void ABK_ctl_send_frame(Job *job, size_t index, size_t offset, int retries) {
+    static const std::vector<std::string> ends = { "update.ack", "update.nak", "update.result" };
+    size_t len = (offset == 0) ? ABK_UPD_HEADER_SIZE : std::min(job->packed.size() - offset, (size_t) ABK_UPD_FRAME_MAX);
+    std::string frame;
+    uint8_t buf[4];
+
+    uint32_t crc = ABK_upd_crc32(0, (const uint8_t *) job->packed.data() + offset, len);
+    for (int i=0; i<4; i++)
+        buf[i] = (crc >> (8 * i)) & 0xFF;
+
+    frame += (char) (len & 0xFF);
+    frame += (char) (len >> 8);
+    frame.append(job->packed, offset, len);
+    frame.append((const char *) buf, 4);
+
+    job->port->send_raw(frame, ends, [job, index, offset, len, retries](ABKPort &port, const ABKReply &reply) {
+        if (!reply.ok) {
+            ABK_ctl_end(job, false, port.error());
+            return;
+        }
+
+        const std::string &last = reply.lines.back();
+        std::string result;
+
+        if (last.compare(0, 10, "update.ack") == 0) {
+            ABK_ctl_send_frame(job, index, offset + len, 0);
+        } else if (last.compare(0, 10, "update.nak") == 0) {
+            if (retries >= 3)
+                ABK_ctl_end(job, false, "frame rejected");
+            else
+                ABK_ctl_send_frame(job, index, offset, retries + 1);
+        } else {
+            ABK_upd_header_t header;
+            ABK_upd_decode_header((const uint8_t *) job->packed.data(), &header);
+
+            // Against flashing the same firmware with make.bat
+            ABK_ctl_print(job, reply);
+            printf("%s update.host_ms %lu\n", port.path().c_str(),
+                    (unsigned long) (ABKPortPool::now_ms() - job->start_ms));
+            printf("%s update.isp_estimate_ms %lu\n", port.path().c_str(),
+                    (unsigned long) ABK_pack_isp_ms(ABK_UPD_APP_START + header.image_size));
+            reply.value("update.result", &result);
+            if (result == "ok")
+                ABK_ctl_run_step(job, index + 1);
+            else
+                ABK_ctl_end(job, false, "update " + result);
+        }
+    });
+}
+
+static void ABK_ctl_transfer(Job *job, size_t index) {
+    static const std::vector<std::string> ends = { "update.ready", "update.result" };
+
+    job->start_ms = ABKPortPool::now_ms();
+    job->port->send_raw("update begin\r", ends, [job, index](ABKPort &port, const ABKReply &reply) {
+        std::string result;
+
+        if (!reply.ok) {
+            ABK_ctl_end(job, false, port.error());
+        } else if (reply.lines.back() == "update.ready") {
+            ABK_ctl_send_frame(job, index, 0, 0);
+        } else {
+            reply.value("update.result", &result);
+            ABK_ctl_end(job, false, "update " + result);
+        }
+    });
+}
+
+static void ABK_ctl_run_step(Job *job, size_t index) {
+    if (index >= job->steps.size()) {
+        ABK_ctl_end(job, true, "");
+        return;
+    }
+
+    // No command: a check on what earlier steps collected
+    if (job->steps[index].command.empty()) {
+        std::string error;
+
+        if (!job->steps[index].check(ABKReply(), &error))
+            ABK_ctl_end(job, false, error);
+        else
+            ABK_ctl_run_step(job, index + 1);
+        return;
+    }
+
+    // Binary, not a console command
+    if (job->steps[index].command == "update begin") {
+        ABK_ctl_transfer(job, index);
+        return;
+    }
+
+    // The unit restarts instead of replying
+    if (job->steps[index].command == "reset") {
+        job->port->send_only("reset");
+        ABK_ctl_run_step(job, index + 1);
+        return;
+    }
+
+    job->port->send(job->steps[index].command, [job, index](ABKPort &port, const ABKReply &reply) {
+        std::string error;
+
+        if (!reply.ok) {
+            ABK_ctl_end(job, false, port.error());
+            return;
+        }
+
+        if (job->steps[index].check && !job->steps[index].check(reply, &error)) {
+            ABK_ctl_end(job, false, error);
+            return;
+        }
+
+        ABK_ctl_run_step(job, index + 1);
+    });
+}
+
+int main(int argc, char **argv) {
+    Options opt;
+    int c;
+
+    while ((c = getopt(argc, argv, "t:a:c:b:h")) != -1) {
+        switch (c) {
+            case 't':
+                opt.timeout = atoi(optarg);
+                break;
+            case 'a':
+                opt.axis = atoi(optarg);
+                break;
+            case 'c':
+                opt.cue = atoi(optarg);
+                break;
+            case 'b':
+                opt.base = optarg;
+                break;
+            default:
+                ABK_ctl_usage(argv[0]);
+                return 2;
+        }
+    }
+
+    if (optind >= argc) {
+        ABK_ctl_usage(argv[0]);
+        return 2;
+    }
+
+    std::string command = argv[optind++];
+    std::string arg;
+    std::vector<std::pair<std::string, std::string> > entries;
+
+    if (command == "decode") {
+        if (optind >= argc) {
+            ABK_ctl_usage(argv[0]);
+            return 2;
+        }
+        return ABK_ctl_decode(argv[optind]);
+    }
+
+    if (command == "pack") {
+        if (optind + 1 >= argc) {
+            ABK_ctl_usage(argv[0]);
+            return 2;
+        }
+        return ABK_ctl_pack(argv[optind], argv[optind + 1], opt.base);
+    }
+
+    std::string packed;
+    ABK_upd_header_t header;
+
+    if (command == "exec" || command == "provision" || command == "verify" || command == "update") {
+        if (optind >= argc) {
+            ABK_ctl_usage(argv[0]);
+            return 2;
+        }
+        arg = argv[optind++];
+    } else if (command != "status" && command != "get" && command != "log") {
+        ABK_ctl_usage(argv[0]);
+        return 2;
+    }
+
+    if ((command == "provision" || command == "verify") && !ABK_ctl_read_file(arg.c_str(), &entries))
+        return 2;
+
+    if (command == "update") {
+        if (!ABK_ctl_load(arg.c_str(), &packed))
+            return 2;
+        if (packed.size() < ABK_UPD_HEADER_SIZE || !ABK_upd_decode_header((const uint8_t *) packed.data(), &header)
+                || header.payload_size != packed.size() - ABK_UPD_HEADER_SIZE) {
+            fprintf(stderr, "%s: not an update image (abkctl pack)\n", arg.c_str());
+            return 2;
+        }
+    }
+
+    if (optind >= argc) {
+        fprintf(stderr, "no port given\n");
+        return 2;
+    }
+
+    std::vector<std::unique_ptr<Job> > jobs;
+    ABKPortPool pool;
+
+    for (int i=optind; i<argc; i++) {
+        Job *job = new Job;
+        jobs.push_back(std::unique_ptr<Job>(job));
+
+        job->port.reset(new ABKPort(argv[i], opt.timeout));
+        job->done = false;
+        job->ok = false;
+
+        if (opt.axis >= 0)
+            job->steps.push_back({ "axis " + std::to_string(opt.axis), ABK_ctl_no_error });
+        if (opt.cue >= 0)
+            job->steps.push_back({ "cue " + std::to_string(opt.cue), ABK_ctl_no_error });
+
+        if (command == "status") {
+            job->steps.push_back({ "status", [job](const ABKReply &reply, std::string *error) {
+                unsigned int state, errors;
+                std::string status;
+
+                if (!reply.value("status", &status) || sscanf(status.c_str(), "0x%x error: 0x%x", &state, &errors) != 2) {
+                    *error = "unexpected status reply";
+                    return false;
+                }
+
+                printf("%s version %s\n", job->port->path().c_str(), reply.version.c_str());
+                printf("%s state %s\n", job->port->path().c_str(),
+                        state < sizeof(ABK_state_names) / sizeof(ABK_state_names[0]) ? ABK_state_names[state] : "UNKNOWN");
+                printf("%s error 0x%x\n", job->port->path().c_str(), errors);
+                return true;
+            }});
+        } else if (command == "get") {
+            job->steps.push_back({ "get", [job](const ABKReply &reply, std::string *error) {
+                ABK_ctl_print(job, reply);
+                return true;
+            }});
+            job->steps.push_back({ "lead", [job](const ABKReply &reply, std::string *error) {
+                ABK_ctl_print(job, reply);
+                return true;
+            }});
+        } else if (command == "exec") {
+            job->steps.push_back({ arg, [job](const ABKReply &reply, std::string *error) {
+                ABK_ctl_print(job, reply);
+                return true;
+            }});
+        } else if (command == "provision") {
+            for (size_t e=0; e<entries.size(); e++)
+                job->steps.push_back({ "set " + entries[e].first + " " + entries[e].second, ABK_ctl_no_error });
+
+            // Pending values are checked before they are written
+            job->steps.push_back({ "gett", ABK_ctl_collect(job) });
+            job->steps.push_back({ "", ABK_ctl_compare(job, entries) });
+            job->steps.push_back({ "save", [](const ABKReply &reply, std::string *error) {
+                if (!reply.lines.empty() && reply.lines[0].find("saved") != std::string::npos)
+                    return true;
+                *error = reply.lines.empty() ? "no reply to save" : reply.lines[0];
+                return false;
+            }});
+        } else if (command == "log") {
+            // "log SEQ TYPE AXIS TIME_MS DURATION_MS ERROR" lines, see the log command
+            job->steps.push_back({ "log " + std::to_string(ABK_LOG_SLOTS), [job](const ABKReply &reply, std::string *error) {
+                for (size_t i=0; i<reply.lines.size(); i++) {
+                    ABK_log_record_t record;
+                    unsigned long seq, time, duration;
+                    unsigned int axis, flags;
+                    char type[16];
+
+                    if (sscanf(reply.lines[i].c_str(), "log %lu %15s %u %lu %lu 0x%x",
+                                &seq, type, &axis, &time, &duration, &flags) != 6)
+                        continue;
+
+                    memset(&record, 0, sizeof(record));
+                    for (int t=ABK_LOG_BOOT; t<ABK_LOG_TYPE_END; t++) {
+                        if (strcmp(type, ABK_log_type_name(t)) == 0)
+                            record.type = t;
+                    }
+                    record.seq = seq;
+                    record.axis = axis;
+                    record.time = time;
+                    record.duration = duration;
+                    record.error = flags;
+                    ABK_ctl_print_record(job->port->path().c_str(), record);
+                }
+                return true;
+            }});
+        } else if (command == "update") {
+            uint32_t crc = header.image_crc;
+
+            job->packed = packed;
+            job->steps.push_back({ "update begin", ABKCheck() });
+            job->steps.push_back({ "update", [job, crc](const ABKReply &reply, std::string *error) {
+                std::string staged, image_crc;
+
+                if (!reply.value("update.staged", &staged) || !reply.value("update.image_crc", &image_crc)
+                        || staged != "1" || strtoul(image_crc.c_str(), NULL, 16) != crc) {
+                    *error = "image not staged";
+                    return false;
+                }
+                printf("%s update.staged 1, installed at the next reset\n", job->port->path().c_str());
+                return true;
+            }});
+        } else if (command == "verify") {
+            job->steps.push_back({ "get", ABK_ctl_collect(job) });
+            job->steps.push_back({ "lead", ABK_ctl_collect(job) });
+            job->steps.push_back({ "", ABK_ctl_compare(job, entries) });
+        }
+
+        if (!job->port->open()) {
+            ABK_ctl_end(job, false, job->port->error());
+            continue;
+        }
+
+        pool.add(job->port.get());
+        ABK_ctl_run_step(job, 0);
+    }
+
+    pool.run();
+
+    int failed = 0;
+    for (size_t i=0; i<jobs.size(); i++) {
+        if (!jobs[i]->done)
+            ABK_ctl_end(jobs[i].get(), false, "not finished");
+        if (!jobs[i]->ok)
+            failed++;
+    }
+
+    fprintf(stderr, "%d/%d units ok\n", (int) (jobs.size() - failed), (int) jobs.size());
+    return failed ? 1 : 0;
+}
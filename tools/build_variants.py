@@ -0,0 +1,102 @@
+#!/usr/bin/env python
+# Builds the bootloader (boot/) into BUILD/boot, then every firmware variant
+# (variants/*.json) in its own BUILD/<variant> directory and reports the flash
+# and RAM each one uses.
+#
+# ABK-firmware.bin is the application alone, at 0x10000: the input of
+# "abkctl pack" for serial updates. ABK-full.bin is the bootloader padded to
+# 0x10000 followed by the application, the image to flash over ISP.
+#
+# usage: build_variants.py [VARIANT...]
+
+import os
+import subprocess
+import sys
+
+ROOT = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+TARGET = 'LPC1768'
+TOOLCHAIN = 'GCC_ARM'
+APP_START = 0x10000     # ABK_UPD_APP_START, src/update/ABKupdproto.h
+
+
+def variants():
+    names = [f[:-5] for f in os.listdir(os.path.join(ROOT, 'variants')) if f.endswith('.json')]
+    return sorted(names)
+
+
+def build_boot():
+    build_dir = os.path.join('BUILD', 'boot')
+    cmd = ['mbed', 'compile', '-t', TOOLCHAIN, '-m', TARGET, '-N', 'ABK-boot',
+           '--source', 'boot', '--source', os.path.join('src', 'update'), '--source', 'mbed-os',
+           '--app-config', os.path.join('boot', 'mbed_app.json'),
+           '--build', build_dir]
+
+    if subprocess.call(cmd, cwd=ROOT) != 0:
+        return None
+
+    return os.path.join(ROOT, build_dir, 'ABK-boot')
+
+
+def combine(boot, variant):
+    with open(boot + '.bin', 'rb') as f:
+        image = f.read()
+    with open(os.path.join(ROOT, 'BUILD', variant, 'ABK-firmware.bin'), 'rb') as f:
+        app = f.read()
+
+    image += b'\xff' * (APP_START - len(image))
+    with open(os.path.join(ROOT, 'BUILD', variant, 'ABK-full.bin'), 'wb') as f:
+        f.write(image + app)
+
+
+def build(variant):
+    build_dir = os.path.join('BUILD', variant)
+    cmd = ['mbed', 'compile', '-t', TOOLCHAIN, '-m', TARGET,
+           '--app-config', os.path.join('variants', variant + '.json'),
+           '--build', build_dir]
+
+    if subprocess.call(cmd, cwd=ROOT) != 0:
+        return None
+
+    return os.path.join(ROOT, build_dir, 'ABK-firmware.elf')
+
+
+# text + data is what gets flashed, data + bss is the static RAM
+def size(elf):
+    out = subprocess.check_output(['arm-none-eabi-size', '-B', elf]).decode()
+    text, data, bss = [int(x) for x in out.splitlines()[1].split()[:3]]
+    return text + data, data + bss
+
+
+def main():
+    names = sys.argv[1:] or variants()
+    results = []
+    failed = False
+
+    boot = build_boot()
+    if boot is None:
+        print('bootloader build failed')
+        return 1
+    results.append(('boot', size(boot + '.elf')))
+
+    for name in names:
+        elf = build(name)
+        if elf is None:
+            results.append((name, None))
+            failed = True
+        else:
+            combine(boot, name)
+            results.append((name, size(elf)))
+
+    print('')
+    print('%-12s %10s %10s' % ('variant', 'flash', 'ram'))
+    for name, sizes in results:
+        if sizes is None:
+            print('%-12s %10s %10s' % (name, 'FAIL', ''))
+        else:
+            print('%-12s %10d %10d' % (name, sizes[0], sizes[1]))
+
+    return 1 if failed else 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
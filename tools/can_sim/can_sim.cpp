@@ -0,0 +1,325 @@
+/*
+ * can_sim.cpp
+ * Copyright (C) 2017 Benoit Rapidel <benoit.rapidel+devs@exmachina.fr>
+ *
+ * Distributed under terms of the MIT license.
+ */
+
+// Host simulation of the ABK CAN synchronised trigger protocol.
+//
+// Runs one master and several slave units, each with its own drifting clock,
+// through the firmware protocol code (src/ABKcanproto.cpp). Frames go either
+// through an in-process simulated bus or through a Linux SocketCAN interface
+// (vcan). For every cue, the real time at which each unit would start its
+// profile is computed and the skew between units is reported.
+
+#include "ABKcanproto.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <time.h>
+
+#include <net/if.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <linux/can.h>
+#include <linux/can/raw.h>
+
+#include <algorithm>
+#include <random>
+#include <thread>
+#include <vector>
+
+struct Unit {
+    int node;
+    double ppm;                 // Clock error
+    uint32_t offset0;           // Clock value at real time 0
+    ABK_can_sync_t sync;
+    int fd;
+    std::vector<double> fires;  // Real fire time in us, per cue
+
+    uint32_t local(double real_us) const {
+        return offset0 + (uint32_t) (uint64_t) (real_us * (1.0 + ppm * 1e-6));
+    }
+
+    double real(uint32_t local_us, double around_us) const {
+        // Undo the clock model, picking the 2^32 wrap closest to around_us
+        double ticks = (double) (uint32_t) (local_us - local(around_us));
+        if (ticks > 2147483648.0)
+            ticks -= 4294967296.0;
+        return around_us + ticks / (1.0 + ppm * 1e-6);
+    }
+};
+
+struct Options {
+    int units = 4;
+    int cues = 10;
+    int sync_ms = 250;
+    double ppm = 100.0;
+    double latency = 110.0;     // Frame time + RX interrupt, simulated bus only
+    double jitter = 2.0;        // RX timestamp jitter, simulated bus only
+    double max_skew = 50.0;
+    uint32_t lead = 5000;       // Cue lead time, ABK_CAN_CUE_LEAD in the firmware
+    const char *iface = NULL;
+};
+
+static double ABK_sim_now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+// Handle a frame received by a unit at the given real time
+static void ABK_sim_receive(Unit &unit, const ABK_can_frame_t &frame, double real_rx, uint32_t latency) {
+    uint8_t seq;
+    uint32_t master_tx;
+    ABK_can_cue_t cue;
+
+    if (frame.id == ABK_CAN_ID_SYNC) {
+        ABK_can_sync_on_sync(&unit.sync, frame.data[0], unit.local(real_rx));
+    } else if (ABK_can_decode_followup(&frame, &seq, &master_tx)) {
+        ABK_can_sync_on_followup(&unit.sync, seq, master_tx, latency);
+    } else if (ABK_can_decode_cue(&frame, &cue)) {
+        if (unit.sync.synced)
+            unit.fires.push_back(unit.real(ABK_can_to_local(&unit.sync, cue.fire_at), real_rx));
+        else
+            unit.fires.push_back(-1.0);
+    }
+}
+
+static void ABK_sim_make_units(std::vector<Unit> &units, const Options &opt) {
+    std::mt19937 rng(1234);
+    std::uniform_real_distribution<double> ppm(-opt.ppm, opt.ppm);
+
+    units.resize(opt.units);
+    for (int i=0; i<opt.units; i++) {
+        units[i].node = i;
+        units[i].ppm = (i == 0) ? 0.0 : ppm(rng);
+        units[i].offset0 = rng();
+        units[i].fd = -1;
+        ABK_can_sync_init(&units[i].sync, i == ABK_CAN_NODE_MASTER);
+    }
+}
+
+// Discrete simulation with a virtual real time
+static void ABK_sim_run_bus(std::vector<Unit> &units, const Options &opt) {
+    std::mt19937 rng(42);
+    std::normal_distribution<double> jitter(0.0, opt.jitter);
+    Unit &master = units[0];
+    double t = 0.0;
+    uint8_t seq = 0;
+    int syncs_per_cue = std::max(1, 1000 / opt.sync_ms);
+
+    for (int cue=0; cue<opt.cues; cue++) {
+        for (int i=0; i<syncs_per_cue + (cue == 0 ? 10 : 0); i++) {
+            ABK_can_frame_t sync, followup;
+
+            t += opt.sync_ms * 1000.0;
+            ABK_can_encode_sync(&sync, seq);
+            ABK_can_encode_followup(&followup, seq, master.local(t));
+            seq++;
+
+            for (size_t u=1; u<units.size(); u++) {
+                ABK_sim_receive(units[u], sync, t + opt.latency + jitter(rng), (uint32_t) opt.latency);
+                ABK_sim_receive(units[u], followup, t + 2 * opt.latency, (uint32_t) opt.latency);
+            }
+        }
+
+        ABK_can_frame_t frame;
+        ABK_can_cue_t c;
+        c.cue = cue;
+        c.axes = 1;
+        c.fire_at = master.local(t) + opt.lead;
+        ABK_can_encode_cue(&frame, &c);
+
+        for (size_t u=0; u<units.size(); u++)
+            ABK_sim_receive(units[u], frame, t + opt.latency, (uint32_t) opt.latency);
+    }
+}
+
+static int ABK_sim_open(const char *iface) {
+    int fd = socket(PF_CAN, SOCK_RAW, CAN_RAW);
+    if (fd < 0)
+        return -1;
+
+    struct ifreq ifr;
+    memset(&ifr, 0, sizeof(ifr));
+    strncpy(ifr.ifr_name, iface, IFNAMSIZ - 1);
+    if (ioctl(fd, SIOCGIFINDEX, &ifr) < 0) {
+        close(fd);
+        return -1;
+    }
+
+    struct sockaddr_can addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.can_family = AF_CAN;
+    addr.can_ifindex = ifr.ifr_ifindex;
+    if (bind(fd, (struct sockaddr *) &addr, sizeof(addr)) < 0) {
+        close(fd);
+        return -1;
+    }
+
+    struct timeval tv = { 0, 100000 };
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+    return fd;
+}
+
+static bool ABK_sim_write(int fd, const ABK_can_frame_t &frame) {
+    struct can_frame cf;
+    memset(&cf, 0, sizeof(cf));
+    cf.can_id = frame.id;
+    cf.can_dlc = frame.len;
+    memcpy(cf.data, frame.data, 8);
+    return write(fd, &cf, sizeof(cf)) == sizeof(cf);
+}
+
+// Real time run over a SocketCAN interface, one receiving thread per slave
+static bool ABK_sim_run_vcan(std::vector<Unit> &units, const Options &opt) {
+    for (size_t u=0; u<units.size(); u++) {
+        units[u].fd = ABK_sim_open(opt.iface);
+        if (units[u].fd < 0) {
+            fprintf(stderr, "unable to open %s: %s\n", opt.iface, strerror(errno));
+            return false;
+        }
+    }
+
+    volatile bool running = true;
+    double start = ABK_sim_now_us();
+    std::vector<std::thread> threads;
+
+    for (size_t u=1; u<units.size(); u++) {
+        threads.push_back(std::thread([&units, u, start, &running]() {
+            struct can_frame cf;
+            while (running) {
+                if (read(units[u].fd, &cf, sizeof(cf)) != sizeof(cf))
+                    continue;
+
+                double rx = ABK_sim_now_us() - start;
+                ABK_can_frame_t frame;
+                frame.id = cf.can_id & CAN_SFF_MASK;
+                frame.len = cf.can_dlc;
+                memcpy(frame.data, cf.data, 8);
+                ABK_sim_receive(units[u], frame, rx, 0);
+            }
+        }));
+    }
+
+    Unit &master = units[0];
+    uint8_t seq = 0;
+    int syncs_per_cue = std::max(1, 1000 / opt.sync_ms);
+
+    for (int cue=0; cue<opt.cues; cue++) {
+        for (int i=0; i<syncs_per_cue + (cue == 0 ? 10 : 0); i++) {
+            ABK_can_frame_t frame;
+
+            usleep(opt.sync_ms * 1000);
+            ABK_can_encode_sync(&frame, seq);
+            uint32_t tx = master.local(ABK_sim_now_us() - start);
+            ABK_sim_write(master.fd, frame);
+            ABK_can_encode_followup(&frame, seq, tx);
+            ABK_sim_write(master.fd, frame);
+            seq++;
+        }
+
+        ABK_can_frame_t frame;
+        ABK_can_cue_t c;
+        double now = ABK_sim_now_us() - start;
+        c.cue = cue;
+        c.axes = 1;
+        c.fire_at = master.local(now) + opt.lead;
+        ABK_can_encode_cue(&frame, &c);
+        ABK_sim_write(master.fd, frame);
+        ABK_sim_receive(master, frame, now, 0);
+    }
+
+    usleep(200000);
+    running = false;
+    for (size_t i=0; i<threads.size(); i++)
+        threads[i].join();
+    for (size_t u=0; u<units.size(); u++)
+        close(units[u].fd);
+
+    return true;
+}
+
+static void ABK_sim_usage(const char *name) {
+    fprintf(stderr,
+"usage: %s [-i IFACE] [-n UNITS] [-c CUES] [-s SYNC_MS] [-p PPM] [-l LATENCY_US] [-j JITTER_US] [-m MAX_SKEW_US]\n\
+    -i IFACE    use a SocketCAN interface (e.g. vcan0) instead of the simulated bus\n", name);
+}
+
+int main(int argc, char **argv) {
+    Options opt;
+    int c;
+
+    while ((c = getopt(argc, argv, "i:n:c:s:p:l:j:m:h")) != -1) {
+        switch (c) {
+            case 'i': opt.iface = optarg; break;
+            case 'n': opt.units = atoi(optarg); break;
+            case 'c': opt.cues = atoi(optarg); break;
+            case 's': opt.sync_ms = atoi(optarg); break;
+            case 'p': opt.ppm = atof(optarg); break;
+            case 'l': opt.latency = atof(optarg); break;
+            case 'j': opt.jitter = atof(optarg); break;
+            case 'm': opt.max_skew = atof(optarg); break;
+            default:
+                ABK_sim_usage(argv[0]);
+                return 2;
+        }
+    }
+
+    if (opt.units < 2 || opt.units > ABK_CAN_MAX_NODES || opt.sync_ms <= 0) {
+        ABK_sim_usage(argv[0]);
+        return 2;
+    }
+
+    std::vector<Unit> units;
+    ABK_sim_make_units(units, opt);
+
+    if (opt.iface) {
+        if (!ABK_sim_run_vcan(units, opt))
+            return 1;
+    } else {
+        ABK_sim_run_bus(units, opt);
+    }
+
+    printf("units %d cues %d sync_ms %d transport %s\n", opt.units, opt.cues, opt.sync_ms,
+            opt.iface ? opt.iface : "simulated");
+    for (size_t u=0; u<units.size(); u++) {
+        printf("node%d.ppm %.1f node%d.worst_residual_us %d\n", units[u].node, units[u].ppm,
+                units[u].node, units[u].sync.worst_residual);
+    }
+
+    double worst = 0.0;
+    for (int cue=0; cue<opt.cues; cue++) {
+        double lo = 1e300, hi = -1e300;
+        int missing = 0;
+
+        for (size_t u=0; u<units.size(); u++) {
+            if ((int) units[u].fires.size() <= cue || units[u].fires[cue] < 0) {
+                missing++;
+                continue;
+            }
+            lo = std::min(lo, units[u].fires[cue]);
+            hi = std::max(hi, units[u].fires[cue]);
+        }
+
+        if (missing) {
+            printf("cue%d missed by %d units\n", cue, missing);
+            worst = 1e300;
+            continue;
+        }
+
+        printf("cue%d.skew_us %.2f\n", cue, hi - lo);
+        worst = std::max(worst, hi - lo);
+    }
+
+    bool ok = worst <= opt.max_skew;
+    printf("max_skew_us %.2f %s\n", worst, ok ? "PASS" : "FAIL");
+
+    return ok ? 0 : 1;
+}
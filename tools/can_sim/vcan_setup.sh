@@ -0,0 +1,7 @@
+#!/bin/sh
+# Create a virtual CAN interface for can_sim (needs root)
+IFACE=${1:-vcan0}
+
+modprobe vcan
+ip link add dev "$IFACE" type vcan 2>/dev/null
+ip link set up "$IFACE"
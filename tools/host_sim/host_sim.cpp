@@ -0,0 +1,624 @@
+/*
+ * host_sim.cpp
+ * Copyright (C) 2017 Benoit Rapidel <benoit.rapidel+devs@exmachina.fr>
+ *
+ * Distributed under terms of the MIT license.
+ */
+
+// Host simulation of the firmware.
+//
+// Implements the mbed subset declared in shim/ so that the unmodified
+// firmware (src/) runs as a Linux process. The console (USB CDC or UART) is
+// a pseudo terminal whose path is printed on stderr, the EEPROM and the flash
+// are files.
+//
+// Environment:
+//     ABK_HOST_LINK    symlink created to the console pty
+//     ABK_HOST_EEPROM  EEPROM image (host_eeprom.bin by default)
+//     ABK_HOST_FLASH   flash image (host_flash.bin by default), an image of the
+//                      running firmware belongs at 0x10000 for delta updates
+//     ABK_HOST_PINS    initial input levels, e.g. "P0_20=0,P0_17=1"
+
+#include "mbed.h"
+#include "USBSerial.h"
+#include "AT24Cxx_I2C.h"
+#include "ABKiap.h"
+#include "ABKupdproto.h"
+
+#include <stdarg.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#define HOST_PINS           (5 * 32)
+#define HOST_WRITE_TIMEOUT  (20)    // ms a console write may wait for the pty to drain
+#define HOST_ERASE_MS       (100)   // Per sector, LPC1768 datasheet
+#define HOST_WRITE_MS       (4)     // Per ABK_IAP_BLOCK_SIZE, 1ms per 256 bytes
+
+// Core
+
+uint32_t SystemCoreClock = 96000000;
+
+static LPC_WDT_TypeDef host_wdt;
+static LPC_SC_TypeDef host_sc;
+static LPC_PINCON_TypeDef host_pincon;
+static LPC_TIM_TypeDef host_tim[4];
+static LPC_PWM_TypeDef host_pwm1;
+static LPC_GPIO_TypeDef host_gpio[3];
+static DWT_Type host_dwt;
+static CoreDebug_Type host_core_debug;
+
+LPC_WDT_TypeDef *LPC_WDT = &host_wdt;
+LPC_SC_TypeDef *LPC_SC = &host_sc;
+LPC_PINCON_TypeDef *LPC_PINCON = &host_pincon;
+LPC_TIM_TypeDef *LPC_TIM0 = &host_tim[0], *LPC_TIM1 = &host_tim[1], *LPC_TIM2 = &host_tim[2], *LPC_TIM3 = &host_tim[3];
+LPC_PWM_TypeDef *LPC_PWM1 = &host_pwm1;
+LPC_GPIO_TypeDef *LPC_GPIO0 = &host_gpio[0], *LPC_GPIO1 = &host_gpio[1], *LPC_GPIO2 = &host_gpio[2];
+DWT_Type *DWT = &host_dwt;
+CoreDebug_Type *CoreDebug = &host_core_debug;
+
+static std::recursive_mutex host_critical;
+
+static uint64_t host_now_us(void) {
+    static const std::chrono::steady_clock::time_point boot = std::chrono::steady_clock::now();
+
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - boot).count();
+}
+
+uint32_t us_ticker_read(void) {
+    return (uint32_t) host_now_us();
+}
+
+void core_util_critical_section_enter(void) {
+    host_critical.lock();
+}
+
+void core_util_critical_section_exit(void) {
+    host_critical.unlock();
+}
+
+void sleep(void) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+}
+
+void wait_ms(int ms) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+void wait_us(int us) {
+    std::this_thread::sleep_for(std::chrono::microseconds(us));
+}
+
+// RTOS
+
+int Thread::start(void (*task)(void)) {
+    std::thread(task).detach();
+    return 0;
+}
+
+int Thread::wait(uint32_t ms) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+    return 0;
+}
+
+int Thread::yield(void) {
+    std::this_thread::yield();
+    return 0;
+}
+
+struct HostSemaphore {
+    std::mutex mutex;
+    std::condition_variable cond;
+    int32_t count;
+};
+
+Semaphore::Semaphore(int32_t count) {
+    HostSemaphore *sem = new HostSemaphore;
+    sem->count = count;
+    _impl = sem;
+}
+
+Semaphore::~Semaphore() {
+    delete (HostSemaphore *) _impl;
+}
+
+// Returns the number of tokens available before taking one, 0 on timeout
+int32_t Semaphore::wait(uint32_t ms) {
+    HostSemaphore *sem = (HostSemaphore *) _impl;
+    std::unique_lock<std::mutex> lock(sem->mutex);
+
+    if (ms == osWaitForever)
+        sem->cond.wait(lock, [sem] { return sem->count > 0; });
+    else
+        sem->cond.wait_for(lock, std::chrono::milliseconds(ms), [sem] { return sem->count > 0; });
+
+    if (sem->count == 0)
+        return 0;
+
+    return sem->count--;
+}
+
+int Semaphore::release(void) {
+    HostSemaphore *sem = (HostSemaphore *) _impl;
+    std::lock_guard<std::mutex> lock(sem->mutex);
+
+    sem->count++;
+    sem->cond.notify_one();
+    return 0;
+}
+
+Mutex::Mutex() {
+    _impl = new std::recursive_timed_mutex;
+}
+
+Mutex::~Mutex() {
+    delete (std::recursive_timed_mutex *) _impl;
+}
+
+int Mutex::lock(uint32_t ms) {
+    std::recursive_timed_mutex *mutex = (std::recursive_timed_mutex *) _impl;
+
+    if (ms == osWaitForever) {
+        mutex->lock();
+        return 0;
+    }
+
+    return mutex->try_lock_for(std::chrono::milliseconds(ms)) ? 0 : -1;
+}
+
+bool Mutex::trylock(void) {
+    return ((std::recursive_timed_mutex *) _impl)->try_lock();
+}
+
+int Mutex::unlock(void) {
+    ((std::recursive_timed_mutex *) _impl)->unlock();
+    return 0;
+}
+
+// Drivers
+
+void Timer::start(void) {
+    if (!_running) {
+        _start = host_now_us();
+        _running = true;
+    }
+}
+
+void Timer::stop(void) {
+    if (_running) {
+        _elapsed += host_now_us() - _start;
+        _running = false;
+    }
+}
+
+void Timer::reset(void) {
+    _start = host_now_us();
+    _elapsed = 0;
+}
+
+int Timer::read_us(void) {
+    return (int) (_elapsed + (_running ? host_now_us() - _start : 0));
+}
+
+// Each attachment gets its own thread, which exits once the ticker is detached or re-attached
+void Ticker::attach_us(void (*handler)(void), uint32_t us) {
+    uint32_t generation = ++_generation;
+    bool once = one_shot();
+
+    std::thread([this, generation, handler, us, once] {
+        std::chrono::steady_clock::time_point next = std::chrono::steady_clock::now();
+
+        do {
+            next += std::chrono::microseconds(us);
+            std::this_thread::sleep_until(next);
+
+            std::lock_guard<std::recursive_mutex> isr(host_critical);
+            if (_generation != generation)
+                return;
+            handler();
+        } while (!once);
+    }).detach();
+}
+
+void Ticker::detach(void) {
+    std::lock_guard<std::recursive_mutex> isr(host_critical);
+    _generation++;
+}
+
+// Pins
+
+static std::atomic<int> host_pins[HOST_PINS];
+
+// Ports 0 to 2 registers follow the pins, the firmware may read them at once
+static void host_sim_pin_mirror(PinName pin) {
+    LPC_GPIO_TypeDef *gpio = &host_gpio[pin / 32];
+
+    if (pin >= 3 * 32)
+        return;
+
+    if (host_pins[pin])
+        gpio->FIOPIN |= 1U << (pin % 32);
+    else
+        gpio->FIOPIN &= ~(1U << (pin % 32));
+}
+
+// Inputs are active low except the slow feed buttons: idle levels for the default IO map
+static void host_pins_init(void) {
+    static const PinName high[] = {
+        P0_15,  // VFD_STS
+        P0_17,  // EMERGENCY_STOP
+        P0_20,  // TRIGGER_INPUT
+        P0_21,  // VFD_STS_2
+        P0_22,  // TRIGGER_INPUT_2
+    };
+
+    for (unsigned int i=0; i<sizeof(high) / sizeof(high[0]); i++)
+        host_pins[high[i]] = 1;
+
+    const char *env = getenv("ABK_HOST_PINS");
+    int port, pin, value, n;
+
+    while (env && sscanf(env, "P%d_%d=%d%n", &port, &pin, &value, &n) == 3) {
+        if (port * 32 + pin < HOST_PINS)
+            host_pins[port * 32 + pin] = value;
+
+        env += n;
+        if (*env == ',')
+            env++;
+    }
+
+    for (int pin=0; pin<3 * 32; pin++)
+        host_sim_pin_mirror((PinName) pin);
+}
+
+int host_sim_pin_read(PinName pin) {
+    static std::once_flag init;
+    std::call_once(init, host_pins_init);
+
+    if (pin < 0 || pin >= HOST_PINS)
+        return 0;
+
+    return host_pins[pin];
+}
+
+void host_sim_pin_write(PinName pin, int value) {
+    host_sim_pin_read(pin);
+
+    if (pin >= 0 && pin < HOST_PINS) {
+        host_pins[pin] = value ? 1 : 0;
+        host_sim_pin_mirror(pin);
+    }
+}
+
+// Console
+
+static int host_console_fd = -1;
+static std::mutex host_console_rx_mutex;
+
+// The console may be opened by a constructor running before this file's own
+static std::deque<char> &host_console_rx(void) {
+    static std::deque<char> rx;
+    return rx;
+}
+
+static void (*host_console_handler)(void) = NULL;
+
+static void host_console_reader(void) {
+    char buf[64];
+
+    while (true) {
+        struct pollfd pfd = { host_console_fd, POLLIN, 0 };
+
+        if (poll(&pfd, 1, 100) <= 0)
+            continue;
+
+        int len = read(host_console_fd, buf, sizeof(buf));
+        if (len <= 0) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            continue;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(host_console_rx_mutex);
+            host_console_rx().insert(host_console_rx().end(), buf, buf + len);
+        }
+
+        std::lock_guard<std::recursive_mutex> isr(host_critical);
+        if (host_console_handler)
+            host_console_handler();
+    }
+}
+
+// The slave side stays open so the pty keeps its settings and never hangs up between clients
+static void host_console_open(void) {
+    if (host_console_fd >= 0)
+        return;
+
+    const char *fd = getenv("ABK_HOST_PTY_FD");
+    const char *path = getenv("ABK_HOST_PTY_PATH");
+
+    if (fd && path) { // Restarted by NVIC_SystemReset
+        host_console_fd = atoi(fd);
+    } else {
+        host_console_fd = posix_openpt(O_RDWR | O_NOCTTY);
+        if (host_console_fd < 0 || grantpt(host_console_fd) < 0 || unlockpt(host_console_fd) < 0) {
+            perror("host_sim: pty");
+            exit(1);
+        }
+
+        path = ptsname(host_console_fd);
+        setenv("ABK_HOST_PTY_PATH", path, 1);
+
+        const char *link = getenv("ABK_HOST_LINK");
+        if (link) {
+            unlink(link);
+            if (symlink(path, link) < 0)
+                perror("host_sim: symlink");
+        }
+    }
+
+    int slave = open(path, O_RDWR | O_NOCTTY);
+    struct termios tio;
+    if (slave >= 0 && tcgetattr(slave, &tio) == 0) {
+        cfmakeraw(&tio);
+        tcsetattr(slave, TCSANOW, &tio);
+    }
+
+    fcntl(host_console_fd, F_SETFL, fcntl(host_console_fd, F_GETFL) | O_NONBLOCK);
+    fprintf(stderr, "pty %s\n", path);
+
+    std::thread(host_console_reader).detach();
+}
+
+static int host_console_readable(void) {
+    std::lock_guard<std::mutex> lock(host_console_rx_mutex);
+    return host_console_rx().size();
+}
+
+static int host_console_getc(void) {
+    std::lock_guard<std::mutex> lock(host_console_rx_mutex);
+
+    std::deque<char> &rx = host_console_rx();
+
+    if (rx.empty())
+        return -1;
+
+    char c = rx.front();
+    rx.pop_front();
+    return (unsigned char) c;
+}
+
+// Like the USB CDC endpoint: gives up if nobody drains the other side
+static bool host_console_write(const uint8_t *buf, int len) {
+    uint32_t start = us_ticker_read();
+
+    while (len > 0) {
+        int n = write(host_console_fd, buf, len);
+
+        if (n > 0) {
+            buf += n;
+            len -= n;
+            continue;
+        }
+
+        if (n < 0 && errno != EAGAIN)
+            return false;
+        if (us_ticker_read() - start > HOST_WRITE_TIMEOUT * 1000)
+            return false;
+
+        struct pollfd pfd = { host_console_fd, POLLOUT, 0 };
+        poll(&pfd, 1, 1);
+    }
+
+    return true;
+}
+
+int Stream::printf(const char *format, ...) {
+    char line[256];
+    va_list args;
+
+    va_start(args, format);
+    int len = vsnprintf(line, sizeof(line), format, args);
+    va_end(args);
+
+    for (int i=0; i<len && i<(int) sizeof(line) - 1; i++)
+        putc(line[i]);
+
+    return len;
+}
+
+USBSerial::USBSerial(uint16_t vendor_id, uint16_t product_id, uint16_t product_release, bool connect_blocking) {
+    host_console_open();
+}
+
+void USBSerial::attach(void (*handler)(void)) {
+    std::lock_guard<std::recursive_mutex> isr(host_critical);
+    host_console_handler = handler;
+}
+
+bool USBSerial::writeBlock(uint8_t *buf, uint16_t size) {
+    return host_console_write(buf, size);
+}
+
+bool USBSerial::connected(void) {
+    return true;
+}
+
+int USBSerial::readable(void) {
+    return host_console_readable();
+}
+
+int USBSerial::getc(void) {
+    return host_console_getc();
+}
+
+int USBSerial::putc(int c) {
+    uint8_t ch = c;
+    return host_console_write(&ch, 1) ? c : -1;
+}
+
+int Serial::readable(void) {
+    host_console_open();
+    return host_console_readable();
+}
+
+int Serial::getc(void) {
+    return host_console_getc();
+}
+
+int Serial::putc(int c) {
+    uint8_t ch = c;
+    host_console_open();
+    return host_console_write(&ch, 1) ? c : -1;
+}
+
+// Re-executes the simulation, the console pty is inherited so clients stay connected
+void NVIC_SystemReset(void) {
+    std::vector<char> cmdline;
+    std::vector<char *> argv;
+    char buf[256];
+    int n;
+
+    int fd = open("/proc/self/cmdline", O_RDONLY);
+    while (fd >= 0 && (n = read(fd, buf, sizeof(buf))) > 0)
+        cmdline.insert(cmdline.end(), buf, buf + n);
+    if (fd >= 0)
+        close(fd);
+
+    for (size_t i=0; i<cmdline.size(); i += strlen(&cmdline[i]) + 1)
+        argv.push_back(&cmdline[i]);
+    argv.push_back(NULL);
+
+    if (host_console_fd >= 0) {
+        snprintf(buf, sizeof(buf), "%d", host_console_fd);
+        setenv("ABK_HOST_PTY_FD", buf, 1);
+        fcntl(host_console_fd, F_SETFD, 0);
+    }
+
+    fflush(stdout);
+    fprintf(stderr, "reset\n");
+    execv("/proc/self/exe", argv.data());
+
+    perror("host_sim: reset");
+    _exit(1);
+}
+
+// EEPROM
+
+AT24CXX_I2C::AT24CXX_I2C(I2C *i2c, int address) {
+    const char *path = getenv("ABK_HOST_EEPROM");
+
+    _fd = open(path ? path : "host_eeprom.bin", O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (_fd < 0) {
+        perror("host_sim: eeprom");
+        return;
+    }
+
+    // A new image reads as a blank chip
+    off_t size = lseek(_fd, 0, SEEK_END);
+    unsigned char blank[256];
+    memset(blank, 0xFF, sizeof(blank));
+    while (size < HOST_EEPROM_SIZE) {
+        int n = ::write(_fd, blank, std::min((off_t) sizeof(blank), HOST_EEPROM_SIZE - size));
+        if (n <= 0)
+            break;
+        size += n;
+    }
+}
+
+bool AT24CXX_I2C::read(int address, unsigned char *buf, int len) {
+    if (_fd < 0 || address < 0 || address + len > HOST_EEPROM_SIZE)
+        return false;
+
+    return pread(_fd, buf, len, address) == len;
+}
+
+bool AT24CXX_I2C::write(int address, unsigned char *buf, int len) {
+    if (_fd < 0 || address < 0 || address + len > HOST_EEPROM_SIZE)
+        return false;
+
+    return pwrite(_fd, buf, len, address) == len;
+}
+
+// Flash, written through the IAP calls of src/update/ABKiap.h
+
+static uint8_t *host_flash = NULL;
+
+static uint8_t *host_flash_open(void) {
+    const char *path = getenv("ABK_HOST_FLASH");
+
+    int fd = open(path ? path : "host_flash.bin", O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        perror("host_sim: flash");
+        exit(1);
+    }
+
+    // A new image reads as an erased chip
+    off_t size = lseek(fd, 0, SEEK_END);
+    unsigned char blank[4096];
+    memset(blank, 0xFF, sizeof(blank));
+    while (size < ABK_UPD_FLASH_SIZE) {
+        int n = ::write(fd, blank, std::min((off_t) sizeof(blank), ABK_UPD_FLASH_SIZE - size));
+        if (n <= 0)
+            break;
+        size += n;
+    }
+
+    void *map = mmap(NULL, ABK_UPD_FLASH_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        perror("host_sim: flash");
+        exit(1);
+    }
+
+    return (uint8_t *) map;
+}
+
+const uint8_t *ABK_iap_map(uint32_t address) {
+    if (host_flash == NULL)
+        host_flash = host_flash_open();
+
+    return host_flash + address;
+}
+
+bool ABK_iap_erase(uint32_t start, uint32_t end) {
+    uint8_t *flash = (uint8_t *) ABK_iap_map(0);
+
+    for (int i=ABK_upd_sector(start); i<=ABK_upd_sector(end - 1); i++) {
+        uint32_t address = (i < 16) ? i * 0x1000 : 0x10000 + (i - 16) * 0x8000;
+        uint32_t size = (i < 16) ? 0x1000 : 0x8000;
+
+        memset(flash + address, 0xFF, size);
+        std::this_thread::sleep_for(std::chrono::milliseconds(HOST_ERASE_MS));
+    }
+
+    return true;
+}
+
+// Like the chip, only erased flash can be written
+bool ABK_iap_write(uint32_t address, const uint8_t *buf) {
+    uint8_t *flash = (uint8_t *) ABK_iap_map(0);
+
+    if (address % ABK_IAP_BLOCK_SIZE != 0 || address + ABK_IAP_BLOCK_SIZE > ABK_UPD_FLASH_SIZE)
+        return false;
+
+    for (int i=0; i<ABK_IAP_BLOCK_SIZE; i++) {
+        if (flash[address + i] != 0xFF)
+            return false;
+    }
+
+    memcpy(flash + address, buf, ABK_IAP_BLOCK_SIZE);
+    std::this_thread::sleep_for(std::chrono::milliseconds(HOST_WRITE_MS));
+    return true;
+}
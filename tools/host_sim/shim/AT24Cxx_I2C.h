@@ -0,0 +1,29 @@
+/*
+ * AT24Cxx_I2C.h
+ * Copyright (C) 2017 Benoit Rapidel <benoit.rapidel+devs@exmachina.fr>
+ *
+ * Distributed under terms of the MIT license.
+ */
+
+// Host build of the firmware: the EEPROM is a file, blank (0xFF) when created
+
+#ifndef HOST_AT24CXX_I2C_H
+#define HOST_AT24CXX_I2C_H
+
+#include "mbed.h"
+
+#define HOST_EEPROM_SIZE    (32768)     // AT24C256
+
+class AT24CXX_I2C {
+
+public:
+    AT24CXX_I2C(I2C *i2c, int address);
+
+    bool read(int address, unsigned char *buf, int len);
+    bool write(int address, unsigned char *buf, int len);
+
+private:
+    int _fd;
+};
+
+#endif /* !HOST_AT24CXX_I2C_H */
@@ -0,0 +1,30 @@
+/*
+ * USBSerial.h
+ * Copyright (C) 2017 Benoit Rapidel <benoit.rapidel+devs@exmachina.fr>
+ *
+ * Distributed under terms of the MIT license.
+ */
+
+// Host build of the firmware: the USB CDC port is the simulation pty
+
+#ifndef HOST_USBSERIAL_H
+#define HOST_USBSERIAL_H
+
+#include "mbed.h"
+
+class USBSerial : public Stream {
+
+public:
+    USBSerial(uint16_t vendor_id=0x1f00, uint16_t product_id=0x2012, uint16_t product_release=0x0001,
+            bool connect_blocking=true);
+
+    void attach(void (*handler)(void));
+    bool writeBlock(uint8_t *buf, uint16_t size);
+    bool connected(void);
+
+    virtual int readable(void);
+    virtual int getc(void);
+    virtual int putc(int c);
+};
+
+#endif /* !HOST_USBSERIAL_H */
@@ -0,0 +1,40 @@
+/*
+ * can_api.h
+ * Copyright (C) 2017 Benoit Rapidel <benoit.rapidel+devs@exmachina.fr>
+ *
+ * Distributed under terms of the MIT license.
+ */
+
+// Host build of the firmware: a CAN controller alone on its bus, nothing is
+// ever received and transmitted frames are dropped
+
+#ifndef HOST_CAN_API_H
+#define HOST_CAN_API_H
+
+#include "mbed.h"
+
+typedef enum { CANStandard = 0, CANExtended, CANAny } CANFormat;
+typedef enum { CANData = 0, CANRemote } CANType;
+
+typedef struct {
+    unsigned int id;
+    unsigned char data[8];
+    unsigned char len;
+    CANFormat format;
+    CANType type;
+} CAN_Message;
+
+typedef enum { IRQ_RX = 0, IRQ_TX, IRQ_ERROR, IRQ_OVERRUN, IRQ_WAKEUP, IRQ_PASSIVE, IRQ_ARB, IRQ_BUS, IRQ_READY } CanIrqType;
+
+typedef struct { int index; } can_t;
+
+typedef void (*can_irq_handler)(uint32_t id, CanIrqType type);
+
+inline void can_init(can_t *obj, PinName rd, PinName td) {}
+inline int can_frequency(can_t *obj, int hz) { return 1; }
+inline void can_irq_init(can_t *obj, can_irq_handler handler, uint32_t id) {}
+inline void can_irq_set(can_t *obj, CanIrqType irq, uint32_t enable) {}
+inline int can_write(can_t *obj, CAN_Message msg, int cc) { return 1; }
+inline int can_read(can_t *obj, CAN_Message *msg, int handle) { return 0; }
+
+#endif /* !HOST_CAN_API_H */
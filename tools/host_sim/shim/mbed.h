@@ -0,0 +1,285 @@
+/*
+ * mbed.h
+ * Copyright (C) 2017 Benoit Rapidel <benoit.rapidel+devs@exmachina.fr>
+ *
+ * Distributed under terms of the MIT license.
+ */
+
+// Host build of the firmware: the subset of mbed-os 5 used by src/, on top of
+// POSIX threads. Interrupt handlers (Ticker, Timeout) run in their own thread
+// with the critical section held, so they stay atomic with respect to the
+// firmware critical sections as on the target. Peripheral registers are plain
+// memory.
+
+#ifndef HOST_MBED_H
+#define HOST_MBED_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <string>
+
+#include "PinNames.h"
+
+// Core
+
+extern uint32_t SystemCoreClock;
+
+uint32_t us_ticker_read(void);
+
+void core_util_critical_section_enter(void);
+void core_util_critical_section_exit(void);
+
+void sleep(void);
+void wait_ms(int ms);
+void wait_us(int us);
+
+typedef enum {
+    TIMER0_IRQn = 1,
+    TIMER1_IRQn,
+    TIMER2_IRQn,
+    TIMER3_IRQn,
+    PWM1_IRQn = 9,
+    CAN_IRQn = 25,
+} IRQn_Type;
+
+// Vectors are never taken on the host, don't even evaluate the handler address
+#define NVIC_SetVector(irq, vector) ((void) (irq))
+inline void NVIC_EnableIRQ(IRQn_Type) {}
+inline void NVIC_DisableIRQ(IRQn_Type) {}
+inline void NVIC_SetPriority(IRQn_Type, uint32_t) {}
+
+// Restarts the simulation in place, keeping the console pty
+void NVIC_SystemReset(void);
+
+// Peripheral registers
+
+typedef volatile uint32_t HOST_REG;
+
+typedef struct { HOST_REG WDMOD, WDTC, WDFEED, WDTV, WDCLKSEL; } LPC_WDT_TypeDef;
+typedef struct { HOST_REG PCONP, PCLKSEL0, PCLKSEL1, RSID; } LPC_SC_TypeDef;
+typedef struct { HOST_REG PINSEL0, PINSEL1, PINSEL2, PINSEL3, PINSEL4, PINMODE0, PINMODE1, PINMODE2, PINMODE3, PINMODE4; } LPC_PINCON_TypeDef;
+typedef struct { HOST_REG IR, TCR, TC, PR, PC, MCR, MR0, MR1, MR2, MR3, CCR, CR0, CR1, EMR, CTCR; } LPC_TIM_TypeDef;
+typedef struct { HOST_REG IR, TCR, TC, PR, PC, MCR, MR0, MR1, MR2, MR3, CCR, CR0, CR1, CR2, CR3, MR4, MR5, MR6, PCR, LER, CTCR; } LPC_PWM_TypeDef;
+typedef struct { HOST_REG FIODIR, FIOMASK, FIOPIN, FIOSET, FIOCLR; } LPC_GPIO_TypeDef;
+
+// Core debug, the cycle counter never moves on the host
+typedef struct { HOST_REG CTRL, CYCCNT; } DWT_Type;
+typedef struct { HOST_REG DEMCR; } CoreDebug_Type;
+
+#define DWT_CTRL_CYCCNTENA_Msk      (1UL << 0)
+#define CoreDebug_DEMCR_TRCENA_Msk  (1UL << 24)
+
+extern DWT_Type *DWT;
+extern CoreDebug_Type *CoreDebug;
+extern LPC_WDT_TypeDef *LPC_WDT;
+extern LPC_SC_TypeDef *LPC_SC;
+extern LPC_PINCON_TypeDef *LPC_PINCON;
+extern LPC_TIM_TypeDef *LPC_TIM0, *LPC_TIM1, *LPC_TIM2, *LPC_TIM3;
+extern LPC_PWM_TypeDef *LPC_PWM1;
+extern LPC_GPIO_TypeDef *LPC_GPIO0, *LPC_GPIO1, *LPC_GPIO2;
+
+// RTOS
+
+typedef enum {
+    osPriorityIdle = -3,
+    osPriorityLow = -2,
+    osPriorityBelowNormal = -1,
+    osPriorityNormal = 0,
+    osPriorityAboveNormal = 1,
+    osPriorityHigh = 2,
+    osPriorityRealtime = 3,
+} osPriority;
+
+#define osWaitForever 0xFFFFFFFF
+
+class Thread {
+
+public:
+    Thread(osPriority priority=osPriorityNormal, uint32_t stack_size=4096, unsigned char *stack_mem=NULL) {}
+
+    int start(void (*task)(void));
+
+    static int wait(uint32_t ms);
+    static int yield(void);
+    static void attach_idle_hook(void (*hook)(void)) {}    // The host never idles the MCU
+};
+
+class Semaphore {
+
+public:
+    Semaphore(int32_t count=0);
+    ~Semaphore();
+
+    int32_t wait(uint32_t ms=osWaitForever);
+    int release(void);
+
+private:
+    void *_impl;
+};
+
+class Mutex {
+
+public:
+    Mutex();
+    ~Mutex();
+
+    int lock(uint32_t ms=osWaitForever);
+    bool trylock(void);
+    int unlock(void);
+
+private:
+    void *_impl;
+};
+
+// Drivers
+
+class Timer {
+
+public:
+    Timer() : _running(false), _start(0), _elapsed(0) {}
+
+    void start(void);
+    void stop(void);
+    void reset(void);
+    int read_us(void);
+    int read_ms(void) { return read_us() / 1000; }
+    float read(void) { return read_us() / 1000000.0f; }
+
+private:
+    bool _running;
+    uint64_t _start;
+    uint64_t _elapsed;
+};
+
+class Ticker {
+
+public:
+    Ticker() : _generation(0) {}
+    virtual ~Ticker() { detach(); }
+
+    void attach_us(void (*handler)(void), uint32_t us);
+    void attach(void (*handler)(void), float s) { attach_us(handler, (uint32_t) (s * 1000000)); }
+    void detach(void);
+
+protected:
+    virtual bool one_shot(void) { return false; }
+
+private:
+    volatile uint32_t _generation;
+};
+
+class Timeout : public Ticker {
+
+protected:
+    virtual bool one_shot(void) { return true; }
+};
+
+// Pin levels are shared by every object on the same pin and mirrored in the
+// FIOPIN register of their port, see host_sim_pin_write()
+int host_sim_pin_read(PinName pin);
+void host_sim_pin_write(PinName pin, int value);
+
+// HAL
+typedef struct { PinName pin; } gpio_t;
+inline void gpio_init_in(gpio_t *obj, PinName pin) { obj->pin = pin; host_sim_pin_read(pin); }
+
+class DigitalIn {
+
+public:
+    DigitalIn(PinName pin) : _pin(pin) {}
+    DigitalIn(PinName pin, int mode) : _pin(pin) {}
+
+    int read(void) { return host_sim_pin_read(_pin); }
+    void mode(int mode) {}
+    operator int() { return read(); }
+
+private:
+    PinName _pin;
+};
+
+class DigitalOut {
+
+public:
+    DigitalOut(PinName pin, int value=0) : _pin(pin) { write(value); }
+
+    void write(int value) { host_sim_pin_write(_pin, value); }
+    int read(void) { return host_sim_pin_read(_pin); }
+    DigitalOut &operator=(int value) { write(value); return *this; }
+    DigitalOut &operator=(DigitalOut &rhs) { write(rhs.read()); return *this; }
+    operator int() { return read(); }
+
+private:
+    PinName _pin;
+};
+
+class InterruptIn {
+
+public:
+    InterruptIn(PinName pin) : _pin(pin) {}
+
+    void rise(void (*handler)(void)) {}
+    void fall(void (*handler)(void)) {}
+    int read(void) { return host_sim_pin_read(_pin); }
+    operator int() { return read(); }
+
+private:
+    PinName _pin;
+};
+
+class PwmOut {
+
+public:
+    PwmOut(PinName pin) : _pin(pin), _value(0), _period_us(20000) {}
+
+    void write(float value) { _value = value; }
+    float read(void) { return _value; }
+    void period_us(int us) { _period_us = us; }
+    void period_ms(int ms) { _period_us = ms * 1000; }
+    PwmOut &operator=(float value) { write(value); return *this; }
+    operator float() { return read(); }
+
+private:
+    PinName _pin;
+    float _value;
+    int _period_us;
+};
+
+class I2C {
+
+public:
+    I2C(PinName sda, PinName scl) {}
+
+    void frequency(int hz) {}
+};
+
+enum SerialParity { ParityNone = 0 };
+
+class Stream {
+
+public:
+    virtual ~Stream() {}
+
+    virtual int readable(void) = 0;
+    virtual int getc(void) = 0;
+    virtual int putc(int c) = 0;
+
+    int printf(const char *format, ...);
+};
+
+class Serial : public Stream {
+
+public:
+    Serial(PinName tx, PinName rx) {}
+
+    void baud(int baudrate) {}
+
+    virtual int readable(void);
+    virtual int getc(void);
+    virtual int putc(int c);
+};
+
+#endif /* !HOST_MBED_H */